@@ -0,0 +1,269 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "Color.hpp"
+#include "Image.hpp"
+#include "ImageView.hpp"
+#include "PixelKernels.hpp"
+#include "Rect.hpp"
+
+namespace ZD
+{
+  /*
+   *  Pixel sinks write runs of pixels to the target rows:
+   *    void fill(uint32_t *dest, uint32_t value, size_t count) const;
+   *    void copy(uint32_t *dest, const uint32_t *src, size_t count) const;
+   * */
+
+  // overwrites destination pixels
+  struct ReplaceSink
+  {
+    void fill(uint32_t *dest, uint32_t value, size_t count) const
+    {
+      Kernels::fill_span(dest, value, count);
+    }
+
+    void copy(uint32_t *dest, const uint32_t *src, size_t count) const
+    {
+      std::memcpy(dest, src, count * sizeof(uint32_t));
+    }
+  };
+
+  // skips pixels with alpha equal to 0
+  struct ColorKeySink
+  {
+    void fill(uint32_t *dest, uint32_t value, size_t count) const
+    {
+      if ((value & 0xff) != 0)
+        Kernels::fill_span(dest, value, count);
+    }
+
+    void copy(uint32_t *dest, const uint32_t *src, size_t count) const
+    {
+      Kernels::copy_keyed_row(dest, src, count);
+    }
+  };
+
+  // blending mode picked at run time
+  struct BlendSink
+  {
+    BlendMode mode { BlendMode::Replace };
+    PixelFormat::Type format { PixelFormat::BGRA }; // of copied pixels
+
+    void fill(uint32_t *dest, uint32_t value, size_t count) const
+    {
+      Kernels::blend_fill(dest, value, count, mode);
+    }
+
+    void copy(uint32_t *dest, const uint32_t *src, size_t count) const
+    {
+      Kernels::blend_row(dest, src, count, mode, format);
+    }
+  };
+
+  /*
+   *  Scalers map coordinates to target pixels, pixel x covers target
+   *  columns [x(x); x(x + 1)). Mapping can't decrease.
+   *    static constexpr bool IDENTITY;
+   *    int x(int v) const;
+   *    int y(int v) const;
+   * */
+
+  struct Unscaled
+  {
+    static constexpr bool IDENTITY = true;
+
+    constexpr int x(int v) const { return v; }
+    constexpr int y(int v) const { return v; }
+  };
+
+  // coordinates multiplied by positive factors, as in ScaledPainter
+  struct FactorScaler
+  {
+    static constexpr bool IDENTITY = false;
+
+    float x_scaler { 1.0f };
+    float y_scaler { 1.0f };
+
+    int x(int v) const { return v * x_scaler; }
+    int y(int v) const { return v * y_scaler; }
+  };
+
+  /*
+   *  Painter specialised at compile time for a pixel sink and a scaler.
+   *  There are no virtual calls and drawing works on whole rows. Every call
+   *  returns the changed area of the target (empty if nothing was drawn),
+   *  marking it is up to the caller.
+   *  Painter and ScaledPainter create one for a call when they need it.
+   * */
+  template<typename PixelSink, typename Scaler = Unscaled>
+  class BasicPainter
+  {
+  public:
+    BasicPainter(
+      Image &target, const Rect &clip, PixelSink sink = {},
+      Scaler scaler = {})
+    : target { target }
+    , clip { clip.intersected(Rect(0, 0, target.width(), target.height())) }
+    , sink { sink }
+    , scaler { scaler }
+    {
+    }
+
+    Rect set_pixel(int x, int y, uint32_t value)
+    {
+      return fill_rectangle(Rect(x, y, 1, 1), value);
+    }
+
+    // fills [x1; x2) of row y
+    Rect fill_span(int x1, int x2, int y, uint32_t value)
+    {
+      return fill_rectangle(Rect(x1, y, x2 - x1, 1), value);
+    }
+
+    Rect fill_rectangle(const Rect &rect, uint32_t value)
+    {
+      const Rect area = clip.intersected(to_target(rect));
+      if (area.is_empty())
+        return area;
+
+      const int t_width = target.width();
+      uint32_t *dest = row(area.top()) + area.left();
+      // whole rows are contiguous, filled as one span
+      if (area.width() == t_width)
+      {
+        sink.fill(dest, value, (size_t)(t_width) * area.height());
+        return area;
+      }
+
+      for (int y = area.top(); y < area.bottom(); ++y, dest += t_width)
+      {
+        sink.fill(dest, value, area.width());
+      }
+      return area;
+    }
+
+    // draws `source` part of the image with its top left corner at (x, y)
+    Rect draw_image(int x, int y, const ImageView &image, const Rect &source)
+    {
+      const Rect part =
+        source.intersected(Rect(0, 0, image.width(), image.height()));
+      if (part.is_empty())
+        return Rect();
+
+      x += part.left() - source.left();
+      y += part.top() - source.top();
+
+      if constexpr (Scaler::IDENTITY)
+        return copy_rows(x, y, image, part);
+      else
+        return scale_rows(x, y, image, part);
+    }
+
+  private:
+    Rect to_target(const Rect &rect) const
+    {
+      if constexpr (Scaler::IDENTITY)
+        return rect;
+
+      const int x1 = scaler.x(rect.left());
+      const int y1 = scaler.y(rect.top());
+      return Rect(
+        x1, y1, scaler.x(rect.right()) - x1, scaler.y(rect.bottom()) - y1);
+    }
+
+    uint32_t *row(int y)
+    {
+      return target.data.get() + (long)y * target.width();
+    }
+
+    Rect copy_rows(int x, int y, const ImageView &image, const Rect &part)
+    {
+      const Rect area =
+        clip.intersected(Rect(x, y, part.width(), part.height()));
+      if (area.is_empty())
+        return area;
+
+      const int t_width = target.width();
+      const int sx = part.left() + area.left() - x;
+      int sy = part.top() + area.top() - y;
+      uint32_t *dest = row(area.top()) + area.left();
+      if (image.is_compact())
+        row_buffer.resize(area.width());
+
+      for (int ty = area.top(); ty < area.bottom(); ++ty, ++sy)
+      {
+        const uint32_t *src =
+          image.get_pixels(sx, sy, area.width(), row_buffer.data());
+        sink.copy(dest, src, area.width());
+        dest += t_width;
+      }
+      return area;
+    }
+
+    /*
+     *  Every source pixel (i, j) covers the target block
+     *  [x(x + i); x(x + i + 1)) x [y(y + j); y(y + j + 1)). Visible columns
+     *  are gathered once per source row and copied to all its target rows.
+     * */
+    Rect scale_rows(int x, int y, const ImageView &image, const Rect &part)
+    {
+      const Rect area = clip.intersected(
+        to_target(Rect(x, y, part.width(), part.height())));
+      if (area.is_empty())
+        return area;
+
+      const size_t columns = area.width();
+      row_buffer.resize(columns);
+      column_offsets.resize(columns);
+
+      for (int i = 0; i < part.width(); ++i)
+      {
+        const int x1 = std::max(scaler.x(x + i), area.left());
+        const int x2 = std::min(scaler.x(x + i + 1), area.right());
+        for (int tx = x1; tx < x2; ++tx)
+        {
+          column_offsets[tx - area.left()] = i;
+        }
+      }
+
+      const int t_width = target.width();
+      if (image.is_compact())
+        source_buffer.resize(part.width());
+
+      for (int j = 0; j < part.height(); ++j)
+      {
+        const int y1 = std::max(scaler.y(y + j), area.top());
+        const int y2 = std::min(scaler.y(y + j + 1), area.bottom());
+        if (y1 >= y2)
+          continue;
+
+        const uint32_t *src = image.get_pixels(
+          part.left(), part.top() + j, part.width(), source_buffer.data());
+        Kernels::gather_row(
+          row_buffer.data(), src, column_offsets.data(), columns);
+
+        uint32_t *dest = row(y1) + area.left();
+        for (int ty = y1; ty < y2; ++ty, dest += t_width)
+        {
+          sink.copy(dest, row_buffer.data(), columns);
+        }
+      }
+      return area;
+    }
+
+    Image &target;
+    Rect clip;
+    PixelSink sink;
+    Scaler scaler;
+
+    std::vector<uint32_t> row_buffer;
+    std::vector<uint32_t> source_buffer; // expanded compact rows
+    std::vector<int32_t> column_offsets;
+  };
+
+} // namespace ZD
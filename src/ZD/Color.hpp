@@ -4,6 +4,7 @@
 #include <cstdint>
 #include <cstdio>
 #include <random>
+#include <type_traits>
 
 namespace ZD
 {
@@ -42,11 +43,57 @@ namespace ZD
 
       return 3;
     }
+
+    // bytes of a stored pixel, formats with fewer than 4 are stored natively
+    static constexpr int get_pixel_bytes(Type format)
+    {
+      switch (format)
+      {
+        case Type::Indexed:
+        case Type::Gray: return 1;
+        case Type::GrayAlpha: return 2;
+        default: return 4;
+      }
+    }
+
+    // colors of indexed images come from a palette, which has alpha
+    static constexpr bool has_alpha(Type format)
+    {
+      return format == Type::GrayAlpha || format == Type::RGBA ||
+             format == Type::BGRA || format == Type::Indexed;
+    }
   };
 
+  /*
+   *  How source pixels are combined with the destination.
+   *  Replace    - source overwrites destination (including alpha)
+   *  ColorKey   - as Replace but pixels with alpha equal to 0 are skipped
+   *  SrcOver    - "over" operator for straight (non-premultiplied) alpha
+   *  Additive   - source weighted by its alpha is added to destination
+   *  Multiply   - destination is multiplied by source weighted by its alpha
+   *  PremultipliedSrcOver - "over" operator for premultiplied alpha
+   *  Sources without alpha channel (see PixelFormat::has_alpha) are
+   *  treated as fully opaque by the blending modes.
+   * */
+  enum class BlendMode
+  {
+    Replace,
+    ColorKey,
+    SrcOver,
+    Additive,
+    Multiply,
+    PremultipliedSrcOver
+  };
+
+  /*
+   *  A single 32 bit BGRA value (see PixelFormat), trivially copyable, so
+   *  arrays of colors can be copied in bulk and reinterpreted as pixels.
+   * */
   class Color
   {
   public:
+    constexpr Color() = default;
+
     constexpr Color(uint32_t v)
     : color_value { v }
     {
@@ -59,11 +106,11 @@ namespace ZD
       set_value(red, green, blue, alpha);
     }
 
-    constexpr bool operator==(const Color &o)
+    constexpr bool operator==(const Color &o) const
     {
       return o.color_value == color_value;
     }
-    constexpr bool operator!=(const Color &o)
+    constexpr bool operator!=(const Color &o) const
     {
       return o.color_value != color_value;
     }
@@ -91,6 +138,12 @@ namespace ZD
 
     static constexpr Color from_value(uint32_t v) { return Color(v); }
 
+    // gray level in all color channels
+    static constexpr Color from_gray(u8 gray, u8 alpha = 255)
+    {
+      return Color(gray, gray, gray, alpha);
+    }
+
     inline constexpr void set_value(u8 r, u8 g, u8 b, u8 a = 255)
     {
       // internally BGRA
@@ -115,6 +168,12 @@ namespace ZD
       return (color_value >> ALPHA_BIT) & 0xff;
     }
 
+    // Rec. 601 luma in 8 bit fixed point
+    inline constexpr u8 gray() const
+    {
+      return (red() * 77 + green() * 150 + blue() * 29 + 128) >> 8;
+    }
+
     constexpr float red_float() const { return ((float)red()) / 255.0; }
     constexpr float green_float() const { return ((float)green()) / 255.0; }
     constexpr float blue_float() const { return ((float)blue()) / 255.0; }
@@ -132,12 +191,15 @@ namespace ZD
     }
 
   private:
-    uint32_t color_value { 0 };
+    static constexpr int RED_BIT = 8;
+    static constexpr int GREEN_BIT = 16;
+    static constexpr int BLUE_BIT = 24;
+    static constexpr int ALPHA_BIT = 0;
 
-    const int RED_BIT = 8;
-    const int GREEN_BIT = 16;
-    const int BLUE_BIT = 24;
-    const int ALPHA_BIT = 0;
+    uint32_t color_value { 0 };
   };
 
+  static_assert(sizeof(Color) == sizeof(uint32_t));
+  static_assert(std::is_trivially_copyable_v<Color>);
+
 } // namespace ZD
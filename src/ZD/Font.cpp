@@ -0,0 +1,133 @@
+#include "Font.hpp"
+
+#include <algorithm>
+
+namespace ZD
+{
+  std::shared_ptr<Font> Font::create(
+    const Image &atlas, const Size &cell_size, char first, bool proportional,
+    int spacing)
+  {
+    return std::shared_ptr<Font>(
+      new Font(atlas, cell_size, first, proportional, spacing));
+  }
+
+  std::shared_ptr<Font> Font::load(
+    std::string file_name, const Size &cell_size, char first,
+    bool proportional, int spacing)
+  {
+    auto atlas = Image::load(file_name);
+    if (!atlas || !atlas->is_valid())
+      return nullptr;
+
+    return create(*atlas, cell_size, first, proportional, spacing);
+  }
+
+  static uint8_t pixel_coverage(const Color &color, bool alpha)
+  {
+    if (alpha)
+      return color.alpha();
+
+    return (color.red() * 77 + color.green() * 150 + color.blue() * 29) >> 8;
+  }
+
+  Font::Font(
+    const Image &atlas, const Size &cell_size, char first, bool proportional,
+    int spacing)
+  : cell_size { cell_size }
+  {
+    const int cell_width = cell_size.width();
+    const int cell_height = cell_size.height();
+    if (cell_width <= 0 || cell_height <= 0)
+      return;
+
+    // characters without pixels (spaces and missing ones)
+    const int16_t empty_advance = proportional ? cell_width / 2 : cell_width;
+    for (auto &g : glyphs)
+    {
+      g.advance = empty_advance;
+    }
+
+    const bool alpha = PixelFormat::has_alpha(atlas.get_format());
+    const int columns = atlas.width() / cell_width;
+    const int cells = columns * (atlas.height() / cell_height);
+    std::vector<uint8_t> cell(cell_width * cell_height);
+
+    for (int i = 0; i < cells && (unsigned char)(first) + i < 256; i++)
+    {
+      const int cell_x = (i % columns) * cell_width;
+      const int cell_y = (i / columns) * cell_height;
+
+      int left = cell_width;
+      int right = 0;
+      int top = cell_height;
+      int bottom = 0;
+      for (int y = 0; y < cell_height; y++)
+      {
+        for (int x = 0; x < cell_width; x++)
+        {
+          const uint8_t c =
+            pixel_coverage(atlas.get_pixel(cell_x + x, cell_y + y), alpha);
+          cell[y * cell_width + x] = c;
+          if (c == 0)
+            continue;
+
+          left = std::min(left, x);
+          right = std::max(right, x + 1);
+          top = std::min(top, y);
+          bottom = std::max(bottom, y + 1);
+        }
+      }
+
+      if (left >= right)
+        continue;
+
+      Glyph &g = glyphs[(unsigned char)(first) + i];
+      g.x_offset = proportional ? 0 : left;
+      g.y_offset = top;
+      g.width = right - left;
+      g.height = bottom - top;
+      g.advance = proportional ? g.width + spacing : cell_width;
+      g.offset = coverage_data.size();
+
+      for (int y = top; y < bottom; y++)
+      {
+        const uint8_t *row = cell.data() + y * cell_width;
+        coverage_data.insert(coverage_data.end(), row + left, row + right);
+      }
+    }
+  }
+
+  Size Font::measure(std::string_view text) const
+  {
+    std::scoped_lock<std::mutex> lock(measured_mutex);
+
+    auto it = measured.find(text);
+    if (it != measured.end())
+      return it->second;
+
+    int width = 0;
+    int line_width = 0;
+    int lines = 1;
+    for (const char c : text)
+    {
+      if (c == '\n')
+      {
+        line_width = 0;
+        lines++;
+        continue;
+      }
+
+      line_width += glyph(c).advance;
+      width = std::max(width, line_width);
+    }
+
+    if (measured.size() >= MAX_MEASURED)
+      measured.clear();
+
+    const Size size(width, lines * line_height());
+    measured.emplace(text, size);
+    return size;
+  }
+
+} // namespace ZD
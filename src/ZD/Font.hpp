@@ -0,0 +1,115 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "Image.hpp"
+#include "Size.hpp"
+
+namespace ZD
+{
+  /*
+   *  Bitmap font cut from an atlas image: a grid of equally sized cells
+   *  holding consecutive characters row by row, starting at `first`.
+   *  Coverage of every glyph (alpha, or brightness for atlases without
+   *  alpha) is cached once, trimmed to its visible pixels, so the atlas
+   *  isn't needed afterwards.
+   *  Proportional fonts advance by the visible width of a glyph plus
+   *  `spacing`, monospaced ones by the cell width.
+   * */
+  class Font
+  {
+  public:
+    struct Glyph
+    {
+      int16_t x_offset; // of the visible part, from the pen position
+      int16_t y_offset;
+      int16_t width;
+      int16_t height;
+      int16_t advance;
+      uint32_t offset; // of the first coverage row, rows are `width` long
+    };
+
+    static std::shared_ptr<Font> create(
+      const Image &atlas, const Size &cell_size, char first = ' ',
+      bool proportional = false, int spacing = 1);
+    static std::shared_ptr<Font> load(
+      std::string file_name, const Size &cell_size, char first = ' ',
+      bool proportional = false, int spacing = 1);
+
+    int line_height() const { return cell_size.height(); }
+    const Size &get_cell_size() const { return cell_size; }
+
+    // characters missing in the atlas have no pixels, only an advance
+    const Glyph &glyph(char c) const { return glyphs[(unsigned char)(c)]; }
+    const uint8_t *coverage(const Glyph &g) const
+    {
+      return coverage_data.data() + g.offset;
+    }
+
+    /*
+     *  Calls func(x, y, glyph) for every visible glyph, at its position
+     *  relative to the start of the text. '\n' starts a new line.
+     * */
+    template<typename Func>
+    void for_each_glyph(std::string_view text, Func func) const
+    {
+      int pen_x = 0;
+      int pen_y = 0;
+      for (const char c : text)
+      {
+        if (c == '\n')
+        {
+          pen_x = 0;
+          pen_y += line_height();
+          continue;
+        }
+
+        const Glyph &g = glyph(c);
+        if (g.width > 0)
+          func(pen_x + g.x_offset, pen_y + g.y_offset, g);
+        pen_x += g.advance;
+      }
+    }
+
+    /*
+     *  Width of the longest line (sum of advances) and height of all lines.
+     *  Results are cached, measuring the same strings every frame is cheap.
+     * */
+    Size measure(std::string_view text) const;
+
+  private:
+    // measured strings kept at once, the cache is emptied when it is full
+    static constexpr size_t MAX_MEASURED = 256;
+
+    Font(
+      const Image &atlas, const Size &cell_size, char first, bool proportional,
+      int spacing);
+
+    // lets the cache be searched by string_view, without copying the text
+    struct TextHash
+    {
+      using is_transparent = void;
+      size_t operator()(std::string_view text) const
+      {
+        return std::hash<std::string_view> {}(text);
+      }
+    };
+
+    Size cell_size;
+    std::array<Glyph, 256> glyphs {};
+    std::vector<uint8_t> coverage_data;
+
+    mutable std::mutex measured_mutex;
+    mutable std::unordered_map<std::string, Size, TextHash, std::equal_to<>>
+      measured;
+  };
+
+} // namespace ZD
@@ -0,0 +1,109 @@
+#include "FrameDiff.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#pragma GCC optimize("O3")
+
+namespace ZD
+{
+  const std::vector<Rect> &FrameDiff::compare(
+    const uint32_t *pixels, const Size &size)
+  {
+    changed_rects.clear();
+    const size_t area = (size_t)(size.width()) * size.height();
+    if (area == 0)
+      return changed_rects;
+
+    if (previous.size() != area || this->size.width() != size.width())
+    {
+      this->size = size;
+      previous.assign(pixels, pixels + area);
+      changed_rects.push_back(Rect(0, 0, size.width(), size.height()));
+      return changed_rects;
+    }
+
+    first_changed_row.resize((size.width() + TILE_SIZE - 1) / TILE_SIZE);
+    for (int top = 0; top < size.height(); top += TILE_SIZE)
+    {
+      compare_tile_row(pixels, top, std::min(top + TILE_SIZE, size.height()));
+    }
+    return changed_rects;
+  }
+
+  /*
+   *  Rows are compared in memory order, once a tile differs the rest of its
+   *  rows are only copied. Copying starts at the first differing row, rows
+   *  above it are already equal.
+   * */
+  void FrameDiff::compare_tile_row(const uint32_t *pixels, int top, int bottom)
+  {
+    const int width = size.width();
+    const int tiles = first_changed_row.size();
+    std::fill(first_changed_row.begin(), first_changed_row.end(), -1);
+
+    for (int y = top; y < bottom; ++y)
+    {
+      const size_t row = (size_t)(y) * width;
+      for (int tile = 0; tile < tiles; ++tile)
+      {
+        if (first_changed_row[tile] >= 0)
+          continue;
+
+        const int left = tile * TILE_SIZE;
+        const size_t bytes =
+          std::min(TILE_SIZE, width - left) * sizeof(uint32_t);
+        if (memcmp(pixels + row + left, previous.data() + row + left, bytes))
+          first_changed_row[tile] = y;
+      }
+    }
+
+    int run_start = -1;
+    for (int tile = 0; tile <= tiles; ++tile)
+    {
+      const bool changed = tile < tiles && first_changed_row[tile] >= 0;
+      if (changed)
+      {
+        const int left = tile * TILE_SIZE;
+        const int columns = std::min(TILE_SIZE, width - left);
+        for (int y = first_changed_row[tile]; y < bottom; ++y)
+        {
+          const size_t offset = (size_t)(y) * width + left;
+          std::copy_n(pixels + offset, columns, previous.data() + offset);
+        }
+        if (run_start < 0)
+          run_start = tile;
+        continue;
+      }
+
+      if (run_start >= 0)
+      {
+        const int left = run_start * TILE_SIZE;
+        const int right = std::min(tile * TILE_SIZE, width);
+        add_changed(Rect(left, top, right - left, bottom - top));
+        run_start = -1;
+      }
+    }
+  }
+
+  void FrameDiff::add_changed(const Rect &rect)
+  {
+    for (auto &changed : changed_rects)
+    {
+      const bool above = changed.bottom() == rect.top() &&
+                         changed.left() == rect.left() &&
+                         changed.width() == rect.width();
+      if (above)
+      {
+        changed = Rect(
+          changed.left(),
+          changed.top(),
+          changed.width(),
+          changed.height() + rect.height());
+        return;
+      }
+    }
+    changed_rects.push_back(rect);
+  }
+
+} // namespace ZD
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Rect.hpp"
+#include "Size.hpp"
+
+namespace ZD
+{
+  /*
+   *  Finds what changed between consecutive frames by comparing them with
+   *  a copy of the previous one, TILE_SIZE x TILE_SIZE tiles at a time.
+   *  Meant for images written behind the change counter's back (e.g. with
+   *  Image::set_data). Runs of changed tiles become rectangles, and runs
+   *  right below each other with the same columns are merged.
+   * */
+  class FrameDiff
+  {
+  public:
+    static constexpr int TILE_SIZE = 64;
+
+    /*
+     *  Changed areas of the frame since the previous call, empty when
+     *  nothing changed. The first frame (and every frame after a size
+     *  change or reset) is changed as a whole.
+     * */
+    const std::vector<Rect> &compare(const uint32_t *pixels, const Size &size);
+    // next frame is reported as changed as a whole
+    void reset() { previous.clear(); }
+
+  private:
+    // compares rows [top; bottom) of all tiles in a row of tiles
+    void compare_tile_row(const uint32_t *pixels, int top, int bottom);
+    void add_changed(const Rect &rect);
+
+    Size size { 0, 0 };
+    std::vector<uint32_t> previous;
+    std::vector<int> first_changed_row; // of every tile, -1 if unchanged
+    std::vector<Rect> changed_rects;
+  };
+
+} // namespace ZD
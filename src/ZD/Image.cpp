@@ -1,21 +1,28 @@
+#include <algorithm>
 #include <cstring>
+#include <limits>
 #include <memory>
+#include <new>
 #include <unordered_map>
 
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
 #include "Image.hpp"
 #include "ImageLoader.hpp"
+#include "ImageView.hpp"
+#include "PixelKernels.hpp"
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "3rd/stb_image_write.h"
 
-#define JPEG_QUALITY 100
-
 #pragma GCC optimize("O3")
 namespace ZD
 {
-  std::shared_ptr<Image> Image::load(std::string file_name, ForceReload reload)
+  std::shared_ptr<Image> Image::load(std::string file_name, ForceReload reload, KeepGray keep_gray)
   {
-    return ImageLoader::load(file_name, reload);
+    return ImageLoader::load(file_name, reload, keep_gray);
   }
 
   std::shared_ptr<Image> Image::create(const Size &size, PixelFormat::Type format)
@@ -31,60 +38,243 @@ namespace ZD
     return image;
   }
 
+  std::shared_ptr<Image> Image::create(const Size &size, std::shared_ptr<Palette> palette)
+  {
+    std::shared_ptr<Image> image = std::shared_ptr<Image>(new Image(size, PixelFormat::Indexed));
+    image->palette = palette;
+    return image;
+  }
+
   Image::Image(const Size &size, PixelFormat::Type format)
   : size { size }
   , format { format }
   {
     size_t data_size = size.area();
-    this->data.reset(new uint32_t[data_size]);
+    if (is_compact())
+    {
+      const size_t bytes = data_size * PixelFormat::get_pixel_bytes(format);
+      this->samples.reset(new uint8_t[bytes]);
+      memset(samples.get(), 0, bytes);
+      if (format == PixelFormat::Indexed)
+        this->palette = Palette::create();
+      return;
+    }
+
+    this->data = allocate_pixels(data_size);
 
     memset(data.get(), 0, data_size * sizeof(uint32_t));
   }
 
-  bool Image::save_to_file(std::string file_name)
+  Image::Pixels Image::allocate_pixels(size_t count, bool huge_pages)
+  {
+    size_t bytes = std::max<size_t>(count, 1) * sizeof(uint32_t);
+    const size_t alignment = huge_pages && bytes >= HUGE_PAGE_SIZE ? HUGE_PAGE_SIZE : PIXELS_ALIGNMENT;
+    // aligned_alloc needs a multiple of the alignment
+    bytes = (bytes + alignment - 1) / alignment * alignment;
+
+    Pixels pixels((uint32_t *)(aligned_alloc(alignment, bytes)));
+    if (!pixels)
+      throw std::bad_alloc();
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    if (alignment == HUGE_PAGE_SIZE)
+      madvise(pixels.get(), bytes, MADV_HUGEPAGE);
+#endif
+    return pixels;
+  }
+
+  // pixels are contiguous, so the whole image is a single span
+  void Image::clear(Color color)
   {
-    size_t file_ext_pos = file_name.find_last_of(".");
-    std::string file_ext = "png";
-    if (file_ext_pos != std::string::npos)
+    assert(!is_indexed());
+    rle_valid = false;
+    switch (format)
     {
-      file_ext = file_name.substr(file_ext_pos + 1);
+      case PixelFormat::Gray: memset(samples.get(), color.gray(), size.area()); break;
+      case PixelFormat::GrayAlpha:
+      {
+        const GrayAlphaPixel pixel { color.gray(), color.alpha() };
+        auto pixels = view<GrayAlphaPixel>().row(0);
+        std::fill_n(pixels, size.area(), pixel);
+        break;
+      }
+      default: Kernels::fill_span(data.get(), color.value(), size.area()); break;
     }
-    else
+  }
+
+  void Image::expand_pixels(int x, int y, size_t length, uint32_t *buffer) const
+  {
+    const long offset = x + (long)y * size.width();
+    switch (format)
     {
-      file_name += ".";
-      file_name += file_ext;
+      case PixelFormat::Indexed:
+        Kernels::expand_indexed_row(buffer, samples.get() + offset, palette->get_data(), length);
+        break;
+      case PixelFormat::Gray: Kernels::expand_gray_row(buffer, samples.get() + offset, length); break;
+      case PixelFormat::GrayAlpha: Kernels::expand_gray_alpha_row(buffer, samples.get() + 2 * offset, length); break;
+      default: assert(false);
     }
-    printf("Saving %p to file '%s' (ext=%s).\n", (void *)(this), file_name.data(), file_ext.data());
+  }
 
-    const auto w = size.width();
-    const auto h = size.height();
-    const auto comp = PixelFormat::get_components_num(format);
+  void Image::set_palette(std::shared_ptr<Palette> new_palette)
+  {
+    palette = new_palette;
+    mark_changed();
+  }
 
-    uint8_t *u8_data = ImageLoader::u32_to_u8(data.get(), w, h, comp);
+  Image::~Image() = default;
 
-    bool ret = false;
-    if (file_ext == "png")
+  const RleImage &Image::get_rle() const
+  {
+    std::scoped_lock<std::mutex> lock(rle_mutex);
+    if (!rle_valid)
     {
-      ret = stbi_write_png(file_name.data(), w, h, comp, u8_data, size.width() * comp) > 0;
+      rle = std::make_unique<RleImage>(*this);
+      rle_valid = true;
     }
-    else if (file_ext == "bmp")
+    return *rle;
+  }
+
+  void Image::reset_change_counter()
+  {
+    changes = 0;
+    whole_changed = false;
+    changed_rects.clear();
+    cheapest_pair.reset();
+  }
+
+  void Image::mark_changed()
+  {
+    rle_valid = false;
+    changes++;
+    whole_changed = true;
+    changed_rects.assign(1, Rect(0, 0, width(), height()));
+    cheapest_pair.reset();
+  }
+
+  void Image::mark_changed(const Rect &rect)
+  {
+    const Rect bounds(0, 0, width(), height());
+    const Rect changed = bounds.intersected(rect);
+    if (changed.is_empty())
+      return;
+
+    rle_valid = false;
+    changes++;
+    if (whole_changed)
+      return;
+
+    if (!add_changed_rect(changed))
+      return;
+
+    long changed_area = 0;
+    for (const auto &r : changed_rects)
     {
-      ret = stbi_write_bmp(file_name.data(), w, h, comp, u8_data) > 0;
+      changed_area += r.area();
     }
-    else if (file_ext == "tga")
+
+    // uploading a few big parts costs more than a single whole image
+    if (changed_area * 2 >= bounds.area())
     {
-      // TODO: TGA not always works
-      ret = stbi_write_tga(file_name.data(), w, h, comp, u8_data) > 0;
+      whole_changed = true;
+      changed_rects.assign(1, bounds);
+      cheapest_pair.reset();
     }
-    else if (file_ext == "jpg")
+  }
+
+  bool Image::add_changed_rect(Rect changed)
+  {
+    while (true)
     {
-      ret = stbi_write_jpg(file_name.data(), w, h, comp, u8_data, JPEG_QUALITY) > 0;
+      // overlapping and neighbouring rectangles (e.g. pixels of a row) are
+      // merged into one
+      for (size_t i = 0; i < changed_rects.size();)
+      {
+        const Rect &r = changed_rects[i];
+        if (r.contains(changed))
+          return false;
+
+        // sharing a whole side
+        const bool neighbour =
+          (r.top() == changed.top() && r.height() == changed.height() &&
+           (r.right() == changed.left() || changed.right() == r.left())) ||
+          (r.left() == changed.left() && r.width() == changed.width() &&
+           (r.bottom() == changed.top() || changed.bottom() == r.top()));
+        if (neighbour || r.intersects(changed))
+        {
+          changed = changed.united(r);
+          changed_rects.erase(changed_rects.begin() + i);
+          i = 0;
+          continue;
+        }
+        i++;
+      }
+
+      if (changed_rects.size() < MAX_CHANGED_RECTS)
+        break;
+
+      /*
+       *  Too many rectangles, either the one growing the least takes the new
+       *  one in, or the pair of others wasting the least area is merged.
+       *  The pair is kept until one of its rectangles changes, so scattered
+       *  pixels usually cost a single pass over the rectangles.
+       * */
+      size_t host = 0;
+      long host_waste = std::numeric_limits<long>::max();
+      for (size_t i = 0; i < changed_rects.size(); i++)
+      {
+        const Rect &r = changed_rects[i];
+        const long waste = r.united(changed).area() - r.area() - changed.area();
+        if (waste < host_waste)
+        {
+          host_waste = waste;
+          host = i;
+        }
+      }
+
+      const ChangedPair pair = find_cheapest_pair();
+      if (pair.waste < host_waste)
+      {
+        std::erase(changed_rects, pair.a);
+        std::erase(changed_rects, pair.b);
+        cheapest_pair.reset();
+        add_changed_rect(pair.a.united(pair.b));
+        continue;
+      }
+
+      changed = changed.united(changed_rects[host]);
+      changed_rects.erase(changed_rects.begin() + host);
     }
+    changed_rects.push_back(changed);
+    return true;
+  }
 
-    delete[] u8_data;
+  Image::ChangedPair Image::find_cheapest_pair()
+  {
+    auto present = [this](const Rect &r) {
+      return std::find(changed_rects.begin(), changed_rects.end(), r) !=
+             changed_rects.end();
+    };
+    if (cheapest_pair && present(cheapest_pair->a) && present(cheapest_pair->b))
+      return *cheapest_pair;
 
-    assert(ret);
+    ChangedPair best { Rect(), Rect(), std::numeric_limits<long>::max() };
+    for (size_t a = 0; a < changed_rects.size(); a++)
+    {
+      for (size_t b = a + 1; b < changed_rects.size(); b++)
+      {
+        const Rect &ra = changed_rects[a];
+        const Rect &rb = changed_rects[b];
+        const long waste = ra.united(rb).area() - ra.area() - rb.area();
+        if (waste < best.waste)
+          best = ChangedPair { ra, rb, waste };
+      }
+    }
+    cheapest_pair = best;
+    return best;
+  }
 
-    return ret;
+  bool Image::save_to_file(std::string file_name) const
+  {
+    return ImageView(*this).save_to_file(file_name);
   }
 } // namespace ZD
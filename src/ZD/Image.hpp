@@ -1,52 +1,148 @@
 #pragma once
 
 #include <cassert>
+#include <cstdlib>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <string.h>
 #include <string_view>
+#include <vector>
 
+#include "Rect.hpp"
 #include "Size.hpp"
 #include "Color.hpp"
 #include "File.hpp"
+#include "Palette.hpp"
+#include "PixelView.hpp"
+#include "RleImage.hpp"
 
 namespace ZD
 {
+  // whether 1 and 2 channel files load as Gray and GrayAlpha images, instead of BGRA ones
+  enum class KeepGray
+  {
+    No = 0,
+    Yes = 1
+  };
+
+  /*
+   *  Pixels are stored as 32 bit BGRA values, except compact formats, which keep their native
+   *  width: PixelFormat::Indexed images store 8 bit palette indices (see get_indices and
+   *  get_palette), PixelFormat::Gray and PixelFormat::GrayAlpha images store 1 and 2 bytes
+   *  per pixel. Compact pixels are expanded to BGRA when they are read with get_pixel,
+   *  get_pixels or drawn with Painter, and can be accessed directly through view. Parts of
+   *  images are passed around without copying as ImageView.
+   * */
   class Image
   {
   public:
-    static std::shared_ptr<Image> load(std::string file_name, ForceReload reload = ForceReload::No);
+    /*
+     *  Loads BGRA images, gray files too. With KeepGray::Yes gray files stay compact (masks,
+     *  heightmaps), they can be drawn and uploaded but not painted on or filtered.
+     * */
+    static std::shared_ptr<Image> load(
+      std::string file_name, ForceReload reload = ForceReload::No, KeepGray keep_gray = KeepGray::No);
     static std::shared_ptr<Image> create(const Size &size, PixelFormat::Type format = PixelFormat::BGR);
     static std::shared_ptr<Image> create(const Size &, const Color &, PixelFormat::Type format = PixelFormat::BGR);
+    // indexed image with all indices equal to 0
+    static std::shared_ptr<Image> create(const Size &, std::shared_ptr<Palette> palette);
 
     bool is_empty() const { return !size.is_valid(); }
-    bool is_null() const { return data == NULL; }
+    bool is_null() const { return is_compact() ? samples == NULL : data == NULL; }
     bool is_valid() const { return !is_empty() && !is_null(); }
     PixelFormat::Type get_format() const { return format; }
     Size get_size() const { return size; }
     int width() const { return size.width(); }
     int height() const { return size.height(); }
+    bool is_indexed() const { return format == PixelFormat::Indexed; }
+    // pixels stored with fewer than 32 bits, they can't be painted on
+    bool is_compact() const { return PixelFormat::get_pixel_bytes(format) < 4; }
+    // null for compact images
     const uint32_t *get_data() const { return data.get(); }
 
-    inline Color get_pixel(int x, int y) const { return data[x + y * size.width()]; }
+    inline Color get_pixel(int x, int y) const
+    {
+      const long i = x + (long)y * size.width();
+      switch (format)
+      {
+        case PixelFormat::Indexed: return palette->get_color(samples[i]);
+        case PixelFormat::Gray: return Color::from_gray(samples[i]);
+        case PixelFormat::GrayAlpha: return Color::from_gray(samples[2 * i], samples[2 * i + 1]);
+        default: return data[i];
+      }
+    }
 
-    void set_data(const uint32_t *other_data, size_t area) { memcpy(data.get(), other_data, area * sizeof(uint32_t)); }
+    /*
+     *  `length` pixels of row y starting at column x. Compact images are expanded (indexed
+     *  ones through the palette) to `buffer`, other images return a pointer to their own data.
+     * */
+    inline const uint32_t *get_pixels(int x, int y, size_t length, uint32_t *buffer) const
+    {
+      if (!is_compact())
+        return data.get() + x + (long)y * size.width();
+      expand_pixels(x, y, length, buffer);
+      return buffer;
+    }
 
-    void set_pixel(int x, int y, Color color) { data[x + y * size.width()] = color.value(); }
+    void set_data(const uint32_t *other_data, size_t area)
+    {
+      assert(!is_compact());
+      memcpy(data.get(), other_data, area * sizeof(uint32_t));
+      rle_valid = false;
+    }
 
-    void clear(Color color = Color(0))
+    // gray images keep the luma (and alpha) of the color
+    void set_pixel(int x, int y, Color color)
     {
-      uint32_t v = color.value();
-      if (v < 255)
+      assert(!is_indexed());
+      const long i = x + (long)y * size.width();
+      switch (format)
       {
-        memset(data.get(), v, size.area() * sizeof(uint32_t));
-      }
-      else
-      {
-        std::fill(data.get(), data.get() + size.area(), v);
+        case PixelFormat::Gray: samples[i] = color.gray(); break;
+        case PixelFormat::GrayAlpha:
+          samples[2 * i] = color.gray();
+          samples[2 * i + 1] = color.alpha();
+          break;
+        default: data[i] = color.value(); break;
       }
+      rle_valid = false;
     }
 
+    /*
+     *  Pixels in their stored form, Pixel has to match the format (see PixelView).
+     *  Changes made through the view have to be marked with mark_changed.
+     * */
+    template<typename Pixel> PixelView<Pixel> view()
+    {
+      return PixelView<Pixel>(stored_pixels<Pixel>(), size.width(), size.height(), size.width());
+    }
+    template<typename Pixel> PixelView<const Pixel> view() const
+    {
+      return PixelView<const Pixel>(stored_pixels<Pixel>(), size.width(), size.height(), size.width());
+    }
+
+    // only for indexed images
+    const uint8_t *get_indices() const { return samples.get(); }
+    uint8_t get_index(int x, int y) const { return samples[x + y * size.width()]; }
+    void set_index(int x, int y, uint8_t index)
+    {
+      samples[x + y * size.width()] = index;
+      rle_valid = false;
+    }
+    void fill_indices(uint8_t index)
+    {
+      memset(samples.get(), index, size.area());
+      rle_valid = false;
+    }
+
+    const std::shared_ptr<Palette> &get_palette() const { return palette; }
+    // swaps the palette without touching the pixels, the whole image is marked as changed
+    void set_palette(std::shared_ptr<Palette> new_palette);
+
+    void clear(Color color = Color(0));
+
     inline void print() const
     {
       printf("Image %p (%d; %d)\n{\n", (void *)(this), size.width(), size.height());
@@ -55,30 +151,107 @@ namespace ZD
         printf(" ");
         for (int x = 0; x < size.width(); x++)
         {
-          printf("%x ", data[x + y * size.width()]);
+          printf("%x ", get_pixel(x, y).value());
         }
         printf("\n");
       }
       printf("}\n");
     }
 
-    bool save_to_file(std::string file_name);
+    // see ImageView::save_to_file for saving a part of the image
+    bool save_to_file(std::string file_name) const;
 
     unsigned int change_counter() { return changes; }
     bool is_changed() { return changes > 0; }
-    void reset_change_counter() { changes = 0; }
+    void reset_change_counter();
+
+    /*
+     *  Changed areas since the last reset_change_counter().
+     *  The list is bounded, rectangles are merged when there are too many of them
+     *  and the whole image is marked when they cover most of it.
+     * */
+    void mark_changed();
+    void mark_changed(const Rect &rect);
+    const std::vector<Rect> &get_changed_rects() const { return changed_rects; }
+    bool is_partially_changed() const { return changes > 0 && !whole_changed; }
+
+    /*
+     *  Runs of visible pixels, built when needed for the first time after a change
+     *  (set_pixel, set_data, clear or mark_changed). Safe to call from many threads
+     *  as long as the image isn't changed meanwhile.
+     * */
+    const RleImage &get_rle() const;
+
+    ~Image();
 
   private:
+    // frees buffers of allocate_pixels
+    struct PixelsDeleter
+    {
+      void operator()(uint32_t *pixels) const { free(pixels); }
+    };
+    typedef std::unique_ptr<uint32_t[], PixelsDeleter> Pixels;
+
+    static constexpr size_t PIXELS_ALIGNMENT = 64;
+    static constexpr size_t HUGE_PAGE_SIZE = 2 << 20;
+
+    /*
+     *  Uninitialised buffer of `count` pixels aligned to a cache line. With `huge_pages`
+     *  buffers of at least HUGE_PAGE_SIZE bytes are aligned to it and advised to be backed
+     *  by huge pages (only on Linux with transparent huge pages enabled).
+     * */
+    static Pixels allocate_pixels(size_t count, bool huge_pages = false);
+
     Image() = default;
     Image(const Size &size, PixelFormat::Type format);
 
+    void expand_pixels(int x, int y, size_t length, uint32_t *buffer) const;
+
+    static constexpr size_t MAX_CHANGED_RECTS = 16;
+
+    // changed rectangles a and b, merging them wastes `waste` pixels
+    struct ChangedPair
+    {
+      Rect a;
+      Rect b;
+      long waste;
+    };
+
+    // merges the rectangle into changed_rects, keeping at most MAX_CHANGED_RECTS of them,
+    // false if it was already covered
+    bool add_changed_rect(Rect changed);
+    // pair of changed_rects wasting the least area, cached while both of them stay
+    ChangedPair find_cheapest_pair();
+
+    template<typename Pixel> Pixel *stored_pixels() const
+    {
+      assert(sizeof(Pixel) == (size_t)(PixelFormat::get_pixel_bytes(format)));
+      if constexpr (sizeof(Pixel) == sizeof(uint32_t))
+        return reinterpret_cast<Pixel *>(data.get());
+      else
+        return reinterpret_cast<Pixel *>(samples.get());
+    }
+
     std::string path;
     Size size { 0, 0 };
     PixelFormat::Type format { PixelFormat::Invalid };
-    std::unique_ptr<uint32_t[]> data;
+    Pixels data;
+    std::unique_ptr<uint8_t[]> samples; // of compact images, get_pixel_bytes per pixel
+    std::shared_ptr<Palette> palette;
     unsigned int changes { 0 };
+    bool whole_changed { false };
+    std::vector<Rect> changed_rects;
+    std::optional<ChangedPair> cheapest_pair;
+
+    mutable std::mutex rle_mutex;
+    mutable std::unique_ptr<RleImage> rle;
+    mutable bool rle_valid { false };
 
     friend class ImageLoader;
+    friend class ImageFilter;
+    friend class ImagePool;
+    friend class ImageView;
     friend class Painter;
+    template<typename PixelSink, typename Scaler> friend class BasicPainter;
   };
 } // namespace ZD
@@ -0,0 +1,329 @@
+#include "ImageFilter.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "PixelKernels.hpp"
+
+#pragma GCC optimize("O3")
+
+namespace ZD
+{
+  ImageFilter::ImageFilter(unsigned int thread_count)
+  : thread_count { thread_count > 0
+                     ? thread_count
+                     : std::max(1u, std::thread::hardware_concurrency()) }
+  , buffers(this->thread_count)
+  {
+    for (unsigned int worker = 1; worker < this->thread_count; ++worker)
+    {
+      threads.emplace_back(&ImageFilter::work, this, worker);
+    }
+  }
+
+  ImageFilter::~ImageFilter()
+  {
+    {
+      std::scoped_lock<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    job_ready.notify_all();
+
+    for (auto &thread : threads)
+    {
+      thread.join();
+    }
+  }
+
+  void ImageFilter::work(unsigned int worker)
+  {
+    uint64_t done_job = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true)
+    {
+      job_ready.wait(lock, [&]() { return stopping || job_number != done_job; });
+      if (stopping)
+        return;
+
+      done_job = job_number;
+      if (worker >= job.bands)
+        continue;
+
+      const Job current = job;
+      lock.unlock();
+      const int first = worker * current.band_rows;
+      if (first < current.rows)
+      {
+        current.call(
+          current.func,
+          worker,
+          first,
+          std::min(current.rows, first + current.band_rows));
+      }
+      lock.lock();
+
+      if (--pending_bands == 0)
+        job_done.notify_one();
+    }
+  }
+
+  template<typename Func> void ImageFilter::for_bands(int rows, Func func)
+  {
+    const int tiles = (rows + TILE_ROWS - 1) / TILE_ROWS;
+    const int bands = std::max(1, std::min<int>(thread_count, tiles));
+    const int band_rows = (tiles + bands - 1) / bands * TILE_ROWS;
+
+    if (bands == 1)
+    {
+      func(0, 0, rows);
+      return;
+    }
+
+    {
+      std::scoped_lock<std::mutex> lock(mutex);
+      job = Job {
+        &func,
+        [](void *f, unsigned int worker, int first, int last) {
+          (*(Func *)(f))(worker, first, last);
+        },
+        rows,
+        band_rows,
+        (unsigned int)(bands),
+      };
+      pending_bands = bands - 1;
+      job_number++;
+    }
+    job_ready.notify_all();
+
+    func(0, 0, std::min(rows, band_rows));
+
+    std::unique_lock<std::mutex> lock(mutex);
+    job_done.wait(lock, [this]() { return pending_bands == 0; });
+  }
+
+  void ImageFilter::convolve(
+    const Image &source, Image &output, std::span<const float> kernel_x,
+    std::span<const float> kernel_y)
+  {
+    assert(kernel_x.size() % 2 == 1 || kernel_x.empty());
+    assert(kernel_y.size() % 2 == 1 || kernel_y.empty());
+
+    const Stages stages_x { Stage { kernel_x.data(), kernel_x.size() } };
+    const Stages stages_y { Stage { kernel_y.data(), kernel_y.size() } };
+    filter(
+      source, output, stages_x, !kernel_x.empty(), stages_y, !kernel_y.empty());
+  }
+
+  void ImageFilter::box_blur(
+    const Image &source, Image &output, int radius_x, int radius_y)
+  {
+    const Stages stages_x { Stage { nullptr, 2 * (size_t)(radius_x) + 1 } };
+    const Stages stages_y { Stage { nullptr, 2 * (size_t)(radius_y) + 1 } };
+    filter(source, output, stages_x, radius_x > 0, stages_y, radius_y > 0);
+  }
+
+  /*
+   *  Widths of the boxes are odd and differ by 2 at most, chosen so that
+   *  their combined variance is the closest to sigma^2.
+   * */
+  void ImageFilter::gaussian_blur(
+    const Image &source, Image &output, float sigma)
+  {
+    const float variance = 12.0f * sigma * sigma;
+    const int n = MAX_STAGES;
+    int lower = std::sqrt(variance / n + 1.0f);
+    if (lower % 2 == 0)
+      lower--;
+    const int lower_count = std::clamp<int>(
+      std::lround(
+        (variance - n * lower * lower - 4 * n * lower - 3 * n) /
+        (-4.0f * lower - 4.0f)),
+      0,
+      n);
+
+    Stages stages {};
+    size_t count = 0;
+    for (int i = 0; i < n; ++i)
+    {
+      const int width = i < lower_count ? lower : lower + 2;
+      if (width > 1)
+        stages[count++] = Stage { nullptr, (size_t)(width) };
+    }
+    filter(source, output, stages, count, stages, count);
+  }
+
+  static void unsharp_row(
+    float *sharp, const float *blurred, size_t length, float amount)
+  {
+    for (size_t i = 0; i < length; ++i)
+    {
+      sharp[i] += amount * (sharp[i] - blurred[i]);
+    }
+  }
+
+  void ImageFilter::sharpen(
+    const Image &source, Image &output, float amount, float sigma)
+  {
+    const int width = source.width();
+    const size_t area = source.get_size().area();
+    const uint32_t *src = source.get_data();
+    if (&source == &output)
+    {
+      original.assign(src, src + area);
+      src = original.data();
+    }
+
+    gaussian_blur(source, output, sigma);
+
+    for_bands(source.height(), [&](unsigned int worker, int first, int last) {
+      WorkerBuffers &b = buffers[worker];
+      b.rows[0].resize(4 * (size_t)(width));
+      b.rows[1].resize(4 * (size_t)(width));
+      float *sharp = b.rows[0].data();
+      const float *blurred = b.rows[1].data();
+
+      for (int y = first; y < last; ++y)
+      {
+        uint32_t *row = output.data.get() + (size_t)(y) * width;
+        Kernels::unpack_row(sharp, src + (size_t)(y) * width, width);
+        Kernels::unpack_row(b.rows[1].data(), row, width);
+        unsharp_row(sharp, blurred, 4 * (size_t)(width), amount);
+        Kernels::pack_row(row, sharp, width);
+      }
+    });
+  }
+
+  std::vector<float> ImageFilter::gaussian_kernel(float sigma)
+  {
+    if (sigma <= 0.0f)
+      return { 1.0f };
+
+    const int radius = std::ceil(3.0f * sigma);
+    std::vector<float> kernel(2 * radius + 1);
+    float sum = 0.0f;
+    for (int i = -radius; i <= radius; ++i)
+    {
+      kernel[i + radius] = std::exp(-(i * i) / (2.0f * sigma * sigma));
+      sum += kernel[i + radius];
+    }
+    for (float &weight : kernel)
+    {
+      weight /= sum;
+    }
+    return kernel;
+  }
+
+  void ImageFilter::filter(
+    const Image &source, Image &output, const Stages &stages_x,
+    size_t count_x, const Stages &stages_y, size_t count_y)
+  {
+    assert(!source.is_compact() && !output.is_compact());
+    assert(source.get_size() == output.get_size());
+
+    const int width = source.width();
+    const int height = source.height();
+    if (width <= 0 || height <= 0)
+      return;
+
+    if (count_x == 0 && count_y == 0)
+    {
+      if (&source != &output)
+        output.set_data(source.get_data(), source.get_size().area());
+      output.mark_changed();
+      return;
+    }
+
+    transposed.resize((size_t)(width) * height);
+    filter_pass(
+      source.get_data(), width, height, transposed.data(), stages_x, count_x);
+    filter_pass(
+      transposed.data(), height, width, output.data.get(), stages_y, count_y);
+    output.mark_changed();
+  }
+
+  // rows of the tile become columns of dest, which are `height` apart
+  static void transpose_tile(
+    uint32_t *dest, size_t height, const uint32_t *tile, size_t width,
+    size_t rows)
+  {
+    for (size_t x = 0; x < width; ++x, dest += height)
+    {
+      for (size_t r = 0; r < rows; ++r)
+      {
+        dest[r] = tile[r * width + x];
+      }
+    }
+  }
+
+  /*
+   *  Rows are extended by the edge pixels on both sides, every stage then
+   *  shortens them by its taps - 1 pixels. A tile of filtered rows is
+   *  written column by column, so each column is a short contiguous run.
+   * */
+  void ImageFilter::filter_pass(
+    const uint32_t *src, int width, int height, uint32_t *dest,
+    const Stages &stages, size_t count)
+  {
+    size_t pad = 0;
+    for (size_t s = 0; s < count; ++s)
+    {
+      assert(stages[s].taps % 2 == 1);
+      pad += stages[s].taps / 2;
+    }
+    const size_t padded = width + 2 * pad;
+
+    for_bands(height, [&](unsigned int worker, int first, int last) {
+      WorkerBuffers &b = buffers[worker];
+      b.rows[0].resize(4 * padded);
+      b.rows[1].resize(4 * padded);
+      b.tile.resize(TILE_ROWS * (size_t)(width));
+
+      for (int y = first; y < last; y += TILE_ROWS)
+      {
+        const int rows = std::min(TILE_ROWS, last - y);
+        for (int r = 0; r < rows; ++r)
+        {
+          const uint32_t *row = src + (size_t)(y + r) * width;
+          uint32_t *tile_row = b.tile.data() + (size_t)(r) * width;
+          if (count == 0)
+          {
+            std::copy_n(row, width, tile_row);
+            continue;
+          }
+
+          float *in = b.rows[0].data();
+          float *out = b.rows[1].data();
+          Kernels::unpack_row(in + 4 * pad, row, width);
+          for (size_t p = 0; p < pad; ++p)
+          {
+            std::copy_n(in + 4 * pad, 4, in + 4 * p);
+            std::copy_n(
+              in + 4 * (pad + width - 1), 4, in + 4 * (pad + width + p));
+          }
+
+          size_t length = padded;
+          for (size_t s = 0; s < count; ++s)
+          {
+            length -= stages[s].taps - 1;
+            if (stages[s].weights)
+            {
+              Kernels::convolve_row(
+                out, in, length, stages[s].weights, stages[s].taps);
+            }
+            else
+            {
+              Kernels::box_row(out, in, length, stages[s].taps);
+            }
+            std::swap(in, out);
+          }
+          Kernels::pack_row(tile_row, in, width);
+        }
+
+        transpose_tile(dest + y, height, b.tile.data(), width, rows);
+      }
+    });
+  }
+
+} // namespace ZD
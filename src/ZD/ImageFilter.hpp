@@ -0,0 +1,141 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "Image.hpp"
+
+namespace ZD
+{
+  /*
+   *  Separable filters for post effects (drop shadows, glow, blurred
+   *  backgrounds): convolution with 1D kernels, box blur and approximate
+   *  Gaussian blur.
+   *  Both passes filter rows. The horizontal one writes its result
+   *  transposed, tile by tile, to a scratch image and the vertical one
+   *  filters rows of it and transposes them back. Rows are split into bands,
+   *  one per thread. Worker threads are started once with the filter and
+   *  scratch buffers are kept between calls, so filtering images of the same
+   *  size every frame neither allocates nor spawns threads. Keep the filter
+   *  instead of creating one for every call.
+   *  Channels (alpha too) are filtered separately, pixels outside of the
+   *  image repeat its edges. `output` can be the `source` image itself.
+   *  Compact (indexed and gray) images aren't supported.
+   * */
+  class ImageFilter
+  {
+  public:
+    // thread_count 0 uses all hardware threads, small images use fewer
+    explicit ImageFilter(unsigned int thread_count = 0);
+    ~ImageFilter();
+
+    ImageFilter(const ImageFilter &) = delete;
+    ImageFilter &operator=(const ImageFilter &) = delete;
+
+    // kernels are centered (odd length), an empty one skips its pass
+    void convolve(
+      const Image &source, Image &output, std::span<const float> kernel_x,
+      std::span<const float> kernel_y);
+    // averages boxes of (2 * radius + 1) pixels
+    void box_blur(
+      const Image &source, Image &output, int radius_x, int radius_y);
+    // three box blurs approximating a Gaussian blur
+    void gaussian_blur(const Image &source, Image &output, float sigma);
+    // unsharp mask: source + amount * (source - blurred source)
+    void sharpen(
+      const Image &source, Image &output, float amount, float sigma = 1.0f);
+
+    void convolve(
+      Image &image, std::span<const float> kernel_x,
+      std::span<const float> kernel_y)
+    {
+      convolve(image, image, kernel_x, kernel_y);
+    }
+    void box_blur(Image &image, int radius)
+    {
+      box_blur(image, image, radius, radius);
+    }
+    void gaussian_blur(Image &image, float sigma)
+    {
+      gaussian_blur(image, image, sigma);
+    }
+    void sharpen(Image &image, float amount, float sigma = 1.0f)
+    {
+      sharpen(image, image, amount, sigma);
+    }
+
+    // normalised Gaussian kernel reaching 3 sigma on both sides
+    static std::vector<float> gaussian_kernel(float sigma);
+
+    unsigned int get_thread_count() const { return thread_count; }
+
+  private:
+    // rows filtered at once, before their tile is transposed
+    static constexpr int TILE_ROWS = 16;
+    static constexpr size_t MAX_STAGES = 3;
+
+    // convolution, or box average when there are no weights
+    struct Stage
+    {
+      const float *weights;
+      size_t taps;
+    };
+    typedef std::array<Stage, MAX_STAGES> Stages;
+
+    struct WorkerBuffers
+    {
+      std::vector<float> rows[2];
+      std::vector<uint32_t> tile;
+    };
+
+    void filter(
+      const Image &source, Image &output, const Stages &stages_x,
+      size_t count_x, const Stages &stages_y, size_t count_y);
+    /*
+     *  Filters `height` rows of `width` pixels and writes them transposed,
+     *  as `width` rows of `height` pixels.
+     * */
+    void filter_pass(
+      const uint32_t *src, int width, int height, uint32_t *dest,
+      const Stages &stages, size_t count);
+    /*
+     *  Calls func(worker, first_row, last_row) for bands of TILE_ROWS
+     *  multiples, the first band on the calling thread and the others on
+     *  the workers. Returns when all of them are done.
+     * */
+    template<typename Func> void for_bands(int rows, Func func);
+    // loop of a worker thread, filtering its band of every job
+    void work(unsigned int worker);
+
+    // bands of a for_bands call, func is called through call
+    struct Job
+    {
+      void *func;
+      void (*call)(void *func, unsigned int worker, int first, int last);
+      int rows;
+      int band_rows;
+      unsigned int bands;
+    };
+
+    unsigned int thread_count;
+    std::vector<WorkerBuffers> buffers;
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable job_ready;
+    std::condition_variable job_done;
+    Job job {};
+    uint64_t job_number { 0 }; // incremented for every job
+    unsigned int pending_bands { 0 }; // of the job, still filtered by workers
+    bool stopping { false };
+
+    std::vector<uint32_t> transposed;
+    std::vector<uint32_t> original; // source copy when sharpening in place
+  };
+
+} // namespace ZD
@@ -1,5 +1,6 @@
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <memory>
 #include <optional>
 #include <unordered_map>
@@ -19,6 +20,8 @@
 namespace ZD
 {
   static std::unordered_map<std::string, std::shared_ptr<Image>> loaded_images;
+  // the same files loaded with KeepGray::Yes
+  static std::unordered_map<std::string, std::shared_ptr<Image>> loaded_gray_images;
 
   struct LoadedImage
   {
@@ -26,14 +29,11 @@ namespace ZD
     int width;
     int height;
     PixelFormat::Type format;
-    uint32_t *data;
+    stbi_uc *samples; // kept gray files have their channels, other ones have 4
   };
 
-  uint32_t *ImageLoader::u8_to_u32(uint8_t *bitmap, int width, int height, int channels)
+  static void convert_u8_to_u32(const uint8_t *bitmap, uint32_t *data, ssize_t size, int channels)
   {
-    const int size = width * height;
-    uint32_t *data = new uint32_t[size];
-
     for (ssize_t i = 0; i < size; i++)
     {
       uint8_t r = 0, g = 0, b = 0, a = 255;
@@ -48,7 +48,13 @@ namespace ZD
 
       data[i] = Color(r, g, b, a).value();
     }
+  }
 
+  uint32_t *ImageLoader::u8_to_u32(uint8_t *bitmap, int width, int height, int channels)
+  {
+    const int size = width * height;
+    uint32_t *data = new uint32_t[size];
+    convert_u8_to_u32(bitmap, data, size, channels);
     return data;
   }
 
@@ -75,9 +81,14 @@ namespace ZD
     return data;
   }
 
-  std::optional<LoadedImage> load_image_via_stbi(std::string_view file_name)
+  // kept gray files (masks, heightmaps) have their 1 or 2 channels, other ones are expanded to BGRA
+  std::optional<LoadedImage> load_image_via_stbi(std::string_view file_name, KeepGray keep_gray)
   {
-    const int CHANNEL_NUM = 4;
+    int file_channels = 0;
+    int width = 0, height = 0;
+    const bool gray = keep_gray == KeepGray::Yes &&
+      stbi_info(file_name.data(), &width, &height, &file_channels) && file_channels <= 2;
+    const int CHANNEL_NUM = gray ? file_channels : 4;
 
     LoadedImage loaded;
     int channels = -1;
@@ -90,20 +101,42 @@ namespace ZD
       return std::nullopt;
     }
 
-    auto u32_data = ImageLoader::u8_to_u32(data, loaded.width, loaded.height, CHANNEL_NUM);
-
-    stbi_image_free(data);
-
     loaded.file_name = file_name;
-    loaded.format = PixelFormat::Type::BGRA;
-    loaded.data = u32_data;
+    loaded.samples = data;
+    if (!gray)
+      loaded.format = PixelFormat::Type::BGRA;
+    else if (CHANNEL_NUM == 1)
+      loaded.format = PixelFormat::Type::Gray;
+    else
+      loaded.format = PixelFormat::Type::GrayAlpha;
     return loaded;
   }
 
-  static std::optional<std::shared_ptr<Image>> find_in_loaded(std::string path)
+  template<typename Pixel> static void copy_samples(Image &image, const stbi_uc *samples)
+  {
+    auto view = image.view<Pixel>();
+    const size_t row_bytes = view.width() * sizeof(Pixel);
+    for (int y = 0; y < view.height(); y++)
+    {
+      memcpy(view.row(y), samples + y * row_bytes, row_bytes);
+    }
+  }
+
+  static void copy_rgba_samples(Image &image, const stbi_uc *samples)
+  {
+    auto view = image.view<uint32_t>();
+    const size_t row_bytes = view.width() * 4;
+    for (int y = 0; y < view.height(); y++)
+    {
+      convert_u8_to_u32(samples + y * row_bytes, view.row(y), view.width(), 4);
+    }
+  }
+
+  static std::optional<std::shared_ptr<Image>> find_in_loaded(
+    const std::unordered_map<std::string, std::shared_ptr<Image>> &loaded, std::string path)
   {
-    auto name_image_pair = loaded_images.find(path);
-    if (name_image_pair != loaded_images.end())
+    auto name_image_pair = loaded.find(path);
+    if (name_image_pair != loaded.end())
     {
       //printf("Image %s found in loaded!\n", path.c_str());
       return name_image_pair->second;
@@ -112,30 +145,37 @@ namespace ZD
     return std::nullopt;
   }
 
-  std::shared_ptr<Image> ImageLoader::load(std::string path, ForceReload reload)
+  std::shared_ptr<Image> ImageLoader::load(std::string path, ForceReload reload, KeepGray keep_gray)
   {
+    auto &loaded = keep_gray == KeepGray::Yes ? loaded_gray_images : loaded_images;
     Image *image = NULL;
     if (reload != ForceReload::Yes)
     {
-      if (auto already_loaded = find_in_loaded(path))
+      if (auto already_loaded = find_in_loaded(loaded, path))
       {
         return *already_loaded;
       }
     }
 
-    if (auto loaded_data = load_image_via_stbi(path))
+    if (auto loaded_data = load_image_via_stbi(path, keep_gray))
     {
       Size size(loaded_data->width, loaded_data->height);
       image = new Image(size, loaded_data->format);
       image->path = loaded_data->file_name;
-      image->data = std::unique_ptr<uint32_t[]>(loaded_data->data);
+      if (loaded_data->format == PixelFormat::Gray)
+        copy_samples<uint8_t>(*image, loaded_data->samples);
+      else if (loaded_data->format == PixelFormat::GrayAlpha)
+        copy_samples<GrayAlphaPixel>(*image, loaded_data->samples);
+      else
+        copy_rgba_samples(*image, loaded_data->samples);
+      stbi_image_free(loaded_data->samples);
     }
 
     std::shared_ptr<Image> image_ptr(image);
 
     if (image_ptr)
     {
-      loaded_images.emplace(path, image_ptr);
+      loaded.emplace(path, image_ptr);
     }
 
     return image_ptr;
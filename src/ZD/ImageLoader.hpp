@@ -7,11 +7,12 @@ namespace ZD
 {
   class Image;
   enum class ForceReload;
+  enum class KeepGray;
 
   class ImageLoader
   {
   public:
-    static std::shared_ptr<Image> load(std::string path, ForceReload reload);
+    static std::shared_ptr<Image> load(std::string path, ForceReload reload, KeepGray keep_gray);
 
     static uint32_t *u8_to_u32(uint8_t *bitmap, int width, int height, int channels);
     static uint8_t *u32_to_u8(uint32_t *bitmap, int width, int height, int channels);
@@ -0,0 +1,131 @@
+#include "ImagePool.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace ZD
+{
+  ImagePool::ImagePool(size_t max_pooled_bytes)
+  : max_pooled_bytes { max_pooled_bytes }
+  {
+  }
+
+  std::shared_ptr<ImagePool> ImagePool::create(size_t max_pooled_bytes)
+  {
+    return std::shared_ptr<ImagePool>(new ImagePool(max_pooled_bytes));
+  }
+
+  const std::shared_ptr<ImagePool> &ImagePool::shared()
+  {
+    static const std::shared_ptr<ImagePool> pool = create();
+    return pool;
+  }
+
+  std::shared_ptr<Image> ImagePool::acquire(
+    const Size &size, PixelFormat::Type format, ZeroFill zero_fill)
+  {
+    if (PixelFormat::get_pixel_bytes(format) < 4)
+      return Image::create(size, format);
+
+    const size_t area = size.area();
+    const size_t capacity =
+      (std::max<size_t>(area, 1) + CLASS_PIXELS - 1) / CLASS_PIXELS *
+      CLASS_PIXELS;
+
+    Image::Pixels pixels = take(capacity);
+    if (!pixels)
+    {
+      bool huge;
+      {
+        std::scoped_lock<std::mutex> lock(mutex);
+        huge = huge_pages;
+      }
+      pixels = Image::allocate_pixels(capacity, huge);
+    }
+    if (zero_fill == ZeroFill::Yes)
+      memset(pixels.get(), 0, area * sizeof(uint32_t));
+
+    Image *image = new Image();
+    image->size = size;
+    image->format = format;
+    image->data = std::move(pixels);
+
+    // the pool may be gone by the time the image is released
+    std::weak_ptr<ImagePool> pool = weak_from_this();
+    return std::shared_ptr<Image>(image, [pool, capacity](Image *image) {
+      if (auto owner = pool.lock())
+        owner->give_back(std::move(image->data), capacity);
+      delete image;
+    });
+  }
+
+  std::shared_ptr<Image> ImagePool::acquire(
+    const Size &size, const Color &color, PixelFormat::Type format)
+  {
+    std::shared_ptr<Image> image = acquire(size, format, ZeroFill::No);
+    image->clear(color);
+    return image;
+  }
+
+  Image::Pixels ImagePool::take(size_t capacity)
+  {
+    std::scoped_lock<std::mutex> lock(mutex);
+    auto buffers = free_buffers.find(capacity);
+    if (buffers == free_buffers.end() || buffers->second.empty())
+    {
+      stats.misses++;
+      return nullptr;
+    }
+
+    Image::Pixels pixels = std::move(buffers->second.back());
+    buffers->second.pop_back();
+    stats.hits++;
+    stats.pooled_buffers--;
+    stats.pooled_bytes -= capacity * sizeof(uint32_t);
+    return pixels;
+  }
+
+  void ImagePool::give_back(Image::Pixels pixels, size_t capacity)
+  {
+    std::scoped_lock<std::mutex> lock(mutex);
+    const size_t bytes = capacity * sizeof(uint32_t);
+    if (stats.pooled_bytes + bytes > max_pooled_bytes)
+    {
+      stats.dropped++;
+      return;
+    }
+
+    free_buffers[capacity].push_back(std::move(pixels));
+    stats.pooled_buffers++;
+    stats.pooled_bytes += bytes;
+  }
+
+  void ImagePool::set_huge_pages(bool enabled)
+  {
+    std::scoped_lock<std::mutex> lock(mutex);
+    huge_pages = enabled;
+  }
+
+  ImagePool::Stats ImagePool::get_stats() const
+  {
+    std::scoped_lock<std::mutex> lock(mutex);
+    return stats;
+  }
+
+  void ImagePool::reset_stats()
+  {
+    std::scoped_lock<std::mutex> lock(mutex);
+    stats.hits = 0;
+    stats.misses = 0;
+    stats.dropped = 0;
+  }
+
+  void ImagePool::trim()
+  {
+    std::scoped_lock<std::mutex> lock(mutex);
+    free_buffers.clear();
+    stats.pooled_buffers = 0;
+    stats.pooled_bytes = 0;
+  }
+
+} // namespace ZD
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "Color.hpp"
+#include "Image.hpp"
+#include "Size.hpp"
+
+namespace ZD
+{
+  enum class ZeroFill
+  {
+    No = 0,
+    Yes = 1
+  };
+
+  /*
+   *  Recycles pixel buffers of images created every frame or on demand.
+   *  Images acquired from the pool give their buffer back when the last
+   *  shared_ptr to them is gone, the next image of the same size class
+   *  takes it instead of allocating. Size classes are multiples of
+   *  CLASS_PIXELS pixels, so images of close sizes share buffers.
+   *  Buffers are kept until they take max_pooled_bytes, then they are
+   *  freed. Images may outlive their pool. Safe to use from many threads.
+   *  Compact images (see Image::is_compact) aren't pooled.
+   * */
+  class ImagePool : public std::enable_shared_from_this<ImagePool>
+  {
+  public:
+    static constexpr size_t CLASS_PIXELS = 1024;
+    static constexpr size_t DEFAULT_MAX_POOLED_BYTES = 64 << 20;
+
+    struct Stats
+    {
+      size_t hits { 0 };
+      size_t misses { 0 };
+      size_t dropped { 0 }; // buffers freed because the pool was full
+      size_t pooled_buffers { 0 };
+      size_t pooled_bytes { 0 };
+    };
+
+    static std::shared_ptr<ImagePool> create(
+      size_t max_pooled_bytes = DEFAULT_MAX_POOLED_BYTES);
+    // pool used by the library itself (e.g. TilesetRenderer)
+    static const std::shared_ptr<ImagePool> &shared();
+
+    // pixels are zeroed as in Image::create, unless zero_fill is No
+    std::shared_ptr<Image> acquire(
+      const Size &size, PixelFormat::Type format = PixelFormat::BGR,
+      ZeroFill zero_fill = ZeroFill::Yes);
+    std::shared_ptr<Image> acquire(
+      const Size &size, const Color &color,
+      PixelFormat::Type format = PixelFormat::BGR);
+
+    // buffers allocated from now on, large ones get huge pages when possible
+    void set_huge_pages(bool enabled);
+    Stats get_stats() const;
+    void reset_stats();
+    // frees all pooled buffers
+    void trim();
+
+  private:
+    explicit ImagePool(size_t max_pooled_bytes);
+
+    // null when there is no free buffer of the capacity
+    Image::Pixels take(size_t capacity);
+    void give_back(Image::Pixels pixels, size_t capacity);
+
+    mutable std::mutex mutex;
+    std::unordered_map<size_t, std::vector<Image::Pixels>> free_buffers;
+    size_t max_pooled_bytes;
+    bool huge_pages { false };
+    Stats stats;
+  };
+
+} // namespace ZD
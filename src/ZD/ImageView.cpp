@@ -0,0 +1,186 @@
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "ImageView.hpp"
+#include "PixelKernels.hpp"
+
+#include "3rd/stb_image_write.h"
+
+#define JPEG_QUALITY 100
+
+#pragma GCC optimize("O3")
+
+namespace ZD
+{
+  ImageView::ImageView(
+    const uint32_t *pixels, int width, int height, int stride,
+    PixelFormat::Type format)
+  : pixels { pixels }
+  , view_width { width }
+  , view_height { height }
+  , view_stride { stride }
+  , format { format }
+  {
+    assert(!is_compact());
+  }
+
+  ImageView::ImageView(const Image &image)
+  : image { &image }
+  , pixels { image.data.get() }
+  , samples { image.samples.get() }
+  , view_width { image.width() }
+  , view_height { image.height() }
+  , view_stride { image.width() }
+  , format { image.get_format() }
+  {
+  }
+
+  ImageView::ImageView(const Image &image, const Rect &rect)
+  : ImageView(image)
+  {
+    *this = sub_view(rect);
+  }
+
+  ImageView ImageView::sub_view(const Rect &rect) const
+  {
+    const Rect part = rect.intersected(Rect(0, 0, view_width, view_height));
+    ImageView view = *this;
+    view.offset = Point { offset.x + part.left(), offset.y + part.top() };
+    view.view_width = part.width();
+    view.view_height = part.height();
+    if (part.is_empty())
+      return view;
+
+    if (pixels)
+      view.pixels = row(part.top()) + part.left();
+    if (samples)
+      view.samples = sample(part.left(), part.top());
+    return view;
+  }
+
+  Color ImageView::get_pixel(int x, int y) const
+  {
+    switch (format)
+    {
+      case PixelFormat::Indexed:
+        return image->get_palette()->get_color(*sample(x, y));
+      case PixelFormat::Gray: return Color::from_gray(*sample(x, y));
+      case PixelFormat::GrayAlpha:
+        return Color::from_gray(sample(x, y)[0], sample(x, y)[1]);
+      default: return Color::from_value(row(y)[x]);
+    }
+  }
+
+  void ImageView::expand_pixels(
+    int x, int y, size_t length, uint32_t *buffer) const
+  {
+    switch (format)
+    {
+      case PixelFormat::Indexed:
+        Kernels::expand_indexed_row(
+          buffer, sample(x, y), image->get_palette()->get_data(), length);
+        break;
+      case PixelFormat::Gray:
+        Kernels::expand_gray_row(buffer, sample(x, y), length);
+        break;
+      case PixelFormat::GrayAlpha:
+        Kernels::expand_gray_alpha_row(buffer, sample(x, y), length);
+        break;
+      default: assert(false);
+    }
+  }
+
+  // first `channels` of RGBA for every pixel
+  static void store_row(
+    uint8_t *dest, const uint32_t *pixels, int length, int channels)
+  {
+    for (int i = 0; i < length; i++, dest += channels)
+    {
+      const Color color = Color::from_value(pixels[i]);
+      dest[0] = color.red();
+      if (channels >= 2)
+        dest[1] = color.green();
+      if (channels >= 3)
+        dest[2] = color.blue();
+      if (channels >= 4)
+        dest[3] = color.alpha();
+    }
+  }
+
+  bool ImageView::save_to_file(std::string file_name) const
+  {
+    size_t file_ext_pos = file_name.find_last_of(".");
+    std::string file_ext = "png";
+    if (file_ext_pos != std::string::npos)
+    {
+      file_ext = file_name.substr(file_ext_pos + 1);
+    }
+    else
+    {
+      file_name += ".";
+      file_name += file_ext;
+    }
+    const void *source = image ? (const void *)(image) : pixels;
+    printf(
+      "Saving %p to file '%s' (ext=%s).\n",
+      source,
+      file_name.data(),
+      file_ext.data());
+
+    const int w = view_width;
+    const int h = view_height;
+    int comp = PixelFormat::get_components_num(format);
+
+    // indexed images are saved with their palette colors, gray ones as they
+    // are stored, rows of views are gathered (no copy for whole gray images)
+    std::vector<uint8_t> gathered;
+    const uint8_t *u8_data = samples;
+    if (!is_compact() || is_indexed())
+    {
+      comp = is_indexed() ? 4 : comp;
+      gathered.resize((size_t)(w) * h * comp);
+      std::vector<uint32_t> row_buffer(w);
+      for (int y = 0; y < h; y++)
+      {
+        const uint32_t *src = get_pixels(0, y, w, row_buffer.data());
+        store_row(gathered.data() + (size_t)(y) * w * comp, src, w, comp);
+      }
+      u8_data = gathered.data();
+    }
+    else if (!is_contiguous())
+    {
+      const size_t row_bytes = (size_t)(w) * comp;
+      gathered.resize(row_bytes * h);
+      for (int y = 0; y < h; y++)
+        memcpy(gathered.data() + y * row_bytes, sample(0, y), row_bytes);
+      u8_data = gathered.data();
+    }
+
+    bool ret = false;
+    if (file_ext == "png")
+    {
+      ret = stbi_write_png(file_name.data(), w, h, comp, u8_data, w * comp) > 0;
+    }
+    else if (file_ext == "bmp")
+    {
+      ret = stbi_write_bmp(file_name.data(), w, h, comp, u8_data) > 0;
+    }
+    else if (file_ext == "tga")
+    {
+      // TODO: TGA not always works
+      ret = stbi_write_tga(file_name.data(), w, h, comp, u8_data) > 0;
+    }
+    else if (file_ext == "jpg")
+    {
+      ret =
+        stbi_write_jpg(file_name.data(), w, h, comp, u8_data, JPEG_QUALITY) > 0;
+    }
+
+    assert(ret);
+
+    return ret;
+  }
+
+} // namespace ZD
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "Color.hpp"
+#include "Image.hpp"
+#include "Palette.hpp"
+#include "PixelView.hpp"
+#include "Point.hpp"
+#include "Rect.hpp"
+#include "Size.hpp"
+
+namespace ZD
+{
+  /*
+   *  Read-only window into pixels owned by someone else: width x height
+   *  pixels with rows `stride` pixels apart. Views of an Image part (sprite
+   *  sheet frames, tiles, atlas entries) are made without copying and can
+   *  be drawn with Painter, uploaded with Texture::upload and saved.
+   *  Images convert to views of themselves, so everything taking a view
+   *  takes an Image as well. Compact pixels are expanded when they are read,
+   *  as in Image. The viewed pixels (and the palette) have to outlive
+   *  the view.
+   * */
+  class ImageView
+  {
+  public:
+    ImageView() = default;
+    // 32 bit pixels of any origin, e.g. a frame from a decoder
+    ImageView(
+      const uint32_t *pixels, int width, int height, int stride,
+      PixelFormat::Type format = PixelFormat::BGRA);
+    ImageView(const Image &image);
+    // part of the image, clipped to it
+    ImageView(const Image &image, const Rect &rect);
+
+    // part of this view, clipped to it
+    ImageView sub_view(const Rect &rect) const;
+
+    bool is_empty() const { return view_width <= 0 || view_height <= 0; }
+    PixelFormat::Type get_format() const { return format; }
+    Size get_size() const { return Size(view_width, view_height); }
+    int width() const { return view_width; }
+    int height() const { return view_height; }
+    int stride() const { return view_stride; }
+    bool is_indexed() const { return format == PixelFormat::Indexed; }
+    bool is_compact() const { return PixelFormat::get_pixel_bytes(format) < 4; }
+    // rows follow each other without gaps
+    bool is_contiguous() const { return view_stride == view_width; }
+
+    // viewed image, null for views of raw pixels
+    const Image *get_image() const { return image; }
+    // top left corner of the view in its image
+    Point get_offset() const { return offset; }
+
+    // null for compact views
+    const uint32_t *get_data() const { return pixels; }
+    // null for views of raw pixels
+    const Palette *get_palette() const
+    {
+      return image ? image->get_palette().get() : nullptr;
+    }
+    const uint32_t *row(int y) const
+    {
+      return pixels + (ptrdiff_t)(y) * view_stride;
+    }
+
+    Color get_pixel(int x, int y) const;
+
+    // pixels in their stored form, as Image::view
+    template<typename Pixel> PixelView<const Pixel> view() const
+    {
+      assert(
+        sizeof(Pixel) == (size_t)(PixelFormat::get_pixel_bytes(format)));
+      const void *first = is_compact() ? (const void *)(samples) : pixels;
+      return PixelView<const Pixel>(
+        static_cast<const Pixel *>(first), view_width, view_height,
+        view_stride);
+    }
+
+    /*
+     *  `length` pixels of row y starting at column x, as Image::get_pixels.
+     *  Compact views are expanded to `buffer`.
+     * */
+    inline const uint32_t *get_pixels(
+      int x, int y, size_t length, uint32_t *buffer) const
+    {
+      if (!is_compact())
+        return row(y) + x;
+      expand_pixels(x, y, length, buffer);
+      return buffer;
+    }
+
+    bool save_to_file(std::string file_name) const;
+
+  private:
+    void expand_pixels(int x, int y, size_t length, uint32_t *buffer) const;
+    // stored pixel at (x, y) of compact views
+    const uint8_t *sample(int x, int y) const
+    {
+      const ptrdiff_t i = x + (ptrdiff_t)(y) * view_stride;
+      return samples + i * PixelFormat::get_pixel_bytes(format);
+    }
+
+    const Image *image { nullptr };
+    const uint32_t *pixels { nullptr };
+    const uint8_t *samples { nullptr }; // first pixel of compact views
+    Point offset { 0, 0 };
+    int view_width { 0 };
+    int view_height { 0 };
+    int view_stride { 0 };
+    PixelFormat::Type format { PixelFormat::Invalid };
+  };
+
+} // namespace ZD
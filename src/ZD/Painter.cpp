@@ -1,6 +1,16 @@
 #include "Painter.hpp"
+#include "BasicPainter.hpp"
 #include "Color.hpp"
+#include "Font.hpp"
 #include "Image.hpp"
+#include "PixelKernels.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "3rd/glm/matrix.hpp"
 
 #pragma GCC optimize("O3")
 
@@ -11,82 +21,336 @@ namespace ZD
     return x + y * w;
   }
 
-  bool in_bounds(const int x, const int y, const int w, const int h)
+  // smallest rectangle containing all points
+  static Rect points_bounds(std::span<const Point> points)
   {
-    if (x >= w)
-      return false;
-    if (y >= h)
-      return false;
-    if (x < 0)
-      return false;
-    if (y < 0)
-      return false;
-
-    return true;
+    int x1 = points[0].x;
+    int y1 = points[0].y;
+    int x2 = x1;
+    int y2 = y1;
+    for (const auto &p : points)
+    {
+      x1 = std::min(x1, p.x);
+      y1 = std::min(y1, p.y);
+      x2 = std::max(x2, p.x);
+      y2 = std::max(y2, p.y);
+    }
+    return Rect::from_corners(x1, y1, x2, y2);
   }
 
   Painter::Painter(std::shared_ptr<Image> image)
   : target { image }
   {
+    // compact (indexed and gray) images can be drawn, but not painted on
+    assert(!image || !image->is_compact());
   }
 
-  void Painter::set_pixel(const int x, const int y, const Color &color)
+  void Painter::push_clip(const Rect &rect)
   {
-    if (x < 0)
-      return;
-    if (y < 0)
-      return;
-    if (x >= target->width())
-      return;
-    if (y >= target->height())
+    if (clip_stack.empty())
+    {
+      clip_stack.push_back(rect);
       return;
+    }
 
-    target->set_pixel(x, y, color);
-    target->changes++;
+    clip_stack.push_back(clip_stack.back().intersected(rect));
   }
 
-  void Painter::draw_image(const int x, const int y, const Image &image)
+  void Painter::pop_clip()
   {
-    const auto t_width = target->width();
-    const auto t_height = target->height();
+    if (!clip_stack.empty())
+      clip_stack.pop_back();
+  }
 
-    auto src = image.get_data();
-    auto dest = target->data.get();
+  Rect Painter::get_clip() const
+  {
+    const Rect bounds(0, 0, target->width(), target->height());
+    if (clip_stack.empty())
+      return bounds;
 
-    dest += move_ptr_to_xy(x, y, t_width);
+    return bounds.intersected(clip_stack.back());
+  }
 
-    const auto image_width = image.width();
-    const auto image_height = image.height();
+  void Painter::mark_changed(const Rect &rect)
+  {
+    if (!rect.is_empty())
+      target->mark_changed(rect);
+  }
+
+  void Painter::fill_area(const Rect &area, const Color &color)
+  {
+    const Rect bounds(0, 0, target->width(), target->height());
+    BasicPainter<ReplaceSink> painter(*target, bounds);
+    mark_changed(painter.fill_rectangle(area, color.value()));
+  }
 
-    int ys = 0;
-    if (y < 0)
-      ys = -y;
+  Rect Painter::blend_coverage(
+    const Rect &clip, const Rect &rect, const uint8_t *coverage, int stride,
+    const Color &color, BlendMode mode)
+  {
+    const Rect area = clip.intersected(rect);
+    if (area.is_empty())
+      return area;
 
-    for (ssize_t iy = ys; iy < image_height; ++iy)
+    const int t_width = target->width();
+    const uint32_t value = color.value();
+    coverage += (long)(area.top() - rect.top()) * stride +
+                (area.left() - rect.left());
+    auto dest = target->data.get() +
+                move_ptr_to_xy(area.left(), area.top(), t_width);
+
+    // fully covered pixels of an opaque color are just replaced, which is
+    // most of the pixels of bitmap fonts
+    const bool opaque = (value & 0xff) == 0xff &&
+                        (mode == BlendMode::SrcOver ||
+                         mode == BlendMode::Replace ||
+                         mode == BlendMode::ColorKey);
+    const int width = area.width();
+
+    for (int ty = area.top(); ty < area.bottom(); ++ty)
     {
-      if (y + iy < t_height)
+      if (!opaque)
+        Kernels::blend_mask(dest, value, coverage, width, mode);
+      else
       {
-        for (ssize_t ix = 0; ix < image_width; ++ix)
+        for (int i = 0; i < width; ++i)
         {
-          const ssize_t i = ix + iy * image_width;
-          if ((src[i] & 0xff) == 0)
-            continue;
+          if (coverage[i] == 0xff)
+            dest[i] = value;
+          else if (coverage[i] != 0)
+            Kernels::blend_mask(dest + i, value, coverage + i, 1, mode);
+        }
+      }
+      coverage += stride;
+      dest += t_width;
+    }
+    return area;
+  }
+
+  void Painter::blend_pixel(
+    const int x, const int y, const Color &color, BlendMode mode)
+  {
+    auto dest = target->data.get() + move_ptr_to_xy(x, y, target->width());
+    Kernels::blend_fill(dest, color.value(), 1, mode);
+  }
 
-          if (x + ix >= t_width || x + ix < 0)
-            continue;
+  void Painter::set_pixel(
+    const int x, const int y, const Color &color, BlendMode mode)
+  {
+    BasicPainter<BlendSink> painter(*target, get_clip(), BlendSink { mode });
+    mark_changed(painter.set_pixel(x, y, color.value()));
+  }
 
-          size_t target_idx = ix + (iy * t_width);
+  void Painter::plot_points(
+    std::span<const Point> points, const Color &color, BlendMode mode)
+  {
+    scatter_points(points, nullptr, color, mode);
+  }
 
-          dest[target_idx] = src[i];
+  void Painter::plot_points(
+    std::span<const Point> points, std::span<const Color> colors,
+    BlendMode mode)
+  {
+    assert(colors.size() >= points.size());
+    scatter_points(points, colors.data(), Color(0), mode);
+  }
+
+  /*
+   *  Points are culled in chunks, so offsets stay in cache until they are
+   *  scattered. The changed area is the bounding box of the plotted points.
+   * */
+  void Painter::scatter_points(
+    std::span<const Point> points, const Color *colors, const Color &color,
+    BlendMode mode)
+  {
+    constexpr size_t CHUNK = 4096;
+
+    const Rect clip = get_clip();
+    if (clip.is_empty() || points.empty())
+      return;
+
+    const int t_width = target->width();
+    uint32_t *data = target->data.get();
+    const size_t chunk = std::min(CHUNK, points.size());
+    point_offsets.resize(chunk);
+    if (colors)
+    {
+      point_indices.resize(chunk);
+      row_buffer.resize(chunk);
+    }
+
+    int left = clip.right(), top = clip.bottom();
+    int right = clip.left() - 1, bottom = clip.top() - 1;
+    for (size_t i = 0; i < points.size(); i += chunk)
+    {
+      const size_t n = std::min(chunk, points.size() - i);
+      const size_t count = Kernels::cull_points(
+        point_offsets.data(),
+        colors ? point_indices.data() : nullptr,
+        points.data() + i,
+        n,
+        clip,
+        t_width);
+      if (count == 0)
+        continue;
+
+      if (colors)
+      {
+        for (size_t k = 0; k < count; ++k)
+        {
+          row_buffer[k] = colors[i + point_indices[k]].value();
         }
+        Kernels::scatter_row(
+          data, point_offsets.data(), row_buffer.data(), count, mode);
+      }
+      else
+      {
+        Kernels::scatter_fill(
+          data, point_offsets.data(), color.value(), count, mode);
+      }
+
+      // branchless, so the compiler vectorises it
+      for (const Point &p : points.subspan(i, n))
+      {
+        const bool inside = p.x >= clip.left() && p.x < clip.right() &&
+                            p.y >= clip.top() && p.y < clip.bottom();
+        left = inside ? std::min(left, p.x) : left;
+        right = inside ? std::max(right, p.x) : right;
+        top = inside ? std::min(top, p.y) : top;
+        bottom = inside ? std::max(bottom, p.y) : bottom;
       }
     }
-    target->changes++;
+
+    if (right < left)
+      return;
+
+    mark_changed(Rect::from_corners(left, top, right, bottom));
   }
 
   void Painter::draw_image(
-    const int x, const int y, const Image &image, const int width,
-    const int height, AspectRatioOptions aspect_ratio_options)
+    const int x, const int y, const ImageView &image, BlendMode mode)
+  {
+    Painter::draw_image(
+      x, y, image, Rect(0, 0, image.width(), image.height()), mode);
+  }
+
+  void Painter::draw_image(
+    const int x, const int y, const ImageView &image, const Rect &source,
+    BlendMode mode)
+  {
+    BasicPainter<BlendSink> painter(
+      *target, get_clip(), BlendSink { mode, image.get_format() });
+    mark_changed(painter.draw_image(x, y, image, source));
+  }
+
+  // blending pixels with alpha equal to 0 doesn't change the destination
+  static bool skips_transparent(BlendMode mode, PixelFormat::Type format)
+  {
+    switch (mode)
+    {
+      case BlendMode::ColorKey: return true;
+      case BlendMode::SrcOver:
+      case BlendMode::Additive:
+      case BlendMode::Multiply: return PixelFormat::has_alpha(format);
+      case BlendMode::Replace:
+      case BlendMode::PremultipliedSrcOver: return false;
+    }
+    return false;
+  }
+
+  void Painter::draw_image(
+    const int x, const int y, const ImageView &image, ImageFlip flip,
+    BlendMode mode)
+  {
+    const bool flip_x =
+      flip == ImageFlip::Horizontal || flip == ImageFlip::Both;
+    const bool flip_y = flip == ImageFlip::Vertical || flip == ImageFlip::Both;
+    const auto image_format = image.get_format();
+
+    // runs of indexed images depend on their palette, which can change
+    // without the image knowing, runs below read 32 bit pixels, views of raw
+    // pixels have no runs
+    if (
+      image.is_compact() || !image.get_image() ||
+      !skips_transparent(mode, image_format))
+    {
+      if (!flip_x && !flip_y)
+        return Painter::draw_image(x, y, image, mode);
+
+      return Painter::draw_image(
+        x, y, image, flip_x ? -1.0 : 1.0, flip_y ? -1.0 : 1.0, mode);
+    }
+
+    const int image_width = image.width();
+    const int image_height = image.height();
+    const Rect visible =
+      get_clip().intersected(Rect(x, y, image_width, image_height));
+
+    if (visible.is_empty())
+      return;
+
+    // runs cover whole rows of the viewed image
+    const RleImage &rle = image.get_image()->get_rle();
+    const Point offset = image.get_offset();
+    const int t_width = target->width();
+    const int left = visible.left();
+    const int right = visible.right();
+
+    if (flip_x)
+      row_buffer.resize(visible.width());
+
+    for (int ty = visible.top(); ty < visible.bottom(); ++ty)
+    {
+      const int sy = flip_y ? image_height - 1 - (ty - y) : ty - y;
+      const uint32_t *src = image.row(sy);
+      uint32_t *dest = target->data.get() + (long)ty * t_width;
+
+      // runs ending before the view are skipped at once
+      const auto runs = rle.row(offset.y + sy);
+      const auto first_run = std::partition_point(
+        runs.begin(), runs.end(), [&](const RleImage::Run &run) {
+          return run.x + run.length <= offset.x;
+        });
+      for (const auto &run : runs.subspan(first_run - runs.begin()))
+      {
+        const int run_start = std::max(run.x - offset.x, 0);
+        const int run_end =
+          std::min(run.x + run.length - offset.x, image_width);
+        if (run_start >= image_width)
+          break;
+        if (run_start >= run_end)
+          continue;
+
+        const int run_x =
+          flip_x ? x + image_width - run_end : x + run_start;
+        const int x1 = std::max(run_x, left);
+        const int x2 = std::min(run_x + run_end - run_start, right);
+        if (x1 >= x2)
+          continue;
+
+        const size_t length = x2 - x1;
+        const uint32_t *run_src = src + (x1 - x);
+        if (flip_x)
+        {
+          // column x2 - 1 comes from the first pixel of the source part
+          const uint32_t *first = src + (x + image_width - x2);
+          std::reverse_copy(first, first + length, row_buffer.data());
+          run_src = row_buffer.data();
+        }
+
+        if (mode == BlendMode::ColorKey)
+          memcpy(dest + x1, run_src, length * sizeof(uint32_t));
+        else
+          Kernels::blend_row(dest + x1, run_src, length, mode, image_format);
+      }
+    }
+    mark_changed(visible);
+  }
+
+  void Painter::draw_image(
+    const int x, const int y, const ImageView &image, const int width,
+    const int height, AspectRatioOptions aspect_ratio_options,
+    BlendMode mode, ScaleFilter filter)
   {
     const double scale_x = (double)(width) / (double)(image.width());
     const double scale_y = (double)(height) / (double)(image.height());
@@ -94,275 +358,805 @@ namespace ZD
     if (aspect_ratio_options == PreserveAspectRatio)
     {
       const double scale = scale_y < scale_x ? scale_y : scale_x;
-      return draw_image(x, y, image, scale, scale);
+      return draw_image(x, y, image, scale, scale, mode, filter);
     }
 
-    return draw_image(x, y, image, scale_x, scale_y);
+    return draw_image(x, y, image, scale_x, scale_y, mode, filter);
   }
 
+  /*
+   *  Source coordinates are in 32.32 fixed point. Column offsets (and
+   *  bilinear weights) are computed once per call for the visible columns,
+   *  rows are stepped incrementally. Every destination row is resampled to
+   *  row_buffer and then blended with the regular row kernels.
+   * */
   void Painter::draw_image(
-    const int x, const int y, const Image &image, double scale_x,
-    double scale_y)
+    const int x, const int y, const ImageView &image, double scale_x,
+    double scale_y, BlendMode mode, ScaleFilter filter)
   {
     if (scale_x == 1.0 && scale_y == 1.0)
     {
-      return draw_image(x, y, image);
+      return draw_image(x, y, image, mode);
     }
 
-    auto src = image.get_data();
-    auto dest = target->data.get();
-
-    dest += move_ptr_to_xy(x, y, target->width());
+    const bool whole_x = scale_x >= 1.0 && scale_x == std::floor(scale_x);
+    const bool whole_y = scale_y >= 1.0 && scale_y == std::floor(scale_y);
+    if (filter == ScaleFilter::Nearest && whole_x && whole_y)
+    {
+      return upscale_image(x, y, image, (int)(scale_x), (int)(scale_y), mode);
+    }
 
     const double abs_scale_x = std::abs(scale_x);
     const double abs_scale_y = std::abs(scale_y);
     const int new_width = image.width() * abs_scale_x;
     const int new_height = image.height() * abs_scale_y;
 
-    const auto t_width = target->width();
-    const auto t_height = target->height();
+    const Rect visible =
+      get_clip().intersected(Rect(x, y, new_width, new_height));
+
+    if (visible.is_empty())
+      return;
 
+    constexpr double FIXED_ONE = 4294967296.0;
+    constexpr int64_t FIXED_HALF = 1l << 31;
+
+    const int64_t step_x = FIXED_ONE / abs_scale_x;
+    const int64_t step_y = FIXED_ONE / abs_scale_y;
+    const bool bilinear = filter == ScaleFilter::Bilinear;
+
+    const auto t_width = target->width();
     const auto image_width = image.width();
     const auto image_height = image.height();
-    const auto image_area = image.size.area();
+    const auto image_format = image.get_format();
 
-    for (ssize_t iy = 0; iy < new_height; ++iy)
-    {
-      for (ssize_t ix = 0; ix < new_width; ++ix)
-      {
-        if (x + ix >= t_width || x + ix < 0)
-          continue;
-        if (y + iy >= t_height || y + iy < 0)
-          continue;
+    // index of destination pixel in not flipped image
+    auto unflipped = [](int64_t i, int size, double scale) -> int64_t {
+      return scale < 0 ? size - 1 - i : i;
+    };
 
-        const ssize_t target_idx = ix + (iy * t_width);
+    const size_t columns = visible.width();
+    row_buffer.resize(columns);
+    column_offsets.resize(columns);
+    if (image.is_compact())
+      source_rows.resize(2 * image_width);
+    if (bilinear)
+    {
+      next_column_offsets.resize(columns);
+      column_weights.resize(columns);
+    }
 
-        ssize_t scaled_image_x = ix / abs_scale_x;
-        ssize_t scaled_image_y = iy / abs_scale_y;
+    for (size_t i = 0; i < columns; ++i)
+    {
+      const int64_t ix =
+        unflipped(visible.left() - x + i, new_width, scale_x);
 
-        if (scale_x < 0)
-          scaled_image_x = image_width - scaled_image_x;
-        if (scale_y < 0)
-          scaled_image_y = image_height - scaled_image_y;
+      if (!bilinear)
+      {
+        column_offsets[i] =
+          std::min<int64_t>((ix * step_x) >> 32, image_width - 1);
+        continue;
+      }
 
-        const ssize_t image_idx = scaled_image_x + scaled_image_y * image_width;
+      // sampling at pixel centers
+      const int64_t u =
+        std::max<int64_t>(((2 * ix + 1) * step_x) / 2 - FIXED_HALF, 0);
+      const int32_t x0 = std::min<int64_t>(u >> 32, image_width - 1);
+      column_offsets[i] = x0;
+      next_column_offsets[i] = std::min(x0 + 1, image_width - 1);
+      column_weights[i] = (u >> 24) & 0xff;
+    }
 
-        if (image_idx >= image_area)
-          continue;
+    const int64_t first_iy = unflipped(visible.top() - y, new_height, scale_y);
+    const int64_t row_step = scale_y < 0 ? -step_y : step_y;
+    int64_t v = bilinear ? ((2 * first_iy + 1) * step_y) / 2 - FIXED_HALF
+                         : first_iy * step_y;
 
-        if ((src[image_idx] & 0xff) == 0)
-          continue;
+    auto dest = target->data.get() +
+                move_ptr_to_xy(visible.left(), visible.top(), t_width);
 
-        dest[target_idx] = src[image_idx];
+    for (int ty = visible.top(); ty < visible.bottom(); ++ty)
+    {
+      if (!bilinear)
+      {
+        const int64_t sy = std::min<int64_t>(v >> 32, image_height - 1);
+        Kernels::gather_row(
+          row_buffer.data(),
+          image.get_pixels(0, sy, image_width, source_rows.data()),
+          column_offsets.data(),
+          columns);
+      }
+      else
+      {
+        const int64_t cv = std::max<int64_t>(v, 0);
+        const int64_t y0 = std::min<int64_t>(cv >> 32, image_height - 1);
+        const int64_t y1 = std::min<int64_t>(y0 + 1, image_height - 1);
+        Kernels::bilinear_row(
+          row_buffer.data(),
+          image.get_pixels(0, y0, image_width, source_rows.data()),
+          image.get_pixels(
+            0, y1, image_width, source_rows.data() + image_width),
+          column_offsets.data(),
+          next_column_offsets.data(),
+          column_weights.data(),
+          (cv >> 24) & 0xff,
+          columns);
       }
+
+      Kernels::blend_row(dest, row_buffer.data(), columns, mode, image_format);
+
+      v += row_step;
+      dest += t_width;
     }
-    target->changes++;
+    mark_changed(visible);
   }
 
-  void Painter::draw_line(
-    const int x1, const int y1, const int x2, const int y2, const Color &color)
+  /*
+   *  Integer factors duplicate pixels, so every visible source row is
+   *  expanded once with the upscale kernel and blended to its `factor_y`
+   *  target rows. Cost follows the source resolution plus plain row blends.
+   * */
+  void Painter::upscale_image(
+    const int x, const int y, const ImageView &image, const int factor_x,
+    const int factor_y, BlendMode mode)
   {
-    const auto t_width = target->width();
-    const auto t_height = target->height();
+    const Rect visible = get_clip().intersected(Rect(
+      x, y, image.width() * factor_x, image.height() * factor_y));
+
+    if (visible.is_empty())
+      return;
 
-    //TODO: handle straight lines
+    // visible source columns, the first one may be partially visible
+    const int first_x = (visible.left() - x) / factor_x;
+    const int last_x = (visible.right() - 1 - x) / factor_x;
+    const int lead = visible.left() - x - first_x * factor_x;
+    const size_t source_columns = last_x - first_x + 1;
 
-    bool y_longer = false;
-    int increment_val = 1;
+    row_buffer.resize(source_columns * factor_x);
+    if (image.is_compact())
+      source_rows.resize(source_columns);
 
-    int64_t short_len = y2 - y1;
-    int64_t long_len = x2 - x1;
+    const auto t_width = target->width();
+    const auto image_format = image.get_format();
+    const size_t columns = visible.width();
+
+    auto dest = target->data.get() +
+                move_ptr_to_xy(visible.left(), visible.top(), t_width);
 
-    if (std::abs(short_len) > std::abs(long_len))
+    int ty = visible.top();
+    while (ty < visible.bottom())
     {
-      std::swap(short_len, long_len);
-      y_longer = true;
+      const int sy = (ty - y) / factor_y;
+      const int rows_end = std::min(y + (sy + 1) * factor_y, visible.bottom());
+
+      Kernels::upscale_row(
+        row_buffer.data(),
+        image.get_pixels(first_x, sy, source_columns, source_rows.data()),
+        source_columns,
+        factor_x);
+
+      for (; ty < rows_end; ++ty, dest += t_width)
+      {
+        Kernels::blend_row(
+          dest, row_buffer.data() + lead, columns, mode, image_format);
+      }
     }
+    mark_changed(visible);
+  }
 
-    if (long_len < 0)
-      increment_val = -1;
+  static int64_t floor_div(const int64_t a, const int64_t b)
+  {
+    const int64_t d = a / b;
+    return (a % b != 0 && (a < 0) != (b < 0)) ? d - 1 : d;
+  }
 
-    double div_diff = long_len;
-    if (short_len != 0)
-      div_diff = (double)long_len / (double)short_len;
-    if (y_longer)
+  // limits [first; end) to steps i for which lo <= a + i * d < hi
+  static void limit_steps(
+    int64_t a, int64_t d, int64_t lo, int64_t hi, int64_t &first,
+    int64_t &end)
+  {
+    if (d == 0)
     {
-      for (int i = 0; i != long_len; i += increment_val)
-      {
-        int x = x1 + (int)((double)i / div_diff);
-        int y = y1 + i;
-        if (x < 0)
-          continue;
-        if (y < 0)
-          continue;
-        if (x >= t_width)
-          continue;
-        if (y >= t_height)
-          continue;
+      if (a < lo || a >= hi)
+        end = first;
+      return;
+    }
 
-        target->set_pixel(x, y, color);
-      }
+    if (d > 0)
+    {
+      first = std::max(first, -floor_div(a - lo, d));
+      end = std::min(end, floor_div(hi - 1 - a, d) + 1);
     }
     else
     {
-      for (int i = 0; i != long_len; i += increment_val)
-      {
-        int x = x1 + i;
-        int y = y1 + (int)((double)i / div_diff);
-
-        if (x < 0)
-          continue;
-        if (y < 0)
-          continue;
-        if (x >= t_width)
-          continue;
-        if (y >= t_height)
-          continue;
-
-        target->set_pixel(x, y, color);
-      }
+      first = std::max(first, floor_div(a - hi, -d) + 1);
+      end = std::min(end, floor_div(a - lo, -d) + 1);
     }
-    target->changes++;
   }
 
-  void Painter::clear_rectangle(int x1, int y1, int x2, int y2)
+  // pixels of regular images
+  struct DirectSource
   {
-    auto dest = target->data.get();
+    const uint32_t *pixels;
 
-    if (x2 < x1)
-      std::swap(x1, x2);
-    if (y2 < y1)
-      std::swap(y2, y1);
+    uint32_t operator[](int64_t i) const { return pixels[i]; }
+  };
 
-    if (x1 < 0)
-      x1 = 0;
-    if (y1 < 0)
-      y1 = 0;
-    if (x2 < 0)
-      return;
-    if (y2 < 0)
-      return;
+  // indices of indexed images looked up in their palette
+  struct IndexedSource
+  {
+    const uint8_t *indices;
+    const uint32_t *palette;
 
-    if (x2 > target->width())
-      x2 = target->width();
-    if (y2 > target->height())
-      y2 = target->height();
+    uint32_t operator[](int64_t i) const { return palette[indices[i]]; }
+  };
 
-    if (x1 > target->width())
-      return;
-    if (y1 > target->height())
-      return;
+  // gray levels of gray images
+  struct GraySource
+  {
+    const uint8_t *levels;
 
-    for (int y = y1; y < y2; ++y)
+    uint32_t operator[](int64_t i) const
     {
-      for (int x = x1; x < x2; ++x)
-      {
-        dest[x + y * target->width()] = 0;
-      }
+      return Color::from_gray(levels[i]).value();
     }
-    target->changes++;
+  };
+
+  struct GrayAlphaSource
+  {
+    const GrayAlphaPixel *pixels;
+
+    uint32_t operator[](int64_t i) const
+    {
+      return Color::from_gray(pixels[i].gray, pixels[i].alpha).value();
+    }
+  };
+
+  /*
+   *  Source pixel at (u, v) in 32.32 fixed point, inside of the image.
+   *  Source rows are `stride` pixels apart.
+   * */
+  template<bool Bilinear, typename Source>
+  static inline uint32_t sample_affine(
+    const Source &src, int64_t stride, int64_t width, int64_t height,
+    int64_t u, int64_t v)
+  {
+    if constexpr (!Bilinear)
+      return src[(v >> 32) * stride + (u >> 32)];
+
+    // between the centers of 4 pixels around (u, v)
+    constexpr int64_t HALF = 1l << 31;
+    const int64_t su = std::max<int64_t>(u - HALF, 0);
+    const int64_t sv = std::max<int64_t>(v - HALF, 0);
+    const int64_t x0 = su >> 32;
+    const int64_t y0 = sv >> 32;
+    const int64_t x1 = std::min<int64_t>(x0 + 1, width - 1);
+    const int64_t y1 = std::min<int64_t>(y0 + 1, height - 1);
+    return Kernels::bilinear_pixel(
+      src[y0 * stride + x0], src[y0 * stride + x1], src[y1 * stride + x0],
+      src[y1 * stride + x1], (su >> 24) & 0xff, (sv >> 24) & 0xff);
   }
 
-  void Painter::draw_rectangle(
-    const int x1, const int y1, const int x2, const int y2, const Color &color)
+  template<bool Bilinear, bool Keyed, typename Source>
+  static void sample_affine_row(
+    uint32_t *dest, Source src, int64_t stride, int64_t width, int64_t height,
+    int64_t u, int64_t v, int64_t du, int64_t dv, size_t length)
   {
-    const int t_width = target->width();
-    const int t_height = target->height();
+    for (size_t i = 0; i < length; ++i, u += du, v += dv)
+    {
+      const uint32_t pixel =
+        sample_affine<Bilinear>(src, stride, width, height, u, v);
+      if (!Keyed || (pixel & 0xff) != 0)
+        dest[i] = pixel;
+    }
+  }
 
-    if (x1 < 0 && y1 < 0 && x2 < 0 && y2 < 0)
+  // picks the row sampler for a filter and a blending mode
+  template<typename Source>
+  static auto affine_row_sampler(bool bilinear, bool keyed)
+  {
+    if (bilinear)
+    {
+      return keyed ? sample_affine_row<true, true, Source>
+                   : sample_affine_row<true, false, Source>;
+    }
+    return keyed ? sample_affine_row<false, true, Source>
+                 : sample_affine_row<false, false, Source>;
+  }
+
+  /*
+   *  Source coordinates are in 32.32 fixed point, stepped incrementally
+   *  along every row. Steps are exact integers, so the range of pixels
+   *  mapped inside of the image is solved per row instead of testing
+   *  every pixel.
+   * */
+  void Painter::draw_image_affine(
+    const ImageView &image, const glm::mat3 &transform, BlendMode mode,
+    ScaleFilter filter)
+  {
+    constexpr double FIXED_ONE = 4294967296.0;
+
+    const int image_width = image.width();
+    const int image_height = image.height();
+    if (image_width <= 0 || image_height <= 0)
       return;
-    if (x1 >= t_width && y1 >= t_height && x2 >= t_width && y2 >= t_height)
+
+    const glm::dmat3 matrix(transform);
+    const double det = glm::determinant(matrix);
+    if (det == 0.0 || !std::isfinite(det))
       return;
 
-    if (x1 == x2 || y1 == y2)
+    double min_x = INFINITY, min_y = INFINITY;
+    double max_x = -INFINITY, max_y = -INFINITY;
+    for (const glm::dvec2 corner : { glm::dvec2(0.0, 0.0),
+                                     glm::dvec2(image_width, 0.0),
+                                     glm::dvec2(0.0, image_height),
+                                     glm::dvec2(image_width, image_height) })
     {
-      return draw_line(x1, y1, x2, y2, color);
+      const glm::dvec3 p = matrix * glm::dvec3(corner, 1.0);
+      min_x = std::min(min_x, p.x);
+      min_y = std::min(min_y, p.y);
+      max_x = std::max(max_x, p.x);
+      max_y = std::max(max_y, p.y);
     }
 
-    int xx = x1;
-    int w = x2 - x1;
-    if (w < 0)
-    {
-      xx = x2;
-      w = x1 - x2;
-    }
-    int yy = y1;
-    int h = y2 - y1;
-    if (h < 0)
+    // huge bounds are clipped anyway
+    const Rect clip = get_clip();
+    const double x1 = std::max(std::floor(min_x), (double)clip.left());
+    const double y1 = std::max(std::floor(min_y), (double)clip.top());
+    const double x2 = std::min(std::ceil(max_x), (double)clip.right());
+    const double y2 = std::min(std::ceil(max_y), (double)clip.bottom());
+    if (x2 <= x1 || y2 <= y1)
+      return;
+
+    const Rect area(x1, y1, x2 - x1, y2 - y1);
+    const glm::dmat3 inverse = glm::inverse(matrix);
+
+    auto fixed = [](double v) -> int64_t {
+      return std::llround(v * FIXED_ONE);
+    };
+    const int64_t du = fixed(inverse[0][0]);
+    const int64_t dv = fixed(inverse[0][1]);
+    const int64_t u_end = (int64_t)image_width << 32;
+    const int64_t v_end = (int64_t)image_height << 32;
+
+    const bool bilinear = filter == ScaleFilter::Bilinear;
+    const bool keyed = mode == BlendMode::ColorKey;
+    // samples are written to the target directly when they aren't blended,
+    // reading them back from a buffer is slower than sampling
+    const bool direct = keyed || mode == BlendMode::Replace;
+    const auto image_format = image.get_format();
+    const bool gray = image_format == PixelFormat::Gray;
+    const bool gray_alpha = image_format == PixelFormat::GrayAlpha;
+    const int stride = image.stride();
+    const DirectSource direct_source { image.get_data() };
+    const bool indexed = image.is_indexed();
+    const IndexedSource indexed_source {
+      indexed ? image.view<uint8_t>().row(0) : nullptr,
+      indexed ? image.get_palette()->get_data() : nullptr
+    };
+    const GraySource gray_source {
+      gray ? image.view<uint8_t>().row(0) : nullptr
+    };
+    const GrayAlphaSource gray_alpha_source {
+      gray_alpha ? image.view<GrayAlphaPixel>().row(0) : nullptr
+    };
+    const auto sample_direct =
+      affine_row_sampler<DirectSource>(bilinear, keyed);
+    const auto sample_indexed =
+      affine_row_sampler<IndexedSource>(bilinear, keyed);
+    const auto sample_gray = affine_row_sampler<GraySource>(bilinear, keyed);
+    const auto sample_gray_alpha =
+      affine_row_sampler<GrayAlphaSource>(bilinear, keyed);
+    const int t_width = target->width();
+    row_buffer.resize(area.width());
+
+    int changed_left = area.right();
+    int changed_right = area.left();
+    int changed_top = area.bottom();
+    int changed_bottom = area.top();
+
+    for (int ty = area.top(); ty < area.bottom(); ++ty)
     {
-      yy = y2;
-      h = y1 - y2;
+      const glm::dvec3 start =
+        inverse * glm::dvec3(area.left() + 0.5, ty + 0.5, 1.0);
+      const int64_t u0 = fixed(start.x);
+      const int64_t v0 = fixed(start.y);
+
+      int64_t first = 0;
+      int64_t end = area.width();
+      limit_steps(u0, du, 0, u_end, first, end);
+      limit_steps(v0, dv, 0, v_end, first, end);
+      if (first >= end)
+        continue;
+
+      const int64_t u = u0 + first * du;
+      const int64_t v = v0 + first * dv;
+      const size_t length = end - first;
+      const int tx = area.left() + first;
+      auto dest = target->data.get() + move_ptr_to_xy(tx, ty, t_width);
+
+      uint32_t *row = direct ? dest : row_buffer.data();
+      if (indexed)
+      {
+        sample_indexed(
+          row, indexed_source, stride, image_width, image_height, u, v, du,
+          dv, length);
+      }
+      else if (gray)
+      {
+        sample_gray(
+          row, gray_source, stride, image_width, image_height, u, v, du, dv,
+          length);
+      }
+      else if (gray_alpha)
+      {
+        sample_gray_alpha(
+          row, gray_alpha_source, stride, image_width, image_height, u, v,
+          du, dv, length);
+      }
+      else
+      {
+        sample_direct(
+          row, direct_source, stride, image_width, image_height, u, v, du,
+          dv, length);
+      }
+      if (!direct)
+        Kernels::blend_row(dest, row, length, mode, image_format);
+
+      changed_left = std::min(changed_left, tx);
+      changed_right = std::max(changed_right, tx + (int)length);
+      changed_top = std::min(changed_top, ty);
+      changed_bottom = ty + 1;
     }
 
-    if (xx < 0)
+    if (changed_left < changed_right)
     {
-      w -= -xx + 1;
-      xx = 0;
+      mark_changed(Rect::from_corners(
+        changed_left, changed_top, changed_right - 1, changed_bottom - 1));
     }
-    if (yy < 0)
+  }
+
+  void Painter::draw_text(
+    const int x, const int y, const Font &font, std::string_view text,
+    const Color &color, BlendMode mode)
+  {
+    const Rect clip = get_clip();
+    Rect changed;
+
+    font.for_each_glyph(text, [&](int gx, int gy, const Font::Glyph &g) {
+      const Rect rect(x + gx, y + gy, g.width, g.height);
+      changed = changed.united(blend_coverage(
+        clip, rect, font.coverage(g), g.width, color, mode));
+    });
+    mark_changed(changed);
+  }
+
+  // Cohen-Sutherland region codes
+  enum OutCode
+  {
+    OUT_INSIDE = 0,
+    OUT_LEFT = 1,
+    OUT_RIGHT = 2,
+    OUT_TOP = 4,
+    OUT_BOTTOM = 8
+  };
+
+  static int out_code(const int x, const int y, const Rect &clip)
+  {
+    int code = OUT_INSIDE;
+
+    if (x < clip.left())
+      code |= OUT_LEFT;
+    else if (x >= clip.right())
+      code |= OUT_RIGHT;
+
+    if (y < clip.top())
+      code |= OUT_TOP;
+    else if (y >= clip.bottom())
+      code |= OUT_BOTTOM;
+
+    return code;
+  }
+
+  // for a >= 0 and b > 0
+  static int64_t ceil_div(const int64_t a, const int64_t b)
+  {
+    return (a + b - 1) / b;
+  }
+
+  bool Painter::horizontal_span(
+    int x1, int x2, const int y, const Rect &clip, const Color &color,
+    BlendMode mode)
+  {
+    if (y < clip.top() || y >= clip.bottom())
+      return false;
+
+    x1 = std::max(x1, clip.left());
+    x2 = std::min(x2, clip.right());
+    if (x2 <= x1)
+      return false;
+
+    auto dest = target->data.get() + move_ptr_to_xy(x1, y, target->width());
+    Kernels::blend_fill(dest, color.value(), x2 - x1, mode);
+    return true;
+  }
+
+  bool Painter::vertical_span(
+    const int x, int y1, int y2, const Rect &clip, const Color &color,
+    BlendMode mode)
+  {
+    if (x < clip.left() || x >= clip.right())
+      return false;
+
+    y1 = std::max(y1, clip.top());
+    y2 = std::min(y2, clip.bottom());
+    if (y2 <= y1)
+      return false;
+
+    const int t_width = target->width();
+    const uint32_t value = color.value();
+    auto dest = target->data.get() + move_ptr_to_xy(x, y1, t_width);
+
+    if (mode == BlendMode::Replace)
     {
-      h -= -yy + 1;
-      yy = 0;
+      for (int y = y1; y < y2; ++y, dest += t_width)
+        *dest = value;
+      return true;
     }
-    if (xx >= t_width)
+
+    for (int y = y1; y < y2; ++y, dest += t_width)
+      Kernels::blend_fill(dest, value, 1, mode);
+    return true;
+  }
+
+  /*
+   *  Integer Bresenham. Step i along the major axis moves the minor axis by
+   *  q(i) = floor((2 * i * minor_len + major_len) / (2 * major_len)).
+   *  Region codes reject lines lying fully on one side of the clip. Lines
+   *  crossing the clip edge are limited to the range of steps whose pixels
+   *  are inside, and the error term is computed directly for the first of
+   *  them, so a clipped line has exactly the same pixels as an unclipped one.
+   * */
+  bool Painter::clipped_line(
+    const int x1, const int y1, const int code1, const int x2, const int y2,
+    const int code2, const Rect &clip, const Color &color, BlendMode mode)
+  {
+    if (code1 & code2)
+      return false;
+
+    if (y1 == y2)
     {
-      w -= t_width - xx + 1;
-      xx = t_width;
+      if (x1 < x2)
+        return horizontal_span(x1, x2, y1, clip, color, mode);
+      return horizontal_span(x2 + 1, x1 + 1, y1, clip, color, mode);
     }
-    if (yy >= t_height)
+
+    if (x1 == x2)
     {
-      h -= t_height - yy + 1;
-      yy = t_height;
+      if (y1 < y2)
+        return vertical_span(x1, y1, y2, clip, color, mode);
+      return vertical_span(x1, y2 + 1, y1 + 1, clip, color, mode);
     }
 
-    for (int i = 0; i <= w; i++)
+    const int64_t dx = (int64_t)x2 - x1;
+    const int64_t dy = (int64_t)y2 - y1;
+    const bool x_major = std::abs(dx) >= std::abs(dy);
+
+    const int64_t major_len = x_major ? std::abs(dx) : std::abs(dy);
+    const int64_t minor_len = x_major ? std::abs(dy) : std::abs(dx);
+    const int major_dir = (x_major ? dx : dy) < 0 ? -1 : 1;
+    const int minor_dir = (x_major ? dy : dx) < 0 ? -1 : 1;
+    const int major_start = x_major ? x1 : y1;
+    const int minor_start = x_major ? y1 : x1;
+
+    int64_t first = 0;
+    int64_t last = major_len - 1;
+
+    if (code1 | code2)
     {
-      if (xx + i >= t_width)
+      const int major_lo = x_major ? clip.left() : clip.top();
+      const int major_hi = (x_major ? clip.right() : clip.bottom()) - 1;
+      const int minor_lo = x_major ? clip.top() : clip.left();
+      const int minor_hi = (x_major ? clip.bottom() : clip.right()) - 1;
+
+      if (major_dir > 0)
       {
-        continue;
+        first = std::max<int64_t>(first, major_lo - major_start);
+        last = std::min<int64_t>(last, major_hi - major_start);
+      }
+      else
+      {
+        first = std::max<int64_t>(first, major_start - major_hi);
+        last = std::min<int64_t>(last, major_start - major_lo);
       }
 
-      if (y1 >= 0 && y1 < t_height)
-        target->set_pixel(xx + i, y1, color);
+      // allowed range of q(i)
+      const int64_t q_lo =
+        minor_dir > 0 ? minor_lo - minor_start : minor_start - minor_hi;
+      const int64_t q_hi =
+        minor_dir > 0 ? minor_hi - minor_start : minor_start - minor_lo;
 
-      if (y2 >= 0 && y2 < t_height)
-        target->set_pixel(xx + i, y2, color);
+      if (q_hi < 0)
+        return false;
+
+      if (q_lo > 0)
+      {
+        first = std::max(
+          first,
+          ceil_div(2 * major_len * q_lo - major_len, 2 * minor_len));
+      }
+      last = std::min(
+        last,
+        ceil_div(2 * major_len * (q_hi + 1) - major_len, 2 * minor_len) - 1);
     }
 
-    for (int i = 0; i <= h; i++)
-    {
-      if (yy + i >= t_height)
+    if (first > last)
+      return false;
+
+    const int64_t two_major = 2 * major_len;
+    const int64_t two_minor = 2 * minor_len;
+    const int64_t numerator = 2 * first * minor_len + major_len;
+    const int64_t q = numerator / two_major;
+    int64_t err = numerator % two_major;
+
+    const long t_width = target->width();
+    const long major_pos = major_start + major_dir * first;
+    const long minor_pos = minor_start + minor_dir * q;
+    const long major_step = x_major ? major_dir : major_dir * t_width;
+    const long minor_step = x_major ? minor_dir * t_width : minor_dir;
+
+    long offset = x_major ? move_ptr_to_xy(major_pos, minor_pos, t_width)
+                          : move_ptr_to_xy(minor_pos, major_pos, t_width);
+    uint32_t *data = target->data.get();
+    const uint32_t value = color.value();
+
+    auto rasterize = [&](auto plot) {
+      for (int64_t i = first; i <= last; ++i)
       {
-        continue;
+        plot(data + offset);
+        if (i == last)
+          break;
+
+        offset += major_step;
+        err += two_minor;
+        if (err >= two_major)
+        {
+          err -= two_major;
+          offset += minor_step;
+        }
       }
+    };
 
-      if (x1 >= 0 && x1 < t_width)
-        target->set_pixel(x1, yy + i, color);
+    if (mode == BlendMode::Replace)
+      rasterize([value](uint32_t *dest) { *dest = value; });
+    else
+      rasterize([value, mode](uint32_t *dest) {
+        Kernels::blend_fill(dest, value, 1, mode);
+      });
 
-      if (x2 >= 0 && x2 < t_width)
-        target->set_pixel(x2, yy + i, color);
-    }
-    target->changes++;
+    return true;
   }
 
-  void Painter::draw_circle(
-    const int x, const int y, const int radius, const Color &color)
+  void Painter::draw_line(
+    const int x1, const int y1, const int x2, const int y2, const Color &color,
+    BlendMode mode)
   {
-    if (x + radius < 0)
+    const Rect clip = get_clip();
+    const int code1 = out_code(x1, y1, clip);
+    const int code2 = out_code(x2, y2, clip);
+
+    if (!clipped_line(x1, y1, code1, x2, y2, code2, clip, color, mode))
       return;
-    if (y + radius < 0)
+
+    mark_changed(
+      clip.intersected(Rect::from_corners(x1, y1, x2, y2)));
+  }
+
+  void Painter::draw_polyline(
+    std::span<const Point> points, const Color &color, BlendMode mode)
+  {
+    if (points.empty())
       return;
-    if (x - radius >= target->width())
+
+    const Rect clip = get_clip();
+    bool drawn = false;
+
+    int code = out_code(points[0].x, points[0].y, clip);
+    for (size_t i = 1; i < points.size(); ++i)
+    {
+      const Point &a = points[i - 1];
+      const Point &b = points[i];
+      const int next_code = out_code(b.x, b.y, clip);
+      drawn |= clipped_line(
+        a.x, a.y, code, b.x, b.y, next_code, clip, color, mode);
+      code = next_code;
+    }
+
+    // segments skip their end points, so the last one is drawn separately,
+    // unless it closes the polyline and was drawn as the first one
+    const bool closed = points.size() > 1 && points.back() == points.front();
+    if (code == OUT_INSIDE && !closed)
+    {
+      blend_pixel(points.back().x, points.back().y, color, mode);
+      drawn = true;
+    }
+
+    if (drawn)
+      mark_changed(clip.intersected(points_bounds(points)));
+  }
+
+  void Painter::clear_rectangle(int x1, int y1, int x2, int y2)
+  {
+    if (x2 < x1)
+      std::swap(x1, x2);
+    if (y2 < y1)
+      std::swap(y2, y1);
+
+    BasicPainter<ReplaceSink> painter(*target, get_clip());
+    mark_changed(
+      painter.fill_rectangle(Rect(x1, y1, x2 - x1, y2 - y1), Color(0).value()));
+  }
+
+  void Painter::draw_rectangle(
+    const int x1, const int y1, const int x2, const int y2, const Color &color,
+    BlendMode mode)
+  {
+    const Rect clip = get_clip();
+    const Rect bounds = Rect::from_corners(x1, y1, x2, y2);
+
+    if (!clip.intersects(bounds))
       return;
-    if (y - radius >= target->height())
+
+    const int left = bounds.left();
+    const int top = bounds.top();
+    const int right = bounds.right() - 1;
+    const int bottom = bounds.bottom() - 1;
+
+    // horizontal edges with corners, vertical edges without them
+    horizontal_span(left, right + 1, top, clip, color, mode);
+    if (bottom != top)
+      horizontal_span(left, right + 1, bottom, clip, color, mode);
+
+    vertical_span(left, top + 1, bottom, clip, color, mode);
+    if (right != left)
+      vertical_span(right, top + 1, bottom, clip, color, mode);
+
+    mark_changed(clip.intersected(bounds));
+  }
+
+  void Painter::draw_circle(
+    const int x, const int y, const int radius, const Color &color,
+    BlendMode mode)
+  {
+    const Rect clip = get_clip();
+    const Rect bounds = Rect::from_corners(
+      x - radius, y - radius, x + radius, y + radius);
+
+    if (!clip.intersects(bounds))
       return;
 
-    const int t_width = target->width();
-    const int t_height = target->height();
+    // per pixel tests are needed only if the circle crosses the clip edge
+    const bool inside = clip.contains(bounds);
+    auto in_target_bounds = [&clip, inside](const int t_x, const int t_y) {
+      return inside || clip.contains(t_x, t_y);
+    };
 
-    auto in_target_bounds = [&t_width,
-                             &t_height](const int t_x, const int t_y) -> bool {
-      return in_bounds(t_x, t_y, t_width, t_height);
+    // mirrored points on the axes and on the diagonals are drawn once,
+    // so blending modes don't hit them twice
+    auto plot = [&](const int t_x, const int t_y) {
+      if (in_target_bounds(t_x, t_y))
+        blend_pixel(t_x, t_y, color, mode);
+    };
+    auto plot_mirrored = [&](const int dx, const int dy) {
+      plot(x + dx, y + dy);
+      if (dx != 0)
+        plot(x - dx, y + dy);
+      if (dy != 0)
+      {
+        plot(x + dx, y - dy);
+        if (dx != 0)
+          plot(x - dx, y - dy);
+      }
     };
 
     int xx = radius;
@@ -371,29 +1165,59 @@ namespace ZD
 
     while (xx >= yy)
     {
-      if (in_target_bounds(x + xx, y + yy))
-        target->set_pixel(x + xx, y + yy, color);
+      plot_mirrored(xx, yy);
+      if (xx != yy)
+        plot_mirrored(yy, xx);
 
-      if (in_target_bounds(x + yy, y + xx))
-        target->set_pixel(x + yy, y + xx, color);
+      if (err <= 0)
+      {
+        yy += 1;
+        err += 2 * yy + 1;
+      }
 
-      if (in_target_bounds(x - yy, y + xx))
-        target->set_pixel(x - yy, y + xx, color);
+      if (err > 0)
+      {
+        xx -= 1;
+        err -= 2 * xx + 1;
+      }
+    }
+    mark_changed(clip.intersected(bounds));
+  }
 
-      if (in_target_bounds(x - xx, y + yy))
-        target->set_pixel(x - xx, y + yy, color);
+  void Painter::fill_rectangle(
+    const int x1, const int y1, const int x2, const int y2, const Color &color,
+    BlendMode mode)
+  {
+    BasicPainter<BlendSink> painter(*target, get_clip(), BlendSink { mode });
+    mark_changed(painter.fill_rectangle(
+      Rect::from_corners(x1, y1, x2, y2), color.value()));
+  }
 
-      if (in_target_bounds(x - xx, y - yy))
-        target->set_pixel(x - xx, y - yy, color);
+  void Painter::fill_circle(
+    const int x, const int y, const int radius, const Color &color,
+    BlendMode mode)
+  {
+    if (radius < 0)
+      return;
 
-      if (in_target_bounds(x - yy, y - xx))
-        target->set_pixel(x - yy, y - xx, color);
+    const Rect clip = get_clip();
+    const Rect bounds = Rect::from_corners(
+      x - radius, y - radius, x + radius, y + radius);
 
-      if (in_target_bounds(x + yy, y - xx))
-        target->set_pixel(x + yy, y - xx, color);
+    if (!clip.intersects(bounds))
+      return;
 
-      if (in_target_bounds(x + xx, y - yy))
-        target->set_pixel(x + xx, y - yy, color);
+    // half width of every row, walked the same way as draw_circle
+    circle_extents.assign(radius + 1, 0);
+
+    int xx = radius;
+    int yy = 0;
+    int err = 0;
+
+    while (xx >= yy)
+    {
+      circle_extents[yy] = std::max(circle_extents[yy], xx);
+      circle_extents[xx] = std::max(circle_extents[xx], yy);
 
       if (err <= 0)
       {
@@ -407,7 +1231,223 @@ namespace ZD
         err -= 2 * xx + 1;
       }
     }
-    target->changes++;
+
+    const int y1 = std::max(y - radius, clip.top());
+    const int y2 = std::min(y + radius + 1, clip.bottom());
+
+    for (int ty = y1; ty < y2; ++ty)
+    {
+      const int extent = circle_extents[std::abs(ty - y)];
+      horizontal_span(x - extent, x + extent + 1, ty, clip, color, mode);
+    }
+    mark_changed(clip.intersected(bounds));
+  }
+
+  void Painter::fill_triangle(
+    const int x1, const int y1, const int x2, const int y2, const int x3,
+    const int y3, const Color &color, BlendMode mode)
+  {
+    const Rect clip = get_clip();
+
+    Point v[3] = { { x1, y1 }, { x2, y2 }, { x3, y3 } };
+    std::sort(v, v + 3, [](const Point &a, const Point &b) {
+      return a.y < b.y;
+    });
+
+    if (v[0].y == v[2].y)
+      return;
+
+    const int min_x = std::min({ x1, x2, x3 });
+    const int max_x = std::max({ x1, x2, x3 });
+    const Rect bounds = Rect::from_corners(min_x, v[0].y, max_x, v[2].y);
+    if (!clip.intersects(bounds))
+      return;
+
+    const int row_first = std::max(v[0].y, clip.top());
+    const int row_end = std::min(v[2].y, clip.bottom());
+
+    // edge from the top to the bottom vertex spans both halves
+    ScanEdge long_edge = ScanEdge::create(v[0].x, v[0].y, v[2].x, v[2].y);
+    bool drawn = false;
+
+    for (int half = 0; half < 2; ++half)
+    {
+      const Point &a = v[half];
+      const Point &b = v[half + 1];
+      if (a.y == b.y)
+        continue;
+
+      const int y_first = std::max(a.y, row_first);
+      const int y_end = std::min(b.y, row_end);
+      if (y_first >= y_end)
+        continue;
+
+      ScanEdge short_edge = ScanEdge::create(a.x, a.y, b.x, b.y);
+      short_edge.set_row(y_first);
+      long_edge.set_row(y_first);
+
+      for (int y = y_first; y < y_end; ++y)
+      {
+        const int l = long_edge.boundary();
+        const int s = short_edge.boundary();
+        drawn |= horizontal_span(
+          std::min(l, s), std::max(l, s), y, clip, color, mode);
+
+        long_edge.step();
+        short_edge.step();
+      }
+    }
+
+    if (drawn)
+      mark_changed(clip.intersected(bounds));
+  }
+
+  /*
+   *  Active edge table rasteriser. Edges are sorted by their first row and
+   *  moved to the active list when the scanline reaches them. Active edges
+   *  are kept sorted by their crossing (insertion sort, since the order
+   *  changes only where edges cross) and filled in pairs.
+   * */
+  void Painter::fill_polygon(
+    std::span<const Point> points, const Color &color, BlendMode mode)
+  {
+    if (points.size() < 3)
+      return;
+
+    const Rect clip = get_clip();
+
+    edges.clear();
+    for (size_t i = 0; i < points.size(); ++i)
+    {
+      const Point &a = points[i];
+      const Point &b = points[(i + 1) % points.size()];
+      if (a.y == b.y)
+        continue;
+
+      const ScanEdge e = ScanEdge::create(a.x, a.y, b.x, b.y);
+      if (e.y_end <= clip.top() || e.y_start >= clip.bottom())
+        continue;
+
+      edges.push_back(e);
+    }
+
+    if (edges.empty())
+      return;
+
+    std::sort(edges.begin(), edges.end(), [](const auto &a, const auto &b) {
+      return a.y_start < b.y_start;
+    });
+
+    int y_end = clip.top();
+    for (const auto &e : edges)
+    {
+      y_end = std::max(y_end, e.y_end);
+    }
+    y_end = std::min(y_end, clip.bottom());
+
+    active_edges.clear();
+    size_t next_edge = 0;
+    bool drawn = false;
+
+    for (int y = std::max(edges[0].y_start, clip.top()); y < y_end; ++y)
+    {
+      std::erase_if(active_edges, [y](const auto &e) { return e.y_end <= y; });
+
+      for (; next_edge < edges.size() && edges[next_edge].y_start <= y;
+           ++next_edge)
+      {
+        ScanEdge e = edges[next_edge];
+        if (e.y_end <= y)
+          continue;
+
+        e.set_row(y);
+        active_edges.push_back(e);
+      }
+
+      for (size_t i = 1; i < active_edges.size(); ++i)
+      {
+        for (size_t j = i;
+             j > 0 &&
+             active_edges[j].boundary() < active_edges[j - 1].boundary();
+             --j)
+        {
+          std::swap(active_edges[j], active_edges[j - 1]);
+        }
+      }
+
+      for (size_t i = 0; i + 1 < active_edges.size(); i += 2)
+      {
+        drawn |= horizontal_span(
+          active_edges[i].boundary(),
+          active_edges[i + 1].boundary(),
+          y,
+          clip,
+          color,
+          mode);
+      }
+
+      for (auto &e : active_edges)
+      {
+        e.step();
+      }
+    }
+
+    if (drawn)
+      mark_changed(clip.intersected(points_bounds(points)));
+  }
+
+  void Painter::fill_path(
+    const Path &path, const Color &color, FillRule rule, BlendMode mode)
+  {
+    // maximal distance between curves and lines approximating them
+    constexpr float PATH_TOLERANCE = 0.1f;
+
+    if (path.is_empty())
+      return;
+
+    const Rect bounds = path.bounds();
+    const Rect area = get_clip().intersected(bounds);
+    if (area.is_empty())
+      return;
+
+    path_points.clear();
+    path_contours.clear();
+    path.flatten(PATH_TOLERANCE, path_points, path_contours);
+
+    // rows are counted from the top of the path, not of the clip, so the
+    // coverage doesn't depend on the clip (see ParallelPainter)
+    const int top = std::max(bounds.top(), 0);
+    const glm::vec2 offset(area.left(), top);
+    path_rasterizer.reset(
+      area.width(), area.bottom() - top, area.top() - top);
+
+    // contours are closed when filled
+    for (const auto &contour : path_contours)
+    {
+      const glm::vec2 *p = path_points.data() + contour.first;
+      for (size_t i = 0; i < contour.count; ++i)
+      {
+        path_rasterizer.add_line(
+          p[i] - offset, p[(i + 1) % contour.count] - offset);
+      }
+    }
+
+    const int t_width = target->width();
+    const uint32_t value = color.value();
+    auto dest =
+      target->data.get() + move_ptr_to_xy(area.left(), top, t_width);
+
+    path_rasterizer.resolve(rule, [&](int row, const uint8_t *coverage) {
+      Kernels::blend_mask(
+        dest + (long)row * t_width, value, coverage, area.width(), mode);
+    });
+    mark_changed(area);
+  }
+
+  void Painter::stroke_path(
+    const Path &path, float width, const Color &color, BlendMode mode)
+  {
+    fill_path(path.stroke(width), color, FillRule::NonZero, mode);
   }
 
 } // namespace ZD
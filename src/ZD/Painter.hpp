@@ -1,8 +1,17 @@
 #pragma once
 
+#include "3rd/glm/mat3x3.hpp"
 #include "Image.hpp"
+#include "ImageView.hpp"
+#include "Path.hpp"
+#include "Point.hpp"
+#include "Rect.hpp"
+#include "ScanEdge.hpp"
 #include "Size.hpp"
 #include <memory>
+#include <span>
+#include <string_view>
+#include <vector>
 
 #include "Color.hpp"
 
@@ -10,6 +19,7 @@ namespace ZD
 {
   class Renderer;
   class Image;
+  class Font;
 
   enum AspectRatioOptions
   {
@@ -17,6 +27,20 @@ namespace ZD
     NoPreserveAspectRatio
   };
 
+  enum class ScaleFilter
+  {
+    Nearest,
+    Bilinear
+  };
+
+  enum class ImageFlip
+  {
+    None,
+    Horizontal,
+    Vertical,
+    Both
+  };
+
   class Painter
   {
   public:
@@ -24,45 +48,202 @@ namespace ZD
     Painter(std::shared_ptr<Image> image);
     virtual ~Painter() = default;
 
-    virtual void set_pixel(const int x, const int y, const Color &color);
-    virtual void draw_image(const int x, const int y, const Image &image);
+    virtual void set_pixel(
+      const int x, const int y, const Color &color,
+      BlendMode mode = BlendMode::Replace);
+    /*
+     *  Pixels in bulk, e.g. for particles. Points outside of the clip are
+     *  culled in batches and the bounding box of the plotted points is
+     *  recorded as changed once per call.
+     *  Overlapping points are blended one after another, so they accumulate
+     *  with Additive mode.
+     * */
+    virtual void plot_points(
+      std::span<const Point> points, const Color &color,
+      BlendMode mode = BlendMode::Replace);
+    // colors[i] is the color of points[i]
+    virtual void plot_points(
+      std::span<const Point> points, std::span<const Color> colors,
+      BlendMode mode = BlendMode::Replace);
     virtual void draw_image(
-      const int x, const int y, const Image &image, double scale_x,
-      double scale_y);
+      const int x, const int y, const ImageView &image,
+      BlendMode mode = BlendMode::ColorKey);
+    /*
+     *  Whole positive scales with Nearest filter just duplicate pixels,
+     *  e.g. for presenting a low resolution canvas 2x, 3x or 4x larger.
+     * */
     virtual void draw_image(
-      const int x, const int y, const Image &image, const int width,
+      const int x, const int y, const ImageView &image, double scale_x,
+      double scale_y, BlendMode mode = BlendMode::ColorKey,
+      ScaleFilter filter = ScaleFilter::Nearest);
+    /*
+     *  Draws runs of visible pixels (see Image::get_rle), transparent ones
+     *  are skipped without reading them. Used for ColorKey and for modes
+     *  which don't change the destination under alpha 0 (SrcOver, Additive,
+     *  Multiply), other modes fall back to per pixel blending.
+     * */
+    virtual void draw_image(
+      const int x, const int y, const ImageView &image, ImageFlip flip,
+      BlendMode mode = BlendMode::ColorKey);
+    // draws `source` part of the image with its top left corner at (x, y)
+    virtual void draw_image(
+      const int x, const int y, const ImageView &image, const Rect &source,
+      BlendMode mode = BlendMode::ColorKey);
+    virtual void draw_image(
+      const int x, const int y, const ImageView &image, const int width,
       const int height,
-      AspectRatioOptions aspect_ratio_options = NoPreserveAspectRatio);
+      AspectRatioOptions aspect_ratio_options = NoPreserveAspectRatio,
+      BlendMode mode = BlendMode::ColorKey,
+      ScaleFilter filter = ScaleFilter::Nearest);
+    /*
+     *  Draws the image transformed by an affine matrix mapping source pixel
+     *  coordinates to the target ((0, 0) is the top left corner of the first
+     *  pixel). Every target pixel center is mapped back to the source,
+     *  pixels mapped outside of the image aren't drawn.
+     * */
+    virtual void draw_image_affine(
+      const ImageView &image, const glm::mat3 &transform,
+      BlendMode mode = BlendMode::ColorKey,
+      ScaleFilter filter = ScaleFilter::Nearest);
+    /*
+     *  Draws text with its top left corner at (x, y), '\n' starts a new line.
+     *  Glyph coverage scales the alpha of the color, so Replace and ColorKey
+     *  modes behave like SrcOver.
+     * */
+    virtual void draw_text(
+      const int x, const int y, const Font &font, std::string_view text,
+      const Color &color, BlendMode mode = BlendMode::SrcOver);
+    // draws from (x1, y1) up to (x2, y2), the end point is not drawn
     virtual void draw_line(
       const int x1, const int y1, const int x2, const int y2,
-      const Color &color);
+      const Color &color, BlendMode mode = BlendMode::Replace);
+    /*
+     *  Connects consecutive points, every point is drawn exactly once, also
+     *  the start of a closed polyline (ending at its first point).
+     *  Segments crossing each other blend their crossing twice.
+     * */
+    virtual void draw_polyline(
+      std::span<const Point> points, const Color &color,
+      BlendMode mode = BlendMode::Replace);
     virtual void draw_rectangle(
       const int x1, const int y1, const int x2, const int y2,
-      const Color &color);
+      const Color &color, BlendMode mode = BlendMode::Replace);
     virtual void clear_rectangle(int x1, int y1, int x2, int y2);
     virtual void draw_circle(
-      const int x, const int y, const int radius, const Color &color);
-    inline void clear(const Color &c = Color(0))
-    {
-      target->clear(c);
-      target->changes++;
-    }
-    inline void fill(const Color &c)
-    {
-      target->clear(c);
-      target->changes++;
-    }
+      const int x, const int y, const int radius, const Color &color,
+      BlendMode mode = BlendMode::Replace);
+
+    /*
+     *  Filled primitives are drawn as clipped horizontal spans, every pixel
+     *  is written once so they can be used with blending modes.
+     *  Rectangles and circles cover the same pixels as their outlines,
+     *  triangles and polygons fill pixels with centers inside of the shape
+     *  (polygons use even-odd rule).
+     * */
+    virtual void fill_rectangle(
+      const int x1, const int y1, const int x2, const int y2,
+      const Color &color, BlendMode mode = BlendMode::Replace);
+    virtual void fill_circle(
+      const int x, const int y, const int radius, const Color &color,
+      BlendMode mode = BlendMode::Replace);
+    virtual void fill_triangle(
+      const int x1, const int y1, const int x2, const int y2, const int x3,
+      const int y3, const Color &color, BlendMode mode = BlendMode::Replace);
+    virtual void fill_polygon(
+      std::span<const Point> points, const Color &color,
+      BlendMode mode = BlendMode::Replace);
+
+    /*
+     *  Anti-aliased path filling. Coverage of every pixel scales the alpha
+     *  of the color, so Replace and ColorKey modes behave like SrcOver.
+     * */
+    virtual void fill_path(
+      const Path &path, const Color &color,
+      FillRule rule = FillRule::NonZero, BlendMode mode = BlendMode::SrcOver);
+    virtual void stroke_path(
+      const Path &path, float width, const Color &color,
+      BlendMode mode = BlendMode::SrcOver);
+    // both set every pixel inside of the clip, so only the pushed panel or
+    // viewport is cleared
+    virtual void clear(const Color &c = Color(0)) { fill_area(get_clip(), c); }
+    virtual void fill(const Color &c) { fill_area(get_clip(), c); }
 
     const Color get_pixel(const int x, const int y) const
     {
       return target->get_pixel(x, y);
     }
 
+    /*
+     *  Limits drawing to the rectangle (in target pixels).
+     *  Every pushed rectangle is intersected with the previous one,
+     *  so nested panels can't draw outside of their parents.
+     * */
+    virtual void push_clip(const Rect &rect);
+    virtual void pop_clip();
+    Rect get_clip() const;
+
     void set_target(std::shared_ptr<Image> new_target) { target = new_target; }
     std::shared_ptr<Image> get_target() { return target; }
 
+  protected:
+    // records the area touched by drawing in the target
+    virtual void mark_changed(const Rect &rect);
+    // fills the area with the color, ignoring the clip
+    void fill_area(const Rect &area, const Color &color);
+    /*
+     *  Blends the color through a coverage mask covering `rect`, mask rows
+     *  are `stride` bytes apart. Returns the drawn part of `rect` clipped
+     *  to `clip`, without marking it.
+     * */
+    Rect blend_coverage(
+      const Rect &clip, const Rect &rect, const uint8_t *coverage, int stride,
+      const Color &color, BlendMode mode);
+
   private:
+    // draw_image for whole scale factors
+    void upscale_image(
+      const int x, const int y, const ImageView &image, const int factor_x,
+      const int factor_y, BlendMode mode);
+
+    // colors is null when all points have the same color
+    void scatter_points(
+      std::span<const Point> points, const Color *colors, const Color &color,
+      BlendMode mode);
+
+    // writes a single pixel without bounds checking
+    void blend_pixel(
+      const int x, const int y, const Color &color, BlendMode mode);
+
+    // spans are [x1; x2) and [y1; y2), clipped to `clip`
+    bool horizontal_span(
+      int x1, int x2, const int y, const Rect &clip, const Color &color,
+      BlendMode mode);
+    bool vertical_span(
+      const int x, int y1, int y2, const Rect &clip, const Color &color,
+      BlendMode mode);
+
+    // returns false if nothing was drawn
+    bool clipped_line(
+      const int x1, const int y1, const int code1, const int x2, const int y2,
+      const int code2, const Rect &clip, const Color &color, BlendMode mode);
+
     std::shared_ptr<Image> target;
+    std::vector<Rect> clip_stack;
+
+    // scratch buffers reused between calls to avoid allocations
+    std::vector<uint32_t> row_buffer;
+    std::vector<uint32_t> source_rows; // expanded rows of compact images
+    std::vector<int32_t> column_offsets;
+    std::vector<int32_t> next_column_offsets;
+    std::vector<int32_t> point_offsets;
+    std::vector<uint32_t> point_indices;
+    std::vector<uint16_t> column_weights;
+    std::vector<int> circle_extents;
+    std::vector<ScanEdge> edges;
+    std::vector<ScanEdge> active_edges;
+    PathRasterizer path_rasterizer;
+    std::vector<glm::vec2> path_points;
+    std::vector<Path::Contour> path_contours;
   };
 
 } // namespace ZD
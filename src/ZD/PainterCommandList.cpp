@@ -0,0 +1,416 @@
+#include "PainterCommandList.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#pragma GCC optimize("O3")
+
+namespace ZD
+{
+  PainterCommandList::PainterCommandList(const Size &target_size)
+  : target_rect { 0, 0, target_size.width(), target_size.height() }
+  , clips { target_rect }
+  {
+  }
+
+  Rect PainterCommandList::get_clip() const
+  {
+    if (clip_stack.empty())
+      return target_rect;
+
+    return target_rect.intersected(clip_stack.back());
+  }
+
+  void PainterCommandList::push_clip(const Rect &rect)
+  {
+    if (clip_stack.empty())
+    {
+      clip_stack.push_back(rect);
+    }
+    else
+    {
+      clip_stack.push_back(clip_stack.back().intersected(rect));
+    }
+    current_clip = add_clip();
+  }
+
+  void PainterCommandList::pop_clip()
+  {
+    if (!clip_stack.empty())
+      clip_stack.pop_back();
+    current_clip = add_clip();
+  }
+
+  uint32_t PainterCommandList::add_clip()
+  {
+    const Rect clip = get_clip();
+    if (clip == target_rect)
+      return 0;
+    if (clip == clips.back())
+      return clips.size() - 1;
+
+    clips.push_back(clip);
+    return clips.size() - 1;
+  }
+
+  void PainterCommandList::reset()
+  {
+    commands.clear();
+    clip_stack.clear();
+    clips.resize(1);
+    images.clear();
+    current_clip = 0;
+    binned = false;
+  }
+
+  bool PainterCommandList::add(Command command, const Rect &rect)
+  {
+    const Rect bounds = rect.intersected(clips[current_clip]);
+    if (bounds.is_empty())
+      return false;
+
+    // fills are stored clipped, so they don't need their clip at replay
+    command.clip = current_clip;
+    if (command.type == Type::Fill)
+    {
+      command.clip = 0;
+      command.x1 = bounds.left();
+      command.y1 = bounds.top();
+      command.x2 = bounds.right() - 1;
+      command.y2 = bounds.bottom() - 1;
+    }
+
+    commands.push_back(command);
+    binned = false;
+    return true;
+  }
+
+  void PainterCommandList::draw_image(
+    const int x, const int y, const ImageView &image, BlendMode mode)
+  {
+    const Rect rect(x, y, image.width(), image.height());
+    Command c {};
+    c.type = Type::Image;
+    c.mode = (uint8_t)(mode);
+    c.x1 = x;
+    c.y1 = y;
+    c.x2 = rect.right() - 1;
+    c.y2 = rect.bottom() - 1;
+    c.image = images.size();
+    if (add(c, rect))
+      images.push_back({ image, 1.0, 1.0, ScaleFilter::Nearest });
+  }
+
+  void PainterCommandList::draw_image(
+    const int x, const int y, const ImageView &image, double scale_x,
+    double scale_y, BlendMode mode, ScaleFilter filter)
+  {
+    if (scale_x == 1.0 && scale_y == 1.0)
+      return draw_image(x, y, image, mode);
+
+    // same size as in Painter::draw_image
+    const int width = image.width() * std::abs(scale_x);
+    const int height = image.height() * std::abs(scale_y);
+
+    const Rect rect(x, y, width, height);
+    Command c {};
+    c.type = Type::ScaledImage;
+    c.mode = (uint8_t)(mode);
+    c.x1 = x;
+    c.y1 = y;
+    c.x2 = rect.right() - 1;
+    c.y2 = rect.bottom() - 1;
+    c.image = images.size();
+    if (add(c, rect))
+      images.push_back({ image, scale_x, scale_y, filter });
+  }
+
+  void PainterCommandList::draw_image(
+    const int x, const int y, const ImageView &image, const int width,
+    const int height, AspectRatioOptions aspect_ratio_options,
+    BlendMode mode, ScaleFilter filter)
+  {
+    const double scale_x = (double)(width) / (double)(image.width());
+    const double scale_y = (double)(height) / (double)(image.height());
+
+    if (aspect_ratio_options == PreserveAspectRatio)
+    {
+      const double scale = scale_y < scale_x ? scale_y : scale_x;
+      return draw_image(x, y, image, scale, scale, mode, filter);
+    }
+
+    return draw_image(x, y, image, scale_x, scale_y, mode, filter);
+  }
+
+  void PainterCommandList::draw_line(
+    const int x1, const int y1, const int x2, const int y2, const Color &color,
+    BlendMode mode)
+  {
+    Command c {};
+    c.type = Type::Line;
+    c.mode = (uint8_t)(mode);
+    c.color = color.value();
+    c.x1 = x1;
+    c.y1 = y1;
+    c.x2 = x2;
+    c.y2 = y2;
+    add(c, Rect::from_corners(x1, y1, x2, y2));
+  }
+
+  void PainterCommandList::fill_rectangle(
+    const int x1, const int y1, const int x2, const int y2, const Color &color,
+    BlendMode mode)
+  {
+    Command c {};
+    c.type = Type::Fill;
+    c.mode = (uint8_t)(mode);
+    c.color = color.value();
+    add(c, Rect::from_corners(x1, y1, x2, y2));
+  }
+
+  void PainterCommandList::clear_rectangle(int x1, int y1, int x2, int y2)
+  {
+    if (x2 < x1)
+      std::swap(x1, x2);
+    if (y2 < y1)
+      std::swap(y2, y1);
+
+    Command c {};
+    c.type = Type::Fill;
+    c.mode = (uint8_t)(BlendMode::Replace);
+    c.color = 0;
+    add(c, Rect(x1, y1, x2 - x1, y2 - y1));
+  }
+
+  void PainterCommandList::fill(const Color &c)
+  {
+    fill_rectangle(
+      0, 0, target_rect.right() - 1, target_rect.bottom() - 1, c,
+      BlendMode::Replace);
+  }
+
+  void PainterCommandList::optimize()
+  {
+    remove_hidden();
+    merge_fills();
+    bin();
+  }
+
+  /*
+   *  Commands are walked from the last one, remembering the largest opaque
+   *  fills seen so far. Everything drawn inside one of them is overwritten.
+   * */
+  void PainterCommandList::remove_hidden()
+  {
+    occluders.clear();
+
+    auto hidden = [this](const Rect &bounds) {
+      for (const auto &occluder : occluders)
+      {
+        if (occluder.contains(bounds))
+          return true;
+      }
+      return false;
+    };
+
+    size_t kept = commands.size();
+    for (size_t i = commands.size(); i-- > 0;)
+    {
+      const Command c = commands[i];
+      const Rect bounds = get_bounds(c);
+      if (hidden(bounds))
+        continue;
+
+      commands[--kept] = c;
+
+      if (c.type != Type::Fill || c.mode != (uint8_t)(BlendMode::Replace))
+        continue;
+
+      if (occluders.size() < MAX_OCCLUDERS)
+      {
+        occluders.push_back(bounds);
+        continue;
+      }
+
+      auto smallest = std::min_element(
+        occluders.begin(), occluders.end(), [](const Rect &a, const Rect &b) {
+          return a.area() < b.area();
+        });
+      if (smallest->area() < bounds.area())
+        *smallest = bounds;
+    }
+
+    commands.erase(commands.begin(), commands.begin() + kept);
+  }
+
+  // fills of the same color one after another are joined when their union
+  // is a rectangle
+  void PainterCommandList::merge_fills()
+  {
+    auto mergeable = [](const Rect &a, const Rect &b) {
+      if (a.contains(b) || b.contains(a))
+        return true;
+      if (a.left() == b.left() && a.right() == b.right())
+        return a.bottom() >= b.top() && b.bottom() >= a.top();
+      if (a.top() == b.top() && a.bottom() == b.bottom())
+        return a.right() >= b.left() && b.right() >= a.left();
+      return false;
+    };
+
+    size_t kept = 0;
+    for (size_t i = 0; i < commands.size(); ++i)
+    {
+      const Command c = commands[i];
+      if (kept > 0)
+      {
+        Command &last = commands[kept - 1];
+        const uint8_t replace = (uint8_t)(BlendMode::Replace);
+        if (
+          c.type == Type::Fill && last.type == Type::Fill &&
+          c.mode == replace && last.mode == replace && c.color == last.color &&
+          mergeable(get_bounds(last), get_bounds(c)))
+        {
+          const Rect united = get_bounds(last).united(get_bounds(c));
+          last.x1 = united.left();
+          last.y1 = united.top();
+          last.x2 = united.right() - 1;
+          last.y2 = united.bottom() - 1;
+          continue;
+        }
+      }
+      commands[kept++] = c;
+    }
+    commands.resize(kept);
+  }
+
+  // counting sort of the commands into the tiles they touch
+  void PainterCommandList::bin()
+  {
+    tiles_x = (target_rect.width() + TILE_SIZE - 1) / TILE_SIZE;
+    tiles_y = (target_rect.height() + TILE_SIZE - 1) / TILE_SIZE;
+
+    bin_offsets.assign((size_t)tiles_x * tiles_y + 1, 0);
+
+    auto for_each_tile = [this](const Rect &bounds, auto func) {
+      const int tx2 = (bounds.right() - 1) / TILE_SIZE;
+      const int ty2 = (bounds.bottom() - 1) / TILE_SIZE;
+      for (int ty = bounds.top() / TILE_SIZE; ty <= ty2; ++ty)
+      {
+        for (int tx = bounds.left() / TILE_SIZE; tx <= tx2; ++tx)
+        {
+          func(ty * tiles_x + tx);
+        }
+      }
+    };
+
+    for (const auto &c : commands)
+    {
+      for_each_tile(
+        get_bounds(c), [this](int tile) { bin_offsets[tile + 1]++; });
+    }
+    for (size_t i = 1; i < bin_offsets.size(); ++i)
+    {
+      bin_offsets[i] += bin_offsets[i - 1];
+    }
+
+    bin_commands.resize(bin_offsets.back());
+    std::vector<uint32_t> next(bin_offsets.begin(), bin_offsets.end() - 1);
+    for (size_t i = 0; i < commands.size(); ++i)
+    {
+      for_each_tile(get_bounds(commands[i]), [&](int tile) {
+        bin_commands[next[tile]++] = i;
+      });
+    }
+
+    binned = true;
+  }
+
+  void PainterCommandList::run(const Command &c, Painter &painter) const
+  {
+    const BlendMode mode = (BlendMode)(c.mode);
+    if (c.type == Type::Fill)
+    {
+      // already clipped
+      painter.fill_rectangle(c.x1, c.y1, c.x2, c.y2, Color(c.color), mode);
+      return;
+    }
+
+    if (c.clip != 0)
+      painter.push_clip(clips[c.clip]);
+
+    switch (c.type)
+    {
+      case Type::Image:
+        painter.draw_image(c.x1, c.y1, images[c.image].image, mode);
+        break;
+      case Type::ScaledImage:
+      {
+        const ImageDraw &draw = images[c.image];
+        painter.draw_image(
+          c.x1, c.y1, draw.image, draw.scale_x, draw.scale_y, mode,
+          draw.filter);
+        break;
+      }
+      case Type::Line:
+        painter.draw_line(c.x1, c.y1, c.x2, c.y2, Color(c.color), mode);
+        break;
+      case Type::Fill: break;
+    }
+
+    if (c.clip != 0)
+      painter.pop_clip();
+  }
+
+  void PainterCommandList::replay(Painter &painter) const
+  {
+    for (const auto &c : commands)
+    {
+      run(c, painter);
+    }
+  }
+
+  void PainterCommandList::replay(Painter &painter, const Rect &area) const
+  {
+    const Rect visible = area.intersected(target_rect);
+    if (visible.is_empty())
+      return;
+
+    if (!binned)
+    {
+      painter.push_clip(visible);
+      for (const auto &c : commands)
+      {
+        if (get_bounds(c).intersects(visible))
+          run(c, painter);
+      }
+      painter.pop_clip();
+      return;
+    }
+
+    // every tile is drawn completely before the next one, the order of
+    // commands touching a pixel doesn't change
+    const int tx2 = (visible.right() - 1) / TILE_SIZE;
+    const int ty2 = (visible.bottom() - 1) / TILE_SIZE;
+    for (int ty = visible.top() / TILE_SIZE; ty <= ty2; ++ty)
+    {
+      for (int tx = visible.left() / TILE_SIZE; tx <= tx2; ++tx)
+      {
+        const int tile = ty * tiles_x + tx;
+        const uint32_t first = bin_offsets[tile];
+        const uint32_t end = bin_offsets[tile + 1];
+        if (first == end)
+          continue;
+
+        const Rect tile_rect(
+          tx * TILE_SIZE, ty * TILE_SIZE, TILE_SIZE, TILE_SIZE);
+        painter.push_clip(tile_rect.intersected(visible));
+        for (uint32_t i = first; i < end; ++i)
+        {
+          run(commands[bin_commands[i]], painter);
+        }
+        painter.pop_clip();
+      }
+    }
+  }
+
+} // namespace ZD
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "Color.hpp"
+#include "ImageView.hpp"
+#include "Painter.hpp"
+#include "Rect.hpp"
+#include "Size.hpp"
+
+namespace ZD
+{
+  /*
+   *  Drawing calls recorded for a later replay onto a Painter.
+   *  Calls mirror the Painter ones and give the same pixels when replayed.
+   *  A list can be recorded on one thread (e.g. by the game logic) and
+   *  replayed on another. Images are only referenced (through views), they
+   *  have to stay alive until the list is reset.
+   *
+   *  optimize() removes draws hidden by later opaque fills, merges
+   *  neighbouring fills of the same color and sorts the commands into
+   *  screen tiles. Commands are small fixed size records in a flat array,
+   *  so replaying a list that doesn't change (e.g. UI) is just a walk over
+   *  it, replaying a part of it only visits the tiles under that part.
+   * */
+  class PainterCommandList
+  {
+  public:
+    // size of the target the list will be replayed on
+    PainterCommandList(const Size &target_size);
+
+    void draw_image(
+      const int x, const int y, const ImageView &image,
+      BlendMode mode = BlendMode::ColorKey);
+    void draw_image(
+      const int x, const int y, const ImageView &image, double scale_x,
+      double scale_y, BlendMode mode = BlendMode::ColorKey,
+      ScaleFilter filter = ScaleFilter::Nearest);
+    void draw_image(
+      const int x, const int y, const ImageView &image, const int width,
+      const int height,
+      AspectRatioOptions aspect_ratio_options = NoPreserveAspectRatio,
+      BlendMode mode = BlendMode::ColorKey,
+      ScaleFilter filter = ScaleFilter::Nearest);
+    void draw_line(
+      const int x1, const int y1, const int x2, const int y2,
+      const Color &color, BlendMode mode = BlendMode::Replace);
+    void fill_rectangle(
+      const int x1, const int y1, const int x2, const int y2,
+      const Color &color, BlendMode mode = BlendMode::Replace);
+    void clear_rectangle(int x1, int y1, int x2, int y2);
+    void clear(const Color &c = Color(0)) { fill(c); }
+    // fills the clip (as Painter::fill)
+    void fill(const Color &c);
+
+    void push_clip(const Rect &rect);
+    void pop_clip();
+
+    // removes all commands and clips
+    void reset();
+
+    size_t size() const { return commands.size(); }
+    bool is_empty() const { return commands.empty(); }
+
+    // see the class description, recording after it is still possible
+    void optimize();
+
+    // replays the commands limited by the painter's clip
+    void replay(Painter &painter) const;
+    /*
+     *  Replays only the commands touching the area, clipped to it.
+     *  Painters drawing disjoint areas of the same target can replay
+     *  a list on separate threads.
+     *  Tiles are drawn one after another, so big areas are faster
+     *  replayed whole.
+     * */
+    void replay(Painter &painter, const Rect &area) const;
+
+  private:
+    static constexpr int TILE_SIZE = 256;
+    // hidden draws are looked for below this many fills
+    static constexpr size_t MAX_OCCLUDERS = 8;
+
+    enum class Type : uint8_t
+    {
+      Fill,
+      Image,
+      ScaledImage,
+      Line
+    };
+
+    /*
+     *  Fixed size record, fields which don't fit (images, scales, clips)
+     *  are kept once per list and referenced by index.
+     * */
+    struct Command
+    {
+      Type type;
+      uint8_t mode; // BlendMode
+      uint16_t unused;
+      uint32_t color;
+      // corners (inclusive) of fills and image destinations, line end points
+      int32_t x1, y1, x2, y2;
+      uint32_t clip; // index into clips, 0 is the whole target
+      uint32_t image; // index into images
+    };
+    static_assert(std::is_trivially_copyable_v<Command>);
+    static_assert(sizeof(Command) == 32);
+
+    struct ImageDraw
+    {
+      ImageView image;
+      double scale_x;
+      double scale_y;
+      ScaleFilter filter;
+    };
+
+    Rect get_clip() const;
+    // index of the current clip in clips
+    uint32_t add_clip();
+    // pixels which can change, clipped
+    Rect get_bounds(const Command &command) const
+    {
+      return Rect::from_corners(command.x1, command.y1, command.x2, command.y2)
+        .intersected(clips[command.clip]);
+    }
+    /*
+     *  `rect` are the unclipped pixels the command can change, returns
+     *  false when none of them are visible and nothing is recorded.
+     * */
+    bool add(Command command, const Rect &rect);
+    void run(const Command &command, Painter &painter) const;
+
+    void remove_hidden();
+    void merge_fills();
+    void bin();
+
+    Rect target_rect;
+    std::vector<Rect> clip_stack;
+    std::vector<Command> commands;
+    std::vector<Rect> clips;
+    std::vector<ImageDraw> images;
+    uint32_t current_clip { 0 };
+
+    // commands of tile i are bin_commands[bin_offsets[i]; bin_offsets[i + 1])
+    int tiles_x { 0 };
+    int tiles_y { 0 };
+    bool binned { false };
+    std::vector<uint32_t> bin_offsets;
+    std::vector<uint32_t> bin_commands;
+
+    std::vector<Rect> occluders;
+  };
+
+} // namespace ZD
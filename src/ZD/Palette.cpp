@@ -0,0 +1,39 @@
+#include "Palette.hpp"
+
+#include <algorithm>
+
+namespace ZD
+{
+  std::shared_ptr<Palette> Palette::create()
+  {
+    std::shared_ptr<Palette> palette = std::shared_ptr<Palette>(new Palette());
+    for (size_t i = 0; i < SIZE; i++)
+    {
+      palette->colors[i] = Color(i, i, i).value();
+    }
+    return palette;
+  }
+
+  std::shared_ptr<Palette> Palette::create(std::span<const Color> colors)
+  {
+    std::shared_ptr<Palette> palette = std::shared_ptr<Palette>(new Palette());
+    const size_t count = std::min(colors.size(), SIZE);
+    for (size_t i = 0; i < count; i++)
+    {
+      palette->colors[i] = colors[i].value();
+    }
+    return palette;
+  }
+
+  void Palette::cycle(uint8_t first, size_t count, int steps)
+  {
+    count = std::min(count, SIZE - first);
+    if (count < 2)
+      return;
+
+    const long shift = ((steps % (long)count) + count) % count;
+    auto begin = colors.begin() + first;
+    std::rotate(begin, begin + (count - shift), begin + count);
+  }
+
+} // namespace ZD
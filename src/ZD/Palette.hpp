@@ -0,0 +1,50 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <span>
+
+#include "Color.hpp"
+
+namespace ZD
+{
+  /*
+   *  256 colors of indexed images (see Image::create with
+   *  PixelFormat::Indexed). Images only keep a pointer to their palette,
+   *  so changing, cycling or swapping palettes doesn't touch any pixels.
+   *  Images drawn directly to a Texture have to be marked as changed
+   *  after their palette changes.
+   * */
+  class Palette
+  {
+  public:
+    static constexpr size_t SIZE = 256;
+
+    // grayscale ramp, index i is Color(i, i, i)
+    static std::shared_ptr<Palette> create();
+    // missing colors are transparent black
+    static std::shared_ptr<Palette> create(std::span<const Color> colors);
+
+    Color get_color(uint8_t index) const { return colors[index]; }
+    void set_color(uint8_t index, const Color &color)
+    {
+      colors[index] = color.value();
+    }
+
+    /*
+     *  Rotates `count` colors starting at `first` by `steps` positions
+     *  (color at `first` moves to `first + steps`), the usual palette
+     *  cycling effect. Negative steps rotate the other way.
+     * */
+    void cycle(uint8_t first, size_t count, int steps = 1);
+
+    const uint32_t *get_data() const { return colors.data(); }
+
+  private:
+    Palette() = default;
+
+    std::array<uint32_t, SIZE> colors {};
+  };
+
+} // namespace ZD
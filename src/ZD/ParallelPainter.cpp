@@ -0,0 +1,562 @@
+#include "ParallelPainter.hpp"
+
+#include <algorithm>
+
+#pragma GCC optimize("O3")
+
+namespace ZD
+{
+  /*
+   *  Painter clipped to a single band. Changed rectangles are only collected
+   *  here, the image is updated by ParallelPainter::finish on the calling
+   *  thread.
+   * */
+  class ParallelPainter::BandPainter : public Painter
+  {
+  public:
+    BandPainter(std::shared_ptr<Image> image, const Rect &band)
+    : Painter(image)
+    {
+      Painter::push_clip(band);
+    }
+
+    void apply_changes(Image &image)
+    {
+      for (const auto &rect : changed_rects)
+      {
+        image.mark_changed(rect);
+      }
+      changed_rects.clear();
+    }
+
+  protected:
+    void mark_changed(const Rect &rect)
+    {
+      if (!rect.is_empty())
+        changed_rects.push_back(rect);
+    }
+
+  private:
+    std::vector<Rect> changed_rects;
+  };
+
+  ParallelPainter::ParallelPainter(
+    std::shared_ptr<Image> image, unsigned int thread_count)
+  : Painter(image)
+  {
+    if (thread_count == 0)
+      thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+    const int width = image->width();
+    const int height = image->height();
+    thread_count = std::clamp<int>(thread_count, 1, std::max(height, 1));
+
+    for (unsigned int i = 0; i < thread_count; ++i)
+    {
+      const int top = (long)height * i / thread_count;
+      const int bottom = (long)height * (i + 1) / thread_count;
+
+      auto worker = std::make_unique<Worker>();
+      worker->painter = std::make_unique<BandPainter>(
+        image, Rect(0, top, width, bottom - top));
+      workers.push_back(std::move(worker));
+    }
+
+    for (auto &worker : workers)
+    {
+      worker->thread =
+        std::thread(&ParallelPainter::work, this, std::ref(*worker));
+    }
+  }
+
+  ParallelPainter::~ParallelPainter()
+  {
+    finish();
+
+    {
+      std::scoped_lock<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    batches_ready.notify_all();
+
+    for (auto &worker : workers)
+    {
+      worker->thread.join();
+    }
+  }
+
+  void ParallelPainter::Batch::clear()
+  {
+    commands.clear();
+    points.clear();
+    colors.clear();
+    images.clear();
+    paths.clear();
+    fonts.clear();
+    text.clear();
+  }
+
+  void ParallelPainter::work(Worker &worker)
+  {
+    std::vector<const Batch *> taken;
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true)
+    {
+      batches_ready.wait(lock, [&]() {
+        return stopping || worker.next_batch < batches.size();
+      });
+
+      if (worker.next_batch >= batches.size())
+        return;
+
+      taken.clear();
+      for (size_t i = worker.next_batch; i < batches.size(); ++i)
+      {
+        taken.push_back(batches[i].get());
+      }
+      worker.next_batch = batches.size();
+
+      lock.unlock();
+      for (const auto *batch : taken)
+      {
+        for (const auto &command : batch->commands)
+        {
+          run(*batch, command, *worker.painter);
+        }
+      }
+      lock.lock();
+
+      worker.done_batches = worker.next_batch;
+      batches_done.notify_all();
+    }
+  }
+
+  void ParallelPainter::run(
+    const Batch &batch, const Command &c, BandPainter &p)
+  {
+    const auto &v = c.values;
+    const Color color = Color::from_value(c.color);
+    const BlendMode mode = (BlendMode)(c.mode);
+    const ScaleFilter filter = (ScaleFilter)(c.filter);
+    const std::span<const Point> points(batch.points.data() + c.first, c.count);
+
+    switch (c.type)
+    {
+      case Type::Points: p.plot_points(points, color, mode); break;
+      case Type::ColoredPoints:
+        p.plot_points(
+          points, std::span(batch.colors.data() + v[0], c.count), mode);
+        break;
+      case Type::Image:
+        p.draw_image(v[0], v[1], batch.images[c.first].image, mode);
+        break;
+      case Type::FlippedImage:
+        p.draw_image(
+          v[0], v[1], batch.images[c.first].image, (ImageFlip)(c.option),
+          mode);
+        break;
+      case Type::ImagePart:
+        p.draw_image(
+          v[0], v[1], batch.images[c.first].image,
+          Rect(v[2], v[3], v[4], v[5]), mode);
+        break;
+      case Type::ScaledImage:
+      {
+        const ImageDraw &draw = batch.images[c.first];
+        p.draw_image(
+          v[0], v[1], draw.image, draw.scale_x, draw.scale_y, mode, filter);
+        break;
+      }
+      case Type::SizedImage:
+        p.draw_image(
+          v[0], v[1], batch.images[c.first].image, v[2], v[3],
+          (AspectRatioOptions)(c.option), mode, filter);
+        break;
+      case Type::AffineImage:
+      {
+        const ImageDraw &draw = batch.images[c.first];
+        p.draw_image_affine(draw.image, draw.transform, mode, filter);
+        break;
+      }
+      case Type::Text:
+        p.draw_text(
+          v[0], v[1], *batch.fonts[v[2]],
+          std::string_view(batch.text).substr(c.first, c.count), color, mode);
+        break;
+      case Type::Line: p.draw_line(v[0], v[1], v[2], v[3], color, mode); break;
+      case Type::Polyline: p.draw_polyline(points, color, mode); break;
+      case Type::Rectangle:
+        p.draw_rectangle(v[0], v[1], v[2], v[3], color, mode);
+        break;
+      case Type::ClearRectangle:
+        p.clear_rectangle(v[0], v[1], v[2], v[3]);
+        break;
+      case Type::Circle: p.draw_circle(v[0], v[1], v[2], color, mode); break;
+      case Type::FillRectangle:
+        p.fill_rectangle(v[0], v[1], v[2], v[3], color, mode);
+        break;
+      case Type::FillCircle:
+        p.fill_circle(v[0], v[1], v[2], color, mode);
+        break;
+      case Type::Triangle:
+        p.fill_triangle(v[0], v[1], v[2], v[3], v[4], v[5], color, mode);
+        break;
+      case Type::Polygon: p.fill_polygon(points, color, mode); break;
+      case Type::Path:
+        p.fill_path(batch.paths[c.first], color, (FillRule)(c.option), mode);
+        break;
+      case Type::Clear: p.clear(color); break;
+      case Type::Fill: p.fill(color); break;
+      case Type::PushClip: p.push_clip(Rect(v[0], v[1], v[2], v[3])); break;
+      case Type::PopClip: p.pop_clip(); break;
+    }
+  }
+
+  ParallelPainter::Command &ParallelPainter::record(
+    Type type, const Color &color, BlendMode mode)
+  {
+    if (
+      recorded && (recorded->commands.size() >= SUBMIT_COMMANDS ||
+                   recorded->points.size() >= SUBMIT_POINTS))
+      submit();
+
+    if (!recorded)
+    {
+      if (free_batches.empty())
+      {
+        recorded = std::make_unique<Batch>();
+      }
+      else
+      {
+        recorded = std::move(free_batches.back());
+        free_batches.pop_back();
+      }
+    }
+
+    Command &c = recorded->commands.emplace_back();
+    c = Command {};
+    c.type = type;
+    c.mode = (uint8_t)(mode);
+    c.color = color.value();
+    return c;
+  }
+
+  uint32_t ParallelPainter::record_points(std::span<const Point> points)
+  {
+    const uint32_t first = recorded->points.size();
+    recorded->points.insert(
+      recorded->points.end(), points.begin(), points.end());
+    return first;
+  }
+
+  uint32_t ParallelPainter::record_image(const ImageView &image)
+  {
+    recorded->images.push_back({ image, 1.0, 1.0, glm::mat3(1.0f) });
+    return recorded->images.size() - 1;
+  }
+
+  void ParallelPainter::submit()
+  {
+    if (!recorded)
+      return;
+
+    {
+      std::scoped_lock<std::mutex> lock(mutex);
+      batches.push_back(std::move(recorded));
+    }
+    batches_ready.notify_all();
+  }
+
+  void ParallelPainter::finish()
+  {
+    submit();
+
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      batches_done.wait(lock, [this]() {
+        return std::all_of(workers.begin(), workers.end(), [this](auto &w) {
+          return w->done_batches == batches.size();
+        });
+      });
+
+      for (auto &batch : batches)
+      {
+        batch->clear();
+        free_batches.push_back(std::move(batch));
+      }
+      batches.clear();
+      for (auto &worker : workers)
+      {
+        worker->next_batch = 0;
+        worker->done_batches = 0;
+      }
+    }
+
+    for (auto &worker : workers)
+    {
+      worker->painter->apply_changes(*get_target());
+    }
+  }
+
+  void ParallelPainter::set_pixel(
+    int x, int y, const Color &color, BlendMode mode)
+  {
+    // joined with the previous pixels while they have the same color
+    if (recorded && !recorded->commands.empty())
+    {
+      Command &last = recorded->commands.back();
+      if (
+        last.type == Type::Points && last.mode == (uint8_t)(mode) &&
+        last.color == color.value() &&
+        recorded->points.size() < SUBMIT_POINTS)
+      {
+        recorded->points.push_back(Point(x, y));
+        last.count++;
+        return;
+      }
+    }
+
+    const Point point(x, y);
+    plot_points(std::span(&point, 1), color, mode);
+  }
+
+  void ParallelPainter::plot_points(
+    std::span<const Point> points, const Color &color, BlendMode mode)
+  {
+    Command &c = record(Type::Points, color, mode);
+    c.first = record_points(points);
+    c.count = points.size();
+  }
+
+  void ParallelPainter::plot_points(
+    std::span<const Point> points, std::span<const Color> colors,
+    BlendMode mode)
+  {
+    Command &c = record(Type::ColoredPoints, Color(0), mode);
+    c.first = record_points(points);
+    c.count = points.size();
+    c.values[0] = recorded->colors.size();
+    recorded->colors.insert(
+      recorded->colors.end(), colors.begin(), colors.begin() + points.size());
+  }
+
+  void ParallelPainter::draw_image(
+    int x, int y, const ImageView &image, BlendMode mode)
+  {
+    Command &c = record(Type::Image, Color(0), mode);
+    c.values[0] = x;
+    c.values[1] = y;
+    c.first = record_image(image);
+  }
+
+  void ParallelPainter::draw_image(
+    int x, int y, const ImageView &image, ImageFlip flip, BlendMode mode)
+  {
+    Command &c = record(Type::FlippedImage, Color(0), mode);
+    c.option = (uint8_t)(flip);
+    c.values[0] = x;
+    c.values[1] = y;
+    c.first = record_image(image);
+  }
+
+  void ParallelPainter::draw_image(
+    int x, int y, const ImageView &image, const Rect &source, BlendMode mode)
+  {
+    Command &c = record(Type::ImagePart, Color(0), mode);
+    c.values[0] = x;
+    c.values[1] = y;
+    c.values[2] = source.left();
+    c.values[3] = source.top();
+    c.values[4] = source.width();
+    c.values[5] = source.height();
+    c.first = record_image(image);
+  }
+
+  void ParallelPainter::draw_image(
+    int x, int y, const ImageView &image, double scale_x, double scale_y,
+    BlendMode mode, ScaleFilter filter)
+  {
+    Command &c = record(Type::ScaledImage, Color(0), mode);
+    c.filter = (uint8_t)(filter);
+    c.values[0] = x;
+    c.values[1] = y;
+    c.first = record_image(image);
+    recorded->images.back().scale_x = scale_x;
+    recorded->images.back().scale_y = scale_y;
+  }
+
+  void ParallelPainter::draw_image(
+    int x, int y, const ImageView &image, int width, int height,
+    AspectRatioOptions aspect_ratio_options, BlendMode mode,
+    ScaleFilter filter)
+  {
+    Command &c = record(Type::SizedImage, Color(0), mode);
+    c.option = (uint8_t)(aspect_ratio_options);
+    c.filter = (uint8_t)(filter);
+    c.values[0] = x;
+    c.values[1] = y;
+    c.values[2] = width;
+    c.values[3] = height;
+    c.first = record_image(image);
+  }
+
+  void ParallelPainter::draw_image_affine(
+    const ImageView &image, const glm::mat3 &transform, BlendMode mode,
+    ScaleFilter filter)
+  {
+    Command &c = record(Type::AffineImage, Color(0), mode);
+    c.filter = (uint8_t)(filter);
+    c.first = record_image(image);
+    recorded->images.back().transform = transform;
+  }
+
+  void ParallelPainter::draw_text(
+    int x, int y, const Font &font, std::string_view text, const Color &color,
+    BlendMode mode)
+  {
+    Command &c = record(Type::Text, color, mode);
+    c.values[0] = x;
+    c.values[1] = y;
+    c.values[2] = recorded->fonts.size();
+    c.first = recorded->text.size();
+    c.count = text.size();
+    recorded->fonts.push_back(&font);
+    recorded->text.append(text);
+  }
+
+  void ParallelPainter::draw_line(
+    int x1, int y1, int x2, int y2, const Color &color, BlendMode mode)
+  {
+    Command &c = record(Type::Line, color, mode);
+    c.values[0] = x1;
+    c.values[1] = y1;
+    c.values[2] = x2;
+    c.values[3] = y2;
+  }
+
+  void ParallelPainter::draw_polyline(
+    std::span<const Point> points, const Color &color, BlendMode mode)
+  {
+    Command &c = record(Type::Polyline, color, mode);
+    c.first = record_points(points);
+    c.count = points.size();
+  }
+
+  void ParallelPainter::draw_rectangle(
+    int x1, int y1, int x2, int y2, const Color &color, BlendMode mode)
+  {
+    Command &c = record(Type::Rectangle, color, mode);
+    c.values[0] = x1;
+    c.values[1] = y1;
+    c.values[2] = x2;
+    c.values[3] = y2;
+  }
+
+  void ParallelPainter::clear_rectangle(int x1, int y1, int x2, int y2)
+  {
+    Command &c = record(Type::ClearRectangle, Color(0), BlendMode::Replace);
+    c.values[0] = x1;
+    c.values[1] = y1;
+    c.values[2] = x2;
+    c.values[3] = y2;
+  }
+
+  void ParallelPainter::draw_circle(
+    int x, int y, int radius, const Color &color, BlendMode mode)
+  {
+    Command &c = record(Type::Circle, color, mode);
+    c.values[0] = x;
+    c.values[1] = y;
+    c.values[2] = radius;
+  }
+
+  void ParallelPainter::fill_rectangle(
+    int x1, int y1, int x2, int y2, const Color &color, BlendMode mode)
+  {
+    Command &c = record(Type::FillRectangle, color, mode);
+    c.values[0] = x1;
+    c.values[1] = y1;
+    c.values[2] = x2;
+    c.values[3] = y2;
+  }
+
+  void ParallelPainter::fill_circle(
+    int x, int y, int radius, const Color &color, BlendMode mode)
+  {
+    Command &c = record(Type::FillCircle, color, mode);
+    c.values[0] = x;
+    c.values[1] = y;
+    c.values[2] = radius;
+  }
+
+  void ParallelPainter::fill_triangle(
+    int x1, int y1, int x2, int y2, int x3, int y3, const Color &color,
+    BlendMode mode)
+  {
+    Command &c = record(Type::Triangle, color, mode);
+    c.values[0] = x1;
+    c.values[1] = y1;
+    c.values[2] = x2;
+    c.values[3] = y2;
+    c.values[4] = x3;
+    c.values[5] = y3;
+  }
+
+  void ParallelPainter::fill_polygon(
+    std::span<const Point> points, const Color &color, BlendMode mode)
+  {
+    Command &c = record(Type::Polygon, color, mode);
+    c.first = record_points(points);
+    c.count = points.size();
+  }
+
+  void ParallelPainter::fill_path(
+    const Path &path, const Color &color, FillRule rule, BlendMode mode)
+  {
+    Command &c = record(Type::Path, color, mode);
+    c.option = (uint8_t)(rule);
+    c.first = recorded->paths.size();
+    recorded->paths.push_back(path);
+  }
+
+  void ParallelPainter::stroke_path(
+    const Path &path, float width, const Color &color, BlendMode mode)
+  {
+    // outline is built once instead of in every band
+    fill_path(path.stroke(width), color, FillRule::NonZero, mode);
+  }
+
+  void ParallelPainter::clear(const Color &c)
+  {
+    record(Type::Clear, c, BlendMode::Replace);
+  }
+
+  void ParallelPainter::fill(const Color &c)
+  {
+    record(Type::Fill, c, BlendMode::Replace);
+  }
+
+  void ParallelPainter::push_clip(const Rect &rect)
+  {
+    Painter::push_clip(rect);
+    clip_depth++;
+    Command &c = record(Type::PushClip, Color(0), BlendMode::Replace);
+    c.values[0] = rect.left();
+    c.values[1] = rect.top();
+    c.values[2] = rect.width();
+    c.values[3] = rect.height();
+  }
+
+  void ParallelPainter::pop_clip()
+  {
+    // band painters can't lose the clip to their band
+    if (clip_depth == 0)
+      return;
+
+    Painter::pop_clip();
+    clip_depth--;
+    record(Type::PopClip, Color(0), BlendMode::Replace);
+  }
+
+} // namespace ZD
@@ -0,0 +1,220 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "Painter.hpp"
+
+namespace ZD
+{
+  /*
+   *  Painter splitting the target into horizontal bands, one per worker thread.
+   *  Drawing calls are recorded as fixed size commands in batches, and
+   *  every worker replays all of them in the same order, clipped to its
+   *  band, so the result is the same as with the sequential Painter.
+   *  Batches are reused, so recording doesn't allocate once they have grown.
+   *  Consecutive set_pixel calls of the same color are joined into a single
+   *  plot_points command, still plotting many pixels is cheaper through
+   *  plot_points directly.
+   *  Drawing is asynchronous. Paths, points, colors and text are copied, but
+   *  images and fonts are only referenced, so they have to stay alive and
+   *  unchanged until finish(). The target can't be read nor changed elsewhere
+   *  until then, nor replaced with set_target().
+   * */
+  class ParallelPainter : public Painter
+  {
+  public:
+    // thread_count 0 uses all hardware threads
+    ParallelPainter(
+      std::shared_ptr<Image> image, unsigned int thread_count = 0);
+    ~ParallelPainter();
+
+    ParallelPainter(const ParallelPainter &) = delete;
+    ParallelPainter &operator=(const ParallelPainter &) = delete;
+
+    // waits until all recorded drawing is done, call it at the end of a frame
+    void finish();
+
+    unsigned int get_thread_count() const { return workers.size(); }
+
+    void set_pixel(
+      int x, int y, const Color &color, BlendMode mode = BlendMode::Replace);
+    void plot_points(
+      std::span<const Point> points, const Color &color,
+      BlendMode mode = BlendMode::Replace);
+    void plot_points(
+      std::span<const Point> points, std::span<const Color> colors,
+      BlendMode mode = BlendMode::Replace);
+    void draw_image(
+      int x, int y, const ImageView &image,
+      BlendMode mode = BlendMode::ColorKey);
+    void draw_image(
+      int x, int y, const ImageView &image, ImageFlip flip,
+      BlendMode mode = BlendMode::ColorKey);
+    void draw_image(
+      int x, int y, const ImageView &image, const Rect &source,
+      BlendMode mode = BlendMode::ColorKey);
+    void draw_image(
+      int x, int y, const ImageView &image, double scale_x, double scale_y,
+      BlendMode mode = BlendMode::ColorKey,
+      ScaleFilter filter = ScaleFilter::Nearest);
+    void draw_image(
+      int x, int y, const ImageView &image, int width, int height,
+      AspectRatioOptions aspect_ratio_options = NoPreserveAspectRatio,
+      BlendMode mode = BlendMode::ColorKey,
+      ScaleFilter filter = ScaleFilter::Nearest);
+    void draw_image_affine(
+      const ImageView &image, const glm::mat3 &transform,
+      BlendMode mode = BlendMode::ColorKey,
+      ScaleFilter filter = ScaleFilter::Nearest);
+    void draw_text(
+      int x, int y, const Font &font, std::string_view text,
+      const Color &color, BlendMode mode = BlendMode::SrcOver);
+    void draw_line(
+      int x1, int y1, int x2, int y2, const Color &color,
+      BlendMode mode = BlendMode::Replace);
+    void draw_polyline(
+      std::span<const Point> points, const Color &color,
+      BlendMode mode = BlendMode::Replace);
+    void draw_rectangle(
+      int x1, int y1, int x2, int y2, const Color &color,
+      BlendMode mode = BlendMode::Replace);
+    void clear_rectangle(int x1, int y1, int x2, int y2);
+    void draw_circle(
+      int x, int y, int radius, const Color &color,
+      BlendMode mode = BlendMode::Replace);
+    void fill_rectangle(
+      int x1, int y1, int x2, int y2, const Color &color,
+      BlendMode mode = BlendMode::Replace);
+    void fill_circle(
+      int x, int y, int radius, const Color &color,
+      BlendMode mode = BlendMode::Replace);
+    void fill_triangle(
+      int x1, int y1, int x2, int y2, int x3, int y3, const Color &color,
+      BlendMode mode = BlendMode::Replace);
+    void fill_polygon(
+      std::span<const Point> points, const Color &color,
+      BlendMode mode = BlendMode::Replace);
+    void fill_path(
+      const Path &path, const Color &color,
+      FillRule rule = FillRule::NonZero, BlendMode mode = BlendMode::SrcOver);
+    void stroke_path(
+      const Path &path, float width, const Color &color,
+      BlendMode mode = BlendMode::SrcOver);
+    void clear(const Color &c = Color(0));
+    void fill(const Color &c);
+
+    void push_clip(const Rect &rect);
+    void pop_clip();
+
+  private:
+    class BandPainter;
+
+    // batches are handed to workers whole to keep locking rare
+    static constexpr size_t SUBMIT_COMMANDS = 32;
+    static constexpr size_t SUBMIT_POINTS = 4096;
+
+    enum class Type : uint8_t
+    {
+      Points,
+      ColoredPoints,
+      Image,
+      FlippedImage,
+      ImagePart,
+      ScaledImage,
+      SizedImage,
+      AffineImage,
+      Text,
+      Line,
+      Polyline,
+      Rectangle,
+      ClearRectangle,
+      Circle,
+      FillRectangle,
+      FillCircle,
+      Triangle,
+      Polygon,
+      Path,
+      Clear,
+      Fill,
+      PushClip,
+      PopClip
+    };
+
+    /*
+     *  Fixed size record of a drawing call, replayed by every band.
+     *  Coordinates are kept in `values`, points, images, paths and text
+     *  in tables of the batch, referenced by `first` and `count`.
+     * */
+    struct Command
+    {
+      Type type;
+      uint8_t mode; // BlendMode
+      uint8_t option; // ImageFlip, AspectRatioOptions or FillRule
+      uint8_t filter; // ScaleFilter
+      uint32_t color;
+      int32_t values[6];
+      uint32_t first;
+      uint32_t count;
+    };
+    static_assert(std::is_trivially_copyable_v<Command>);
+
+    struct ImageDraw
+    {
+      ImageView image;
+      double scale_x;
+      double scale_y;
+      glm::mat3 transform;
+    };
+
+    // commands handed to the workers at once, reused after finish()
+    struct Batch
+    {
+      std::vector<Command> commands;
+      std::vector<Point> points;
+      std::vector<Color> colors;
+      std::vector<ImageDraw> images;
+      std::vector<Path> paths;
+      std::vector<const Font *> fonts;
+      std::string text;
+
+      void clear();
+    };
+
+    struct Worker
+    {
+      std::unique_ptr<BandPainter> painter;
+      std::thread thread;
+      size_t next_batch { 0 }; // first batch not taken yet
+      size_t done_batches { 0 };
+    };
+
+    // appends a command to the recorded batch, submitting it when it is full
+    Command &record(Type type, const Color &color, BlendMode mode);
+    // index of the first point in the recorded batch
+    uint32_t record_points(std::span<const Point> points);
+    uint32_t record_image(const ImageView &image);
+    // moves the recorded batch to the workers
+    void submit();
+    void work(Worker &worker);
+    void run(const Batch &batch, const Command &command, BandPainter &painter);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::unique_ptr<Batch>> batches; // taken by the workers
+    std::vector<std::unique_ptr<Batch>> free_batches; // only on this thread
+    std::unique_ptr<Batch> recorded;
+    size_t clip_depth { 0 };
+
+    std::mutex mutex;
+    std::condition_variable batches_ready;
+    std::condition_variable batches_done;
+    bool stopping { false };
+  };
+
+} // namespace ZD
@@ -0,0 +1,482 @@
+#include "Path.hpp"
+#include "PixelKernels.hpp"
+#include "3rd/glm/common.hpp"
+#include "3rd/glm/geometric.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numbers>
+
+#pragma GCC optimize("O3")
+
+namespace ZD
+{
+  void Path::add_point(float x, float y)
+  {
+    if (points.empty())
+    {
+      min_point = max_point = glm::vec2(x, y);
+    }
+    else
+    {
+      min_point = glm::vec2(std::min(min_point.x, x), std::min(min_point.y, y));
+      max_point = glm::vec2(std::max(max_point.x, x), std::max(max_point.y, y));
+    }
+    points.emplace_back(x, y);
+  }
+
+  void Path::move_to(float x, float y)
+  {
+    verbs.push_back(Verb::Move);
+    add_point(x, y);
+  }
+
+  void Path::line_to(float x, float y)
+  {
+    verbs.push_back(Verb::Line);
+    add_point(x, y);
+  }
+
+  void Path::quad_to(float cx, float cy, float x, float y)
+  {
+    verbs.push_back(Verb::Quad);
+    add_point(cx, cy);
+    add_point(x, y);
+  }
+
+  void Path::cubic_to(
+    float c1x, float c1y, float c2x, float c2y, float x, float y)
+  {
+    verbs.push_back(Verb::Cubic);
+    add_point(c1x, c1y);
+    add_point(c2x, c2y);
+    add_point(x, y);
+  }
+
+  void Path::close() { verbs.push_back(Verb::Close); }
+
+  void Path::clear()
+  {
+    verbs.clear();
+    points.clear();
+  }
+
+  Rect Path::bounds() const
+  {
+    if (points.empty())
+      return Rect();
+
+    const int x1 = std::floor(min_point.x);
+    const int y1 = std::floor(min_point.y);
+    const int x2 = std::ceil(max_point.x);
+    const int y2 = std::ceil(max_point.y);
+    return Rect(x1, y1, x2 - x1, y2 - y1);
+  }
+
+  Path Path::scaled(float scale_x, float scale_y) const
+  {
+    Path path = *this;
+    for (auto &p : path.points)
+    {
+      p *= glm::vec2(scale_x, scale_y);
+    }
+
+    const glm::vec2 a = min_point * glm::vec2(scale_x, scale_y);
+    const glm::vec2 b = max_point * glm::vec2(scale_x, scale_y);
+    path.min_point = glm::min(a, b);
+    path.max_point = glm::max(a, b);
+    return path;
+  }
+
+  /*
+   *  Curves are split into n segments of equal parameter step. Distance
+   *  between the curve and its chords is bounded by the second differences
+   *  of the control points, which gives n for the requested tolerance.
+   * */
+  void Path::flatten(
+    float tolerance, std::vector<glm::vec2> &out_points,
+    std::vector<Contour> &contours) const
+  {
+    static constexpr int MAX_SEGMENTS = 256;
+
+    auto segments_for = [tolerance](float deviation) {
+      const float n = std::ceil(std::sqrt(deviation / tolerance));
+      return std::clamp((int)n, 1, MAX_SEGMENTS);
+    };
+
+    size_t contour_first = out_points.size();
+    bool has_contour = false;
+
+    auto finish_contour = [&](bool closed) {
+      if (!has_contour)
+        return;
+
+      const size_t count = out_points.size() - contour_first;
+      if (count >= 2)
+        contours.push_back({ contour_first, count, closed });
+      else
+        out_points.resize(contour_first);
+
+      has_contour = false;
+    };
+
+    auto begin_contour = [&](glm::vec2 p) {
+      finish_contour(false);
+      contour_first = out_points.size();
+      out_points.push_back(p);
+      has_contour = true;
+    };
+
+    glm::vec2 start { 0.0f, 0.0f };
+    glm::vec2 current { 0.0f, 0.0f };
+    size_t pi = 0;
+
+    for (const auto verb : verbs)
+    {
+      if (verb != Verb::Move && verb != Verb::Close && !has_contour)
+        begin_contour(current);
+
+      switch (verb)
+      {
+        case Verb::Move:
+          start = current = points[pi++];
+          begin_contour(current);
+          break;
+
+        case Verb::Line:
+          current = points[pi++];
+          out_points.push_back(current);
+          break;
+
+        case Verb::Quad:
+        {
+          const glm::vec2 p0 = current;
+          const glm::vec2 c = points[pi++];
+          const glm::vec2 p1 = points[pi++];
+
+          const glm::vec2 dd = p0 - 2.0f * c + p1;
+          const int n = segments_for(glm::length(dd) / 4.0f);
+          for (int i = 1; i <= n; ++i)
+          {
+            const float t = (float)i / n;
+            const float mt = 1.0f - t;
+            out_points.push_back(mt * mt * p0 + 2.0f * mt * t * c + t * t * p1);
+          }
+          current = p1;
+          break;
+        }
+
+        case Verb::Cubic:
+        {
+          const glm::vec2 p0 = current;
+          const glm::vec2 c1 = points[pi++];
+          const glm::vec2 c2 = points[pi++];
+          const glm::vec2 p1 = points[pi++];
+
+          const float dd = std::max(
+            glm::length(p0 - 2.0f * c1 + c2), glm::length(c1 - 2.0f * c2 + p1));
+          const int n = segments_for(dd * 0.75f);
+          for (int i = 1; i <= n; ++i)
+          {
+            const float t = (float)i / n;
+            const float mt = 1.0f - t;
+            out_points.push_back(
+              mt * mt * mt * p0 + 3.0f * mt * mt * t * c1 +
+              3.0f * mt * t * t * c2 + t * t * t * p1);
+          }
+          current = p1;
+          break;
+        }
+
+        case Verb::Close:
+          if (has_contour)
+          {
+            finish_contour(true);
+            current = start;
+          }
+          break;
+      }
+    }
+
+    finish_contour(false);
+  }
+
+  Path Path::stroke(float width, float tolerance) const
+  {
+    std::vector<glm::vec2> line_points;
+    std::vector<Contour> line_contours;
+    flatten(tolerance, line_points, line_contours);
+
+    Path path;
+    const float half_width = width * 0.5f;
+    if (half_width <= 0.0f)
+      return path;
+
+    // round joints are polygons close enough to the circle
+    const float ratio = std::max(1.0f - tolerance / half_width, -1.0f);
+    const float joint_step = std::acos(ratio);
+    const int joint_segments = std::clamp(
+      (int)std::ceil(std::numbers::pi_v<float> / joint_step), 8, 128);
+
+    // every piece has the same orientation, so non-zero rule gives union
+    auto add_joint = [&](glm::vec2 p) {
+      path.move_to(p.x + half_width, p.y);
+      for (int i = 1; i < joint_segments; ++i)
+      {
+        const float angle =
+          -2.0f * std::numbers::pi_v<float> * i / joint_segments;
+        path.line_to(
+          p.x + half_width * std::cos(angle),
+          p.y + half_width * std::sin(angle));
+      }
+      path.close();
+    };
+
+    auto add_segment = [&](glm::vec2 p0, glm::vec2 p1) {
+      const glm::vec2 d = p1 - p0;
+      const float length = glm::length(d);
+      if (length == 0.0f)
+        return;
+
+      const glm::vec2 n = glm::vec2(-d.y, d.x) * (half_width / length);
+      path.move_to(p0.x + n.x, p0.y + n.y);
+      path.line_to(p1.x + n.x, p1.y + n.y);
+      path.line_to(p1.x - n.x, p1.y - n.y);
+      path.line_to(p0.x - n.x, p0.y - n.y);
+      path.close();
+    };
+
+    for (const auto &contour : line_contours)
+    {
+      const glm::vec2 *p = line_points.data() + contour.first;
+      const size_t segments =
+        contour.closed ? contour.count : contour.count - 1;
+
+      for (size_t i = 0; i < segments; ++i)
+      {
+        add_segment(p[i], p[(i + 1) % contour.count]);
+      }
+
+      for (size_t i = 0; i < contour.count; ++i)
+      {
+        if (contour.closed || (i != 0 && i != contour.count - 1))
+          add_joint(p[i]);
+      }
+    }
+
+    return path;
+  }
+
+  void PathRasterizer::reset(int new_width, int new_height, int new_visible_top)
+  {
+    width = std::max(new_width, 0);
+    height = std::max(new_height, 0);
+    visible_top = new_visible_top;
+    stride = width + 2;
+    row_first = height;
+    row_end = 0;
+    segments.clear();
+
+    const size_t size = (size_t)stride * STRIP_HEIGHT;
+    if (accumulation.size() < size)
+      accumulation.resize(size, 0.0f);
+    coverage.resize(width);
+  }
+
+  /*
+   *  Parts of the line left of the area still change the winding of every
+   *  pixel right of them, so they are moved onto its left edge. Parts right
+   *  of the area are moved onto its right edge, where they only close rows.
+   * */
+  void PathRasterizer::add_line(glm::vec2 p0, glm::vec2 p1)
+  {
+    if (p0.y == p1.y)
+      return;
+
+    const float top = std::min(p0.y, p1.y);
+    const float bottom = std::max(p0.y, p1.y);
+    if (bottom <= 0.0f || top >= height)
+      return;
+
+    row_first = std::min(row_first, std::max((int)top, 0));
+    row_end = std::max(row_end, std::min((int)std::ceil(bottom), height));
+
+    const float edges[2] = { 0.0f, (float)width };
+    glm::vec2 pieces[4] = { p0 };
+    int count = 1;
+
+    // split points ordered from p0 to p1
+    float ts[2];
+    int splits = 0;
+    for (const float edge : edges)
+    {
+      if ((p0.x < edge) != (p1.x < edge) && p0.x != p1.x)
+        ts[splits++] = (edge - p0.x) / (p1.x - p0.x);
+    }
+    if (splits == 2 && ts[1] < ts[0])
+      std::swap(ts[0], ts[1]);
+
+    for (int i = 0; i < splits; ++i)
+    {
+      pieces[count++] = p0 + (p1 - p0) * ts[i];
+    }
+    pieces[count++] = p1;
+
+    for (int i = 0; i + 1 < count; ++i)
+    {
+      glm::vec2 a = pieces[i];
+      glm::vec2 b = pieces[i + 1];
+      if (a.y == b.y)
+        continue;
+
+      const float mid = 0.5f * (a.x + b.x);
+      if (mid <= 0.0f)
+        a.x = b.x = 0.0f;
+      else if (mid >= edges[1])
+        a.x = b.x = edges[1];
+
+      segments.push_back({ a, b, std::min(a.y, b.y), std::max(a.y, b.y) });
+    }
+  }
+
+  void PathRasterizer::begin_strips()
+  {
+    std::sort(
+      segments.begin(), segments.end(), [](const auto &a, const auto &b) {
+        return a.top < b.top;
+      });
+    active_segments.clear();
+    next_segment = 0;
+  }
+
+  int PathRasterizer::first_strip() const
+  {
+    if (visible_top <= row_first)
+      return row_first;
+    return row_first + (visible_top - row_first) / STRIP_HEIGHT * STRIP_HEIGHT;
+  }
+
+  int PathRasterizer::accumulate_strip(int top)
+  {
+    const int rows = std::min(STRIP_HEIGHT, height - top);
+    const float strip_top = top;
+    const float strip_bottom = top + rows;
+
+    std::erase_if(active_segments, [this, strip_top](size_t i) {
+      return segments[i].bottom <= strip_top;
+    });
+
+    for (; next_segment < segments.size() &&
+           segments[next_segment].top < strip_bottom;
+         ++next_segment)
+    {
+      if (segments[next_segment].bottom > strip_top)
+        active_segments.push_back(next_segment);
+    }
+
+    const glm::vec2 offset(0.0f, strip_top);
+    for (const size_t i : active_segments)
+    {
+      add_line_inside(segments[i].p0 - offset, segments[i].p1 - offset, rows);
+    }
+    return rows;
+  }
+
+  /*
+   *  Line is walked row by row. In every row the part of the line splits
+   *  the covered cells into trapezoids, their areas go to the cells and the
+   *  rest of the row height goes to the cell after the line.
+   * */
+  void PathRasterizer::add_line_inside(glm::vec2 p0, glm::vec2 p1, int rows)
+  {
+    float dir = 1.0f;
+    if (p1.y < p0.y)
+    {
+      std::swap(p0, p1);
+      dir = -1.0f;
+    }
+
+    if (p1.y <= 0.0f || p0.y >= rows)
+      return;
+
+    const float dxdy = (p1.x - p0.x) / (p1.y - p0.y);
+    const float y_top = std::max(p0.y, 0.0f);
+    const float y_bottom = std::min(p1.y, (float)rows);
+    float x = p0.x + (y_top - p0.y) * dxdy;
+
+    const int y_first = y_top;
+    const int y_end = std::ceil(y_bottom);
+    const float max_x = width;
+
+    for (int y = y_first; y < y_end; ++y)
+    {
+      float *row = accumulation.data() + (size_t)y * stride;
+
+      const float dy = std::min(y + 1.0f, y_bottom) - std::max((float)y, y_top);
+      const float x_next = x + dxdy * dy;
+      const float d = dy * dir;
+
+      // clamping only corrects rounding, lines are already split
+      float x0 = std::clamp(x, 0.0f, max_x);
+      float x1 = std::clamp(x_next, 0.0f, max_x);
+      if (x1 < x0)
+        std::swap(x0, x1);
+
+      const float x0_floor = std::floor(x0);
+      const int x0i = x0_floor;
+      const float x1_ceil = std::ceil(x1);
+      const int x1i = x1_ceil;
+
+      if (x1i <= x0i + 1)
+      {
+        const float xmf = 0.5f * (x0 + x1) - x0_floor;
+        row[x0i] += d - d * xmf;
+        row[x0i + 1] += d * xmf;
+      }
+      else
+      {
+        const float s = 1.0f / (x1 - x0);
+        const float x0f = x0 - x0_floor;
+        const float a0 = 0.5f * s * (1.0f - x0f) * (1.0f - x0f);
+        const float x1f = x1 - x1_ceil + 1.0f;
+        const float am = 0.5f * s * x1f * x1f;
+
+        row[x0i] += d * a0;
+        if (x1i == x0i + 2)
+        {
+          row[x0i + 1] += d * (1.0f - a0 - am);
+        }
+        else
+        {
+          const float a1 = s * (1.5f - x0f);
+          row[x0i + 1] += d * (a1 - a0);
+
+          const float ds = d * s;
+          for (int xi = x0i + 2; xi < x1i - 1; ++xi)
+          {
+            row[xi] += ds;
+          }
+
+          const float a2 = a1 + (x1i - x0i - 3) * s;
+          row[x1i - 1] += d * (1.0f - a2 - am);
+        }
+        row[x1i] += d * am;
+      }
+
+      x = x_next;
+    }
+  }
+
+  void PathRasterizer::resolve_row(int row, FillRule rule)
+  {
+    float *cells = accumulation.data() + (size_t)row * stride;
+    Kernels::accumulate_coverage(
+      coverage.data(), cells, width, rule == FillRule::EvenOdd);
+
+    // cells after the last pixel only close the row
+    cells[width] = 0.0f;
+    cells[width + 1] = 0.0f;
+  }
+
+} // namespace ZD
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "3rd/glm/vec2.hpp"
+#include "Rect.hpp"
+
+namespace ZD
+{
+  enum class FillRule
+  {
+    NonZero,
+    EvenOdd
+  };
+
+  /*
+   *  Vector path made of contours of lines and quadratic/cubic Bezier curves.
+   *  Coordinates are in target pixels, (0, 0) is the top left corner
+   *  of the first pixel, so its center is at (0.5, 0.5).
+   * */
+  class Path
+  {
+  public:
+    struct Contour
+    {
+      size_t first; // index of the first point
+      size_t count;
+      bool closed;
+    };
+
+    Path() = default;
+
+    void move_to(float x, float y);
+    void line_to(float x, float y);
+    void quad_to(float cx, float cy, float x, float y);
+    void cubic_to(
+      float c1x, float c1y, float c2x, float c2y, float x, float y);
+    void close();
+    void clear();
+
+    bool is_empty() const { return verbs.empty(); }
+
+    // bounding box of all points (including control points)
+    Rect bounds() const;
+
+    // copy with every point multiplied by the scale
+    Path scaled(float scale_x, float scale_y) const;
+
+    /*
+     *  Approximates curves with lines no further than `tolerance` pixels
+     *  from them. Points of every contour are appended to `points`.
+     * */
+    void flatten(
+      float tolerance, std::vector<glm::vec2> &points,
+      std::vector<Contour> &contours) const;
+
+    /*
+     *  Outline of the path drawn with a line `width` pixels wide.
+     *  Segments are butt ended, joints are rounded. The outline
+     *  has to be filled with FillRule::NonZero.
+     * */
+    Path stroke(float width, float tolerance = 0.25f) const;
+
+  private:
+    enum class Verb : uint8_t
+    {
+      Move,
+      Line,
+      Quad,
+      Cubic,
+      Close
+    };
+
+    void add_point(float x, float y);
+
+    std::vector<Verb> verbs;
+    std::vector<glm::vec2> points;
+    glm::vec2 min_point { 0.0f, 0.0f };
+    glm::vec2 max_point { 0.0f, 0.0f };
+  };
+
+  /*
+   *  Anti-aliased scanline rasteriser based on signed area accumulation.
+   *  Every line adds the area it covers (signed by its direction) to the
+   *  cells it crosses and a change of winding to the cell right after it.
+   *  Prefix sum of a row gives the winding of every pixel scaled
+   *  by its coverage (see Kernels::accumulate_coverage).
+   *  Rows are accumulated in strips, so the accumulation buffer stays
+   *  in cache even for full screen paths.
+   * */
+  class PathRasterizer
+  {
+  public:
+    /*
+     *  Starts a new area, coordinates are relative to its top left corner.
+     *  Rows above visible_top are skipped. Unlike with a smaller area,
+     *  coverage of the visible rows stays exactly the same.
+     * */
+    void reset(int width, int height, int visible_top = 0);
+
+    void add_line(glm::vec2 p0, glm::vec2 p1);
+
+    // calls row_func(row, coverage) for every row touched by lines
+    template<typename RowFunc>
+    void resolve(FillRule rule, RowFunc row_func)
+    {
+      begin_strips();
+      for (int top = first_strip(); top < row_end; top += STRIP_HEIGHT)
+      {
+        const int rows = accumulate_strip(top);
+        for (int row = 0; row < rows; ++row)
+        {
+          resolve_row(row, rule);
+          if (top + row >= visible_top)
+            row_func(top + row, coverage.data());
+        }
+      }
+    }
+
+  private:
+    static constexpr int STRIP_HEIGHT = 16;
+
+    struct Segment
+    {
+      glm::vec2 p0;
+      glm::vec2 p1;
+      float top;
+      float bottom;
+    };
+
+    void begin_strips();
+    // strips are aligned to row_first, whatever the visible rows are
+    int first_strip() const;
+    // returns number of rows in the strip
+    int accumulate_strip(int top);
+    void resolve_row(int row, FillRule rule);
+    // line which is already split at the left and right edge of the area
+    void add_line_inside(glm::vec2 p0, glm::vec2 p1, int rows);
+
+    int width { 0 };
+    int height { 0 };
+    int stride { 0 };
+    int row_first { 0 };
+    int row_end { 0 };
+    int visible_top { 0 };
+
+    std::vector<Segment> segments;
+    std::vector<size_t> active_segments;
+    size_t next_segment { 0 };
+
+    // kept zeroed between strips, resolve_row clears what was accumulated
+    std::vector<float> accumulation;
+    std::vector<uint8_t> coverage;
+  };
+
+} // namespace ZD
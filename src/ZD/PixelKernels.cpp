@@ -0,0 +1,1602 @@
+#include "PixelKernels.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ZD_KERNELS_X86
+#endif
+
+#pragma GCC optimize("O3")
+
+namespace ZD
+{
+  namespace Kernels
+  {
+    static constexpr size_t BLEND_MODES_NUM =
+      (size_t)(BlendMode::PremultipliedSrcOver) + 1;
+
+    typedef void (*CopyRowFunc)(uint32_t *, const uint32_t *, size_t);
+    typedef void (*FillRowFunc)(uint32_t *, uint32_t, size_t);
+    typedef void (*GatherRowFunc)(
+      uint32_t *, const uint32_t *, const int32_t *, size_t);
+    typedef void (*BilinearRowFunc)(
+      uint32_t *, const uint32_t *, const uint32_t *, const int32_t *,
+      const int32_t *, const uint16_t *, uint32_t, size_t);
+    typedef void (*CoverageRowFunc)(uint8_t *, float *, size_t, bool);
+    typedef void (*ExpandRowFunc)(
+      uint32_t *, const uint8_t *, const uint32_t *, size_t);
+    typedef void (*GrayRowFunc)(uint32_t *, const uint8_t *, size_t);
+    typedef void (*UpscaleRowFunc)(uint32_t *, const uint32_t *, size_t, int);
+    typedef void (*UnpackRowFunc)(float *, const uint32_t *, size_t);
+    typedef void (*PackRowFunc)(uint32_t *, const float *, size_t);
+    typedef void (*ConvolveRowFunc)(
+      float *, const float *, size_t, const float *, size_t);
+    typedef void (*BoxRowFunc)(float *, const float *, size_t, size_t);
+    typedef size_t (*CullPointsFunc)(
+      int32_t *, uint32_t *, const Point *, size_t, const Rect &, int);
+    typedef void (*ScatterFillFunc)(
+      uint32_t *, const int32_t *, uint32_t, size_t);
+    typedef void (*ScatterRowFunc)(
+      uint32_t *, const int32_t *, const uint32_t *, size_t);
+
+    // exact round(v / 255) for v in [0; 255 * 255]
+    static inline uint32_t div255(uint32_t v)
+    {
+      return ((v + 128) * 257) >> 16;
+    }
+
+    /*
+     *  Pixels are stored as 0xBBGGRRAA, so alpha is the lowest byte.
+     *  Alpha channel always gets full source weight, e.g. for SrcOver
+     *  a_out = a_src + a_dst * (1 - a_src).
+     * */
+    template<BlendMode Mode, bool SrcAlpha>
+    static inline uint32_t blend_pixel(uint32_t d, uint32_t s)
+    {
+      if constexpr (Mode == BlendMode::Replace)
+        return s;
+
+      if constexpr (Mode == BlendMode::ColorKey)
+        return (s & 0xff) == 0 ? d : s;
+
+      if constexpr (!SrcAlpha)
+        s |= 0xff;
+
+      const uint32_t a = s & 0xff;
+      const uint32_t inv_a = 255 - a;
+
+      uint32_t out = 0;
+      for (int shift = 0; shift < 32; shift += 8)
+      {
+        const uint32_t dc = (d >> shift) & 0xff;
+        const uint32_t sc = (s >> shift) & 0xff;
+        const uint32_t sf = shift == 0 ? 255 : a;
+
+        uint32_t c = 0;
+        if constexpr (Mode == BlendMode::SrcOver)
+          c = div255(sc * sf + dc * inv_a);
+        else if constexpr (Mode == BlendMode::PremultipliedSrcOver)
+          c = sc + div255(dc * inv_a);
+        else if constexpr (Mode == BlendMode::Additive)
+          c = dc + div255(sc * sf);
+        else if constexpr (Mode == BlendMode::Multiply)
+          c = shift == 0 ? dc : div255(dc * div255(sc * a + 255 * inv_a));
+
+        out |= std::min(c, 255u) << shift;
+      }
+      return out;
+    }
+
+    static void copy_row(uint32_t *dest, const uint32_t *src, size_t length)
+    {
+      memcpy(dest, src, length * sizeof(uint32_t));
+    }
+
+    /*
+     *  Spans of at least this many bytes are filled with non-temporal stores.
+     *  They are larger than the L2 cache of most CPUs, so keeping them in
+     *  cache would only evict more useful data.
+     * */
+    static constexpr size_t NON_TEMPORAL_BYTES = 4 << 20;
+
+    static void fill_span_scalar(uint32_t *dest, uint32_t color, size_t length)
+    {
+      std::fill_n(dest, length, color);
+    }
+
+    static void fill_keyed_row(uint32_t *dest, uint32_t color, size_t length)
+    {
+      if ((color & 0xff) != 0)
+        fill_span(dest, color, length);
+    }
+
+    static void copy_keyed_row_scalar(
+      uint32_t *dest, const uint32_t *src, size_t length)
+    {
+      for (size_t i = 0; i < length; ++i)
+      {
+        if ((src[i] & 0xff) != 0)
+          dest[i] = src[i];
+      }
+    }
+
+    template<BlendMode Mode, bool SrcAlpha>
+    static void blend_row_scalar(
+      uint32_t *dest, const uint32_t *src, size_t length)
+    {
+      for (size_t i = 0; i < length; ++i)
+      {
+        dest[i] = blend_pixel<Mode, SrcAlpha>(dest[i], src[i]);
+      }
+    }
+
+    template<BlendMode Mode>
+    static void blend_fill_scalar(uint32_t *dest, uint32_t color, size_t length)
+    {
+      for (size_t i = 0; i < length; ++i)
+      {
+        dest[i] = blend_pixel<Mode, true>(dest[i], color);
+      }
+    }
+
+    static void gather_row_scalar(
+      uint32_t *dest, const uint32_t *src, const int32_t *offsets,
+      size_t length)
+    {
+      for (size_t i = 0; i < length; ++i)
+      {
+        dest[i] = src[offsets[i]];
+      }
+    }
+
+    static void expand_indexed_row_scalar(
+      uint32_t *dest, const uint8_t *src, const uint32_t *palette,
+      size_t length)
+    {
+      for (size_t i = 0; i < length; ++i)
+      {
+        dest[i] = palette[src[i]];
+      }
+    }
+
+    // gray levels, followed by alpha when Alpha is set
+    template<bool Alpha>
+    static void expand_gray_row_scalar(
+      uint32_t *dest, const uint8_t *src, size_t length)
+    {
+      constexpr size_t step = Alpha ? 2 : 1;
+      for (size_t i = 0; i < length; ++i)
+      {
+        const uint32_t g = src[step * i];
+        const uint32_t a = Alpha ? src[step * i + 1] : 0xff;
+        dest[i] = g << 24 | g << 16 | g << 8 | a;
+      }
+    }
+
+    static void upscale_row_scalar(
+      uint32_t *dest, const uint32_t *src, size_t length, int factor)
+    {
+      for (size_t i = 0; i < length; ++i, dest += factor)
+      {
+        std::fill_n(dest, factor, src[i]);
+      }
+    }
+
+    static inline uint32_t lerp_channels(uint32_t a, uint32_t b, uint32_t f)
+    {
+      uint32_t out = 0;
+      for (int shift = 0; shift < 32; shift += 8)
+      {
+        const uint32_t ca = (a >> shift) & 0xff;
+        const uint32_t cb = (b >> shift) & 0xff;
+        out |= ((ca * (256 - f) + cb * f) >> 8) << shift;
+      }
+      return out;
+    }
+
+    static void bilinear_row_scalar(
+      uint32_t *dest, const uint32_t *row0, const uint32_t *row1,
+      const int32_t *x0, const int32_t *x1, const uint16_t *fx, uint32_t fy,
+      size_t length)
+    {
+      for (size_t i = 0; i < length; ++i)
+      {
+        const uint32_t top = lerp_channels(row0[x0[i]], row0[x1[i]], fx[i]);
+        const uint32_t bottom = lerp_channels(row1[x0[i]], row1[x1[i]], fx[i]);
+        dest[i] = lerp_channels(top, bottom, fy);
+      }
+    }
+
+    static inline uint8_t coverage_value(float sum, bool even_odd)
+    {
+      float v = std::fabs(sum);
+      if (even_odd)
+      {
+        v -= 2.0f * std::floor(v * 0.5f);
+        v = std::min(v, 2.0f - v);
+      }
+      else
+      {
+        v = std::min(v, 1.0f);
+      }
+      return v * 255.0f + 0.5f;
+    }
+
+    static void accumulate_coverage_scalar(
+      uint8_t *coverage, float *accumulation, size_t length, bool even_odd)
+    {
+      float sum = 0.0f;
+      for (size_t i = 0; i < length; ++i)
+      {
+        sum += accumulation[i];
+        accumulation[i] = 0.0f;
+        coverage[i] = coverage_value(sum, even_odd);
+      }
+    }
+
+    static void unpack_row_scalar(
+      float *dest, const uint32_t *src, size_t length)
+    {
+      for (size_t i = 0; i < length; ++i, dest += 4)
+      {
+        for (int c = 0; c < 4; ++c)
+        {
+          dest[c] = (src[i] >> (8 * c)) & 0xff;
+        }
+      }
+    }
+
+    // rounds half to even, as SSE conversions do
+    static void pack_row_scalar(uint32_t *dest, const float *src, size_t length)
+    {
+      for (size_t i = 0; i < length; ++i, src += 4)
+      {
+        uint32_t v = 0;
+        for (int c = 0; c < 4; ++c)
+        {
+          const float value = std::clamp(src[c], 0.0f, 255.0f);
+          v |= (uint32_t)(std::nearbyint(value)) << (8 * c);
+        }
+        dest[i] = v;
+      }
+    }
+
+    static void convolve_row_scalar(
+      float *dest, const float *src, size_t length, const float *weights,
+      size_t taps)
+    {
+      for (size_t i = 0; i < length; ++i, dest += 4, src += 4)
+      {
+        float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        for (size_t k = 0; k < taps; ++k)
+        {
+          for (int c = 0; c < 4; ++c)
+          {
+            sum[c] = sum[c] + weights[k] * src[4 * k + c];
+          }
+        }
+        std::copy_n(sum, 4, dest);
+      }
+    }
+
+    static void box_row_scalar(
+      float *dest, const float *src, size_t length, size_t taps)
+    {
+      const float scale = 1.0f / taps;
+      float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+      for (size_t k = 0; k < taps; ++k)
+      {
+        for (int c = 0; c < 4; ++c)
+        {
+          sum[c] = sum[c] + src[4 * k + c];
+        }
+      }
+
+      for (size_t i = 0; i < length; ++i)
+      {
+        for (int c = 0; c < 4; ++c)
+        {
+          dest[4 * i + c] = sum[c] * scale;
+        }
+        if (i + 1 == length)
+          break;
+
+        for (int c = 0; c < 4; ++c)
+        {
+          sum[c] = sum[c] + src[4 * (i + taps) + c];
+          sum[c] = sum[c] - src[4 * i + c];
+        }
+      }
+    }
+
+    /*
+     *  Culls points [first; length), count is the number of points kept so
+     *  far. Arithmetic is unsigned, so points far away can't overflow.
+     *  Every point is written, only the kept ones advance the output.
+     * */
+    static inline size_t cull_points_from(
+      int32_t *offsets, uint32_t *selected, const Point *points, size_t first,
+      size_t length, const Rect &clip, int stride, size_t count)
+    {
+      const uint32_t width = clip.width();
+      const uint32_t height = clip.height();
+      for (size_t i = first; i < length; ++i)
+      {
+        const uint32_t x = points[i].x;
+        const uint32_t y = points[i].y;
+        offsets[count] = y * (uint32_t)(stride) + x;
+        if (selected)
+          selected[count] = i;
+        count += (x - clip.left() < width) & (y - clip.top() < height);
+      }
+      return count;
+    }
+
+    static size_t cull_points_scalar(
+      int32_t *offsets, uint32_t *selected, const Point *points, size_t length,
+      const Rect &clip, int stride)
+    {
+      return cull_points_from(
+        offsets, selected, points, 0, length, clip, stride, 0);
+    }
+
+    // overlapping points are blended one after another
+    template<BlendMode Mode>
+    static void scatter_fill_scalar(
+      uint32_t *dest, const int32_t *offsets, uint32_t color, size_t length)
+    {
+      for (size_t i = 0; i < length; ++i)
+      {
+        uint32_t &d = dest[offsets[i]];
+        d = blend_pixel<Mode, true>(d, color);
+      }
+    }
+
+    template<BlendMode Mode>
+    static void scatter_row_scalar(
+      uint32_t *dest, const int32_t *offsets, const uint32_t *colors,
+      size_t length)
+    {
+      for (size_t i = 0; i < length; ++i)
+      {
+        uint32_t &d = dest[offsets[i]];
+        d = blend_pixel<Mode, true>(d, colors[i]);
+      }
+    }
+
+#ifdef ZD_KERNELS_X86
+    static void copy_keyed_row_sse2(
+      uint32_t *dest, const uint32_t *src, size_t length)
+    {
+      const __m128i alpha_mask = _mm_set1_epi32(0xff);
+      const __m128i zero = _mm_setzero_si128();
+
+      size_t i = 0;
+      for (; i + 4 <= length; i += 4)
+      {
+        const __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+        const __m128i transparent =
+          _mm_cmpeq_epi32(_mm_and_si128(s, alpha_mask), zero);
+        const int bits = _mm_movemask_epi8(transparent);
+
+        if (bits == 0xffff)
+          continue;
+
+        if (bits == 0)
+        {
+          _mm_storeu_si128((__m128i *)(dest + i), s);
+          continue;
+        }
+
+        const __m128i d = _mm_loadu_si128((const __m128i *)(dest + i));
+        const __m128i out = _mm_or_si128(
+          _mm_and_si128(transparent, d), _mm_andnot_si128(transparent, s));
+        _mm_storeu_si128((__m128i *)(dest + i), out);
+      }
+
+      copy_keyed_row_scalar(dest + i, src + i, length - i);
+    }
+
+    __attribute__((target("avx2"))) static void copy_keyed_row_avx2(
+      uint32_t *dest, const uint32_t *src, size_t length)
+    {
+      const __m256i alpha_mask = _mm256_set1_epi32(0xff);
+      const __m256i zero = _mm256_setzero_si256();
+      const __m256i ones = _mm256_set1_epi32(-1);
+
+      size_t i = 0;
+      for (; i + 8 <= length; i += 8)
+      {
+        const __m256i s = _mm256_loadu_si256((const __m256i *)(src + i));
+        const __m256i transparent =
+          _mm256_cmpeq_epi32(_mm256_and_si256(s, alpha_mask), zero);
+        const int bits = _mm256_movemask_epi8(transparent);
+
+        if (bits == -1)
+          continue;
+
+        if (bits == 0)
+        {
+          _mm256_storeu_si256((__m256i *)(dest + i), s);
+          continue;
+        }
+
+        // masked store writes only opaque lanes, destination is never read
+        const __m256i opaque = _mm256_xor_si256(transparent, ones);
+        _mm256_maskstore_epi32((int *)(dest + i), opaque, s);
+      }
+
+      copy_keyed_row_sse2(dest + i, src + i, length - i);
+    }
+
+    __attribute__((target("avx2"))) static void gather_row_avx2(
+      uint32_t *dest, const uint32_t *src, const int32_t *offsets,
+      size_t length)
+    {
+      size_t i = 0;
+      for (; i + 8 <= length; i += 8)
+      {
+        const __m256i idx = _mm256_loadu_si256((const __m256i *)(offsets + i));
+        const __m256i v = _mm256_i32gather_epi32((const int *)(src), idx, 4);
+        _mm256_storeu_si256((__m256i *)(dest + i), v);
+      }
+
+      gather_row_scalar(dest + i, src, offsets + i, length - i);
+    }
+
+    // 8 indices are widened to 32 bit lanes and looked up with one gather
+    __attribute__((target("avx2"))) static void expand_indexed_row_avx2(
+      uint32_t *dest, const uint8_t *src, const uint32_t *palette,
+      size_t length)
+    {
+      size_t i = 0;
+      for (; i + 8 <= length; i += 8)
+      {
+        const __m256i idx =
+          _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(src + i)));
+        const __m256i v =
+          _mm256_i32gather_epi32((const int *)(palette), idx, 4);
+        _mm256_storeu_si256((__m256i *)(dest + i), v);
+      }
+
+      expand_indexed_row_scalar(dest + i, src + i, palette, length - i);
+    }
+
+    // bytes of a pixel are interleaved from 16 bit lanes of (alpha, gray)
+    // and (gray, gray)
+    template<bool Alpha>
+    static void expand_gray_row_sse2(
+      uint32_t *dest, const uint8_t *src, size_t length)
+    {
+      const __m128i low_bytes = _mm_set1_epi16(0xff);
+      const __m128i opaque = _mm_set1_epi8((char)(0xff));
+
+      size_t i = 0;
+      if constexpr (Alpha)
+      {
+        for (; i + 8 <= length; i += 8)
+        {
+          const __m128i v = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+          const __m128i g = _mm_and_si128(v, low_bytes);
+          const __m128i alpha_gray =
+            _mm_or_si128(_mm_srli_epi16(v, 8), _mm_slli_epi16(v, 8));
+          const __m128i gray_gray = _mm_or_si128(g, _mm_slli_epi16(g, 8));
+          _mm_storeu_si128(
+            (__m128i *)(dest + i), _mm_unpacklo_epi16(alpha_gray, gray_gray));
+          _mm_storeu_si128(
+            (__m128i *)(dest + i + 4),
+            _mm_unpackhi_epi16(alpha_gray, gray_gray));
+        }
+      }
+      else
+      {
+        for (; i + 16 <= length; i += 16)
+        {
+          const __m128i g = _mm_loadu_si128((const __m128i *)(src + i));
+          const __m128i alpha_gray[2] = { _mm_unpacklo_epi8(opaque, g),
+                                          _mm_unpackhi_epi8(opaque, g) };
+          const __m128i gray_gray[2] = { _mm_unpacklo_epi8(g, g),
+                                         _mm_unpackhi_epi8(g, g) };
+          for (int k = 0; k < 2; ++k)
+          {
+            _mm_storeu_si128(
+              (__m128i *)(dest + i + 8 * k),
+              _mm_unpacklo_epi16(alpha_gray[k], gray_gray[k]));
+            _mm_storeu_si128(
+              (__m128i *)(dest + i + 8 * k + 4),
+              _mm_unpackhi_epi16(alpha_gray[k], gray_gray[k]));
+          }
+        }
+      }
+
+      expand_gray_row_scalar<Alpha>(
+        dest + i, src + (Alpha ? 2 : 1) * i, length - i);
+    }
+
+    /*
+     *  Stores start at the first aligned pixel, 4 vectors per iteration.
+     *  Streamed stores are fenced, so the pixels are visible to other
+     *  threads (and the texture upload) once the fill returns.
+     * */
+    static void fill_span_sse2(uint32_t *dest, uint32_t color, size_t length)
+    {
+      size_t i = 0;
+      for (; i < length && ((uintptr_t)(dest + i) & 15) != 0; ++i)
+      {
+        dest[i] = color;
+      }
+
+      const __m128i v = _mm_set1_epi32(color);
+      if ((length - i) * sizeof(uint32_t) >= NON_TEMPORAL_BYTES)
+      {
+        for (; i + 16 <= length; i += 16)
+        {
+          _mm_stream_si128((__m128i *)(dest + i), v);
+          _mm_stream_si128((__m128i *)(dest + i + 4), v);
+          _mm_stream_si128((__m128i *)(dest + i + 8), v);
+          _mm_stream_si128((__m128i *)(dest + i + 12), v);
+        }
+        _mm_sfence();
+      }
+      for (; i + 16 <= length; i += 16)
+      {
+        _mm_store_si128((__m128i *)(dest + i), v);
+        _mm_store_si128((__m128i *)(dest + i + 4), v);
+        _mm_store_si128((__m128i *)(dest + i + 8), v);
+        _mm_store_si128((__m128i *)(dest + i + 12), v);
+      }
+      for (; i + 4 <= length; i += 4)
+      {
+        _mm_store_si128((__m128i *)(dest + i), v);
+      }
+
+      fill_span_scalar(dest + i, color, length - i);
+    }
+
+    __attribute__((target("avx2"))) static void fill_span_avx2(
+      uint32_t *dest, uint32_t color, size_t length)
+    {
+      size_t i = 0;
+      for (; i < length && ((uintptr_t)(dest + i) & 31) != 0; ++i)
+      {
+        dest[i] = color;
+      }
+
+      const __m256i v = _mm256_set1_epi32(color);
+      if ((length - i) * sizeof(uint32_t) >= NON_TEMPORAL_BYTES)
+      {
+        for (; i + 32 <= length; i += 32)
+        {
+          _mm256_stream_si256((__m256i *)(dest + i), v);
+          _mm256_stream_si256((__m256i *)(dest + i + 8), v);
+          _mm256_stream_si256((__m256i *)(dest + i + 16), v);
+          _mm256_stream_si256((__m256i *)(dest + i + 24), v);
+        }
+        _mm_sfence();
+      }
+      for (; i + 32 <= length; i += 32)
+      {
+        _mm256_store_si256((__m256i *)(dest + i), v);
+        _mm256_store_si256((__m256i *)(dest + i + 8), v);
+        _mm256_store_si256((__m256i *)(dest + i + 16), v);
+        _mm256_store_si256((__m256i *)(dest + i + 24), v);
+      }
+      for (; i + 8 <= length; i += 8)
+      {
+        _mm256_store_si256((__m256i *)(dest + i), v);
+      }
+
+      fill_span_scalar(dest + i, color, length - i);
+    }
+
+    // 4 source pixels per iteration, shuffled in place for factors 2 to 4
+    static void upscale_row_sse2(
+      uint32_t *dest, const uint32_t *src, size_t length, int factor)
+    {
+      size_t i = 0;
+      if (factor == 2)
+      {
+        for (; i + 4 <= length; i += 4, dest += 8)
+        {
+          const __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+          _mm_storeu_si128((__m128i *)(dest), _mm_unpacklo_epi32(v, v));
+          _mm_storeu_si128((__m128i *)(dest + 4), _mm_unpackhi_epi32(v, v));
+        }
+      }
+      else if (factor == 3)
+      {
+        for (; i + 4 <= length; i += 4, dest += 12)
+        {
+          const __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+          _mm_storeu_si128((__m128i *)(dest), _mm_shuffle_epi32(v, 0x40));
+          _mm_storeu_si128((__m128i *)(dest + 4), _mm_shuffle_epi32(v, 0xa5));
+          _mm_storeu_si128((__m128i *)(dest + 8), _mm_shuffle_epi32(v, 0xfe));
+        }
+      }
+      else if (factor == 4)
+      {
+        for (; i + 4 <= length; i += 4, dest += 16)
+        {
+          const __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+          _mm_storeu_si128((__m128i *)(dest), _mm_shuffle_epi32(v, 0x00));
+          _mm_storeu_si128((__m128i *)(dest + 4), _mm_shuffle_epi32(v, 0x55));
+          _mm_storeu_si128((__m128i *)(dest + 8), _mm_shuffle_epi32(v, 0xaa));
+          _mm_storeu_si128((__m128i *)(dest + 12), _mm_shuffle_epi32(v, 0xff));
+        }
+      }
+      else
+      {
+        // larger factors store a broadcast pixel
+        for (; i < length; ++i)
+        {
+          const __m128i v = _mm_set1_epi32(src[i]);
+          int k = 0;
+          for (; k + 4 <= factor; k += 4)
+          {
+            _mm_storeu_si128((__m128i *)(dest + k), v);
+          }
+          std::fill_n(dest + k, factor - k, src[i]);
+          dest += factor;
+        }
+      }
+
+      upscale_row_scalar(dest, src + i, length - i, factor);
+    }
+
+    // 8 source pixels per iteration, each output vector is one permutation
+    __attribute__((target("avx2"))) static void upscale_row_avx2(
+      uint32_t *dest, const uint32_t *src, size_t length, int factor)
+    {
+      if (factor < 2 || factor > 4)
+      {
+        upscale_row_sse2(dest, src, length, factor);
+        return;
+      }
+
+      // output vector k of a factor takes source lanes PERMUTATIONS[...][k]
+      alignas(32) static const int32_t PERMUTATIONS[3][4][8] = {
+        { { 0, 0, 1, 1, 2, 2, 3, 3 }, { 4, 4, 5, 5, 6, 6, 7, 7 } },
+        { { 0, 0, 0, 1, 1, 1, 2, 2 },
+          { 2, 3, 3, 3, 4, 4, 4, 5 },
+          { 5, 5, 6, 6, 6, 7, 7, 7 } },
+        { { 0, 0, 0, 0, 1, 1, 1, 1 },
+          { 2, 2, 2, 2, 3, 3, 3, 3 },
+          { 4, 4, 4, 4, 5, 5, 5, 5 },
+          { 6, 6, 6, 6, 7, 7, 7, 7 } },
+      };
+      const int32_t(*permutations)[8] = PERMUTATIONS[factor - 2];
+
+      __m256i indices[4];
+      for (int k = 0; k < factor; ++k)
+      {
+        indices[k] = _mm256_load_si256((const __m256i *)(permutations[k]));
+      }
+
+      size_t i = 0;
+      for (; i + 8 <= length; i += 8, dest += 8 * factor)
+      {
+        const __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+        for (int k = 0; k < factor; ++k)
+        {
+          _mm256_storeu_si256(
+            (__m256i *)(dest + 8 * k),
+            _mm256_permutevar8x32_epi32(v, indices[k]));
+        }
+      }
+
+      upscale_row_sse2(dest, src + i, length - i, factor);
+    }
+
+    /*
+     *  One pixel per iteration, channels of both source rows are
+     *  interpolated at once in 16 bit lanes (top row in the low half).
+     * */
+    static void bilinear_row_sse2(
+      uint32_t *dest, const uint32_t *row0, const uint32_t *row1,
+      const int32_t *x0, const int32_t *x1, const uint16_t *fx, uint32_t fy,
+      size_t length)
+    {
+      const __m128i zero = _mm_setzero_si128();
+      const __m128i wy = _mm_set_epi16(
+        fy, fy, fy, fy, 256 - fy, 256 - fy, 256 - fy, 256 - fy);
+
+      for (size_t i = 0; i < length; ++i)
+      {
+        const __m128i left = _mm_unpacklo_epi8(
+          _mm_unpacklo_epi32(
+            _mm_cvtsi32_si128(row0[x0[i]]), _mm_cvtsi32_si128(row1[x0[i]])),
+          zero);
+        const __m128i right = _mm_unpacklo_epi8(
+          _mm_unpacklo_epi32(
+            _mm_cvtsi32_si128(row0[x1[i]]), _mm_cvtsi32_si128(row1[x1[i]])),
+          zero);
+
+        const __m128i horizontal = _mm_srli_epi16(
+          _mm_add_epi16(
+            _mm_mullo_epi16(left, _mm_set1_epi16(256 - fx[i])),
+            _mm_mullo_epi16(right, _mm_set1_epi16(fx[i]))),
+          8);
+
+        const __m128i weighted = _mm_mullo_epi16(horizontal, wy);
+        const __m128i vertical = _mm_srli_epi16(
+          _mm_add_epi16(weighted, _mm_srli_si128(weighted, 8)), 8);
+
+        dest[i] = _mm_cvtsi128_si32(_mm_packus_epi16(vertical, zero));
+      }
+    }
+
+    // exact round(v / 255) on 16 bit lanes, v in [0; 255 * 255]
+    static inline __m128i div255_epu16(__m128i v)
+    {
+      return _mm_mulhi_epu16(
+        _mm_add_epi16(v, _mm_set1_epi16(128)), _mm_set1_epi16(257));
+    }
+
+    // blends two pixels unpacked to 16 bit lanes, same math as blend_pixel
+    template<BlendMode Mode>
+    static inline __m128i blend2_sse2(__m128i d, __m128i s)
+    {
+      const __m128i alpha_lanes = _mm_set_epi16(0, 0, 0, -1, 0, 0, 0, -1);
+      const __m128i full = _mm_set1_epi16(255);
+      const __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0), 0);
+      const __m128i inv_a = _mm_sub_epi16(full, a);
+      const __m128i sf = _mm_or_si128(
+        _mm_andnot_si128(alpha_lanes, a), _mm_and_si128(alpha_lanes, full));
+
+      if constexpr (Mode == BlendMode::SrcOver)
+      {
+        return div255_epu16(_mm_add_epi16(
+          _mm_mullo_epi16(s, sf), _mm_mullo_epi16(d, inv_a)));
+      }
+      else if constexpr (Mode == BlendMode::PremultipliedSrcOver)
+      {
+        return _mm_add_epi16(s, div255_epu16(_mm_mullo_epi16(d, inv_a)));
+      }
+      else if constexpr (Mode == BlendMode::Additive)
+      {
+        return _mm_add_epi16(d, div255_epu16(_mm_mullo_epi16(s, sf)));
+      }
+      else
+      {
+        const __m128i tint = div255_epu16(_mm_add_epi16(
+          _mm_mullo_epi16(s, a), _mm_mullo_epi16(full, inv_a)));
+        const __m128i out = div255_epu16(_mm_mullo_epi16(d, tint));
+        return _mm_or_si128(
+          _mm_andnot_si128(alpha_lanes, out), _mm_and_si128(alpha_lanes, d));
+      }
+    }
+
+    struct RowSource
+    {
+      const uint32_t *data;
+
+      __m128i load(size_t i) const
+      {
+        return _mm_loadu_si128((const __m128i *)(data + i));
+      }
+      uint32_t get(size_t i) const { return data[i]; }
+    };
+
+    struct SolidSource
+    {
+      uint32_t color;
+
+      __m128i load(size_t) const { return _mm_set1_epi32(color); }
+      uint32_t get(size_t) const { return color; }
+    };
+
+    template<BlendMode Mode, bool SrcAlpha, typename Source>
+    static void blend_span_sse2(
+      uint32_t *dest, const Source &src, size_t length)
+    {
+      const __m128i zero = _mm_setzero_si128();
+      const __m128i alpha_mask = _mm_set1_epi32(0xff);
+
+      size_t i = 0;
+      for (; i + 4 <= length; i += 4)
+      {
+        __m128i s = src.load(i);
+        __m128i *dest_ptr = (__m128i *)(dest + i);
+
+        if constexpr (!SrcAlpha)
+        {
+          s = _mm_or_si128(s, alpha_mask);
+
+          if constexpr (
+            Mode == BlendMode::SrcOver ||
+            Mode == BlendMode::PremultipliedSrcOver)
+          {
+            _mm_storeu_si128(dest_ptr, s);
+            continue;
+          }
+          else if constexpr (Mode == BlendMode::Additive)
+          {
+            _mm_storeu_si128(
+              dest_ptr, _mm_adds_epu8(_mm_loadu_si128(dest_ptr), s));
+            continue;
+          }
+        }
+        else
+        {
+          const __m128i alpha = _mm_and_si128(s, alpha_mask);
+          const int transparent =
+            _mm_movemask_epi8(_mm_cmpeq_epi32(alpha, zero));
+          const int opaque =
+            _mm_movemask_epi8(_mm_cmpeq_epi32(alpha, alpha_mask));
+
+          if (transparent == 0xffff && Mode != BlendMode::PremultipliedSrcOver)
+            continue;
+
+          if (
+            opaque == 0xffff && (Mode == BlendMode::SrcOver ||
+                                 Mode == BlendMode::PremultipliedSrcOver))
+          {
+            _mm_storeu_si128(dest_ptr, s);
+            continue;
+          }
+        }
+
+        const __m128i d = _mm_loadu_si128(dest_ptr);
+        const __m128i lo = blend2_sse2<Mode>(
+          _mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero));
+        const __m128i hi = blend2_sse2<Mode>(
+          _mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero));
+        _mm_storeu_si128(dest_ptr, _mm_packus_epi16(lo, hi));
+      }
+
+      for (; i < length; ++i)
+      {
+        dest[i] = blend_pixel<Mode, SrcAlpha>(dest[i], src.get(i));
+      }
+    }
+
+    template<BlendMode Mode, bool SrcAlpha>
+    static void blend_row_sse2(
+      uint32_t *dest, const uint32_t *src, size_t length)
+    {
+      blend_span_sse2<Mode, SrcAlpha>(dest, RowSource { src }, length);
+    }
+
+    template<BlendMode Mode>
+    static void blend_fill_sse2(uint32_t *dest, uint32_t color, size_t length)
+    {
+      blend_span_sse2<Mode, true>(dest, SolidSource { color }, length);
+    }
+
+    struct CoverageSSE2
+    {
+      const __m128 sign = _mm_set1_ps(-0.0f);
+      const __m128 one = _mm_set1_ps(1.0f);
+      const __m128 two = _mm_set1_ps(2.0f);
+      const __m128 half = _mm_set1_ps(0.5f);
+      const __m128 scale = _mm_set1_ps(255.0f);
+
+      // prefix sum of 4 floats, done with two shifted adds
+      static inline __m128 prefix_sum(__m128 x)
+      {
+        x = _mm_add_ps(
+          x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 4)));
+        return _mm_add_ps(
+          x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 8)));
+      }
+
+      inline __m128i convert(__m128 x, bool even_odd) const
+      {
+        __m128 v = _mm_andnot_ps(sign, x);
+        if (even_odd)
+        {
+          // v is not negative, so truncation works as floor
+          const __m128 pairs =
+            _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_mul_ps(v, half)));
+          v = _mm_sub_ps(v, _mm_mul_ps(pairs, two));
+          v = _mm_min_ps(v, _mm_sub_ps(two, v));
+        }
+        else
+        {
+          v = _mm_min_ps(v, one);
+        }
+        return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, scale), half));
+      }
+    };
+
+    /*
+     *  16 pixels per iteration. Prefix sums of the 4 blocks are independent,
+     *  only the running total (broadcast from the last lane) is carried
+     *  between them.
+     * */
+    static void accumulate_coverage_sse2(
+      uint8_t *coverage, float *accumulation, size_t length, bool even_odd)
+    {
+      const CoverageSSE2 k;
+      const __m128 zero = _mm_setzero_ps();
+      const __m128i zero_bits = _mm_setzero_si128();
+
+      __m128 offset = zero;
+      size_t i = 0;
+      for (; i + 16 <= length; i += 16)
+      {
+        float *a = accumulation + i;
+        __m128 x[4];
+        __m128 any = zero;
+        for (int j = 0; j < 4; ++j)
+        {
+          x[j] = _mm_loadu_ps(a + 4 * j);
+          any = _mm_or_ps(any, x[j]);
+        }
+
+        // nothing starts nor ends here, whole block has the running coverage
+        const __m128i any_bits = _mm_castps_si128(any);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(any_bits, zero_bits)) == 0xffff)
+        {
+          __m128i c = k.convert(offset, even_odd);
+          c = _mm_packs_epi32(c, c);
+          _mm_storeu_si128(
+            (__m128i *)(coverage + i), _mm_packus_epi16(c, c));
+          continue;
+        }
+
+        __m128i c[4];
+        for (int j = 0; j < 4; ++j)
+        {
+          _mm_storeu_ps(a + 4 * j, zero);
+          x[j] = CoverageSSE2::prefix_sum(x[j]);
+          const __m128 total =
+            _mm_shuffle_ps(x[j], x[j], _MM_SHUFFLE(3, 3, 3, 3));
+          c[j] = k.convert(_mm_add_ps(x[j], offset), even_odd);
+          offset = _mm_add_ps(offset, total);
+        }
+
+        const __m128i c01 = _mm_packs_epi32(c[0], c[1]);
+        const __m128i c23 = _mm_packs_epi32(c[2], c[3]);
+        _mm_storeu_si128(
+          (__m128i *)(coverage + i), _mm_packus_epi16(c01, c23));
+      }
+
+      for (; i + 4 <= length; i += 4)
+      {
+        const __m128 x =
+          CoverageSSE2::prefix_sum(_mm_loadu_ps(accumulation + i));
+        _mm_storeu_ps(accumulation + i, zero);
+
+        __m128i c = k.convert(_mm_add_ps(x, offset), even_odd);
+        offset =
+          _mm_add_ps(offset, _mm_shuffle_ps(x, x, _MM_SHUFFLE(3, 3, 3, 3)));
+
+        c = _mm_packs_epi32(c, c);
+        c = _mm_packus_epi16(c, c);
+        const uint32_t packed = _mm_cvtsi128_si32(c);
+        memcpy(coverage + i, &packed, sizeof(packed));
+      }
+
+      float sum = _mm_cvtss_f32(offset);
+      for (; i < length; ++i)
+      {
+        sum += accumulation[i];
+        accumulation[i] = 0.0f;
+        coverage[i] = coverage_value(sum, even_odd);
+      }
+    }
+
+    static void unpack_row_sse2(float *dest, const uint32_t *src, size_t length)
+    {
+      const __m128i zero = _mm_setzero_si128();
+
+      size_t i = 0;
+      for (; i + 4 <= length; i += 4, dest += 16)
+      {
+        const __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        const __m128i lo = _mm_unpacklo_epi8(v, zero);
+        const __m128i hi = _mm_unpackhi_epi8(v, zero);
+        const __m128i channels[4] = { _mm_unpacklo_epi16(lo, zero),
+                                      _mm_unpackhi_epi16(lo, zero),
+                                      _mm_unpacklo_epi16(hi, zero),
+                                      _mm_unpackhi_epi16(hi, zero) };
+        for (int j = 0; j < 4; ++j)
+        {
+          _mm_storeu_ps(dest + 4 * j, _mm_cvtepi32_ps(channels[j]));
+        }
+      }
+
+      unpack_row_scalar(dest, src + i, length - i);
+    }
+
+    // saturating packs clamp channels to [0; 255]
+    static void pack_row_sse2(uint32_t *dest, const float *src, size_t length)
+    {
+      size_t i = 0;
+      for (; i + 4 <= length; i += 4, src += 16)
+      {
+        __m128i channels[4];
+        for (int j = 0; j < 4; ++j)
+        {
+          channels[j] = _mm_cvtps_epi32(_mm_loadu_ps(src + 4 * j));
+        }
+        const __m128i lo = _mm_packs_epi32(channels[0], channels[1]);
+        const __m128i hi = _mm_packs_epi32(channels[2], channels[3]);
+        _mm_storeu_si128((__m128i *)(dest + i), _mm_packus_epi16(lo, hi));
+      }
+
+      pack_row_scalar(dest + i, src, length - i);
+    }
+
+    // a pixel is one vector, weights are broadcast
+    static void convolve_row_sse2(
+      float *dest, const float *src, size_t length, const float *weights,
+      size_t taps)
+    {
+      for (size_t i = 0; i < length; ++i, dest += 4, src += 4)
+      {
+        __m128 sum = _mm_setzero_ps();
+        for (size_t k = 0; k < taps; ++k)
+        {
+          const __m128 w = _mm_set1_ps(weights[k]);
+          sum = _mm_add_ps(sum, _mm_mul_ps(w, _mm_loadu_ps(src + 4 * k)));
+        }
+        _mm_storeu_ps(dest, sum);
+      }
+    }
+
+    static void box_row_sse2(
+      float *dest, const float *src, size_t length, size_t taps)
+    {
+      const __m128 scale = _mm_set1_ps(1.0f / taps);
+      __m128 sum = _mm_setzero_ps();
+      for (size_t k = 0; k < taps; ++k)
+      {
+        sum = _mm_add_ps(sum, _mm_loadu_ps(src + 4 * k));
+      }
+
+      for (size_t i = 0; i < length; ++i)
+      {
+        _mm_storeu_ps(dest + 4 * i, _mm_mul_ps(sum, scale));
+        if (i + 1 == length)
+          break;
+
+        sum = _mm_add_ps(sum, _mm_loadu_ps(src + 4 * (i + taps)));
+        sum = _mm_sub_ps(sum, _mm_loadu_ps(src + 4 * i));
+      }
+    }
+
+    // 4 pixels per iteration in two vectors of 2 pixels
+    __attribute__((target("avx2"))) static void convolve_row_avx2(
+      float *dest, const float *src, size_t length, const float *weights,
+      size_t taps)
+    {
+      size_t i = 0;
+      for (; i + 4 <= length; i += 4, dest += 16, src += 16)
+      {
+        __m256 sum0 = _mm256_setzero_ps();
+        __m256 sum1 = _mm256_setzero_ps();
+        for (size_t k = 0; k < taps; ++k)
+        {
+          const __m256 w = _mm256_set1_ps(weights[k]);
+          const float *s = src + 4 * k;
+          sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(w, _mm256_loadu_ps(s)));
+          sum1 =
+            _mm256_add_ps(sum1, _mm256_mul_ps(w, _mm256_loadu_ps(s + 8)));
+        }
+        _mm256_storeu_ps(dest, sum0);
+        _mm256_storeu_ps(dest + 8, sum1);
+      }
+
+      convolve_row_sse2(dest, src, length - i, weights, taps);
+    }
+
+    /*
+     *  4 points per iteration. Unsigned comparisons are signed ones with
+     *  flipped sign bits, y * stride is built from two 32 x 32 bit products.
+     * */
+    static size_t cull_points_sse2(
+      int32_t *offsets, uint32_t *selected, const Point *points, size_t length,
+      const Rect &clip, int stride)
+    {
+      const __m128i sign = _mm_set1_epi32(0x80000000);
+      const __m128i left = _mm_set1_epi32(clip.left());
+      const __m128i top = _mm_set1_epi32(clip.top());
+      const __m128i width = _mm_xor_si128(_mm_set1_epi32(clip.width()), sign);
+      const __m128i height =
+        _mm_xor_si128(_mm_set1_epi32(clip.height()), sign);
+      const __m128i strides = _mm_set1_epi32(stride);
+
+      size_t count = 0;
+      size_t i = 0;
+      for (; i + 4 <= length; i += 4)
+      {
+        const __m128 p0 = _mm_loadu_ps((const float *)(points + i));
+        const __m128 p1 = _mm_loadu_ps((const float *)(points + i + 2));
+        const __m128i x =
+          _mm_castps_si128(_mm_shuffle_ps(p0, p1, _MM_SHUFFLE(2, 0, 2, 0)));
+        const __m128i y =
+          _mm_castps_si128(_mm_shuffle_ps(p0, p1, _MM_SHUFFLE(3, 1, 3, 1)));
+
+        const __m128i inside_x = _mm_cmplt_epi32(
+          _mm_xor_si128(_mm_sub_epi32(x, left), sign), width);
+        const __m128i inside_y = _mm_cmplt_epi32(
+          _mm_xor_si128(_mm_sub_epi32(y, top), sign), height);
+        const int mask =
+          _mm_movemask_ps(_mm_castsi128_ps(_mm_and_si128(inside_x, inside_y)));
+        if (mask == 0)
+          continue;
+
+        const __m128i even = _mm_mul_epu32(y, strides);
+        const __m128i odd = _mm_mul_epu32(_mm_srli_epi64(y, 32), strides);
+        const __m128i rows = _mm_unpacklo_epi32(
+          _mm_shuffle_epi32(even, _MM_SHUFFLE(3, 1, 2, 0)),
+          _mm_shuffle_epi32(odd, _MM_SHUFFLE(3, 1, 2, 0)));
+        const __m128i offset = _mm_add_epi32(rows, x);
+
+        if (mask == 0xf)
+        {
+          _mm_storeu_si128((__m128i *)(offsets + count), offset);
+          if (selected)
+          {
+            const __m128i index = _mm_add_epi32(
+              _mm_set1_epi32(i), _mm_setr_epi32(0, 1, 2, 3));
+            _mm_storeu_si128((__m128i *)(selected + count), index);
+          }
+          count += 4;
+          continue;
+        }
+
+        alignas(16) int32_t lanes[4];
+        _mm_store_si128((__m128i *)(lanes), offset);
+        for (int j = 0; j < 4; ++j)
+        {
+          offsets[count] = lanes[j];
+          if (selected)
+            selected[count] = i + j;
+          count += (mask >> j) & 1;
+        }
+      }
+
+      return cull_points_from(
+        offsets, selected, points, i, length, clip, stride, count);
+    }
+
+    // lane permutations moving lanes of a mask to the front, as bytes
+    static constexpr std::array<uint64_t, 256> COMPACT_LANES = []() {
+      std::array<uint64_t, 256> table {};
+      for (uint32_t mask = 0; mask < 256; ++mask)
+      {
+        int kept = 0;
+        for (uint64_t lane = 0; lane < 8; ++lane)
+        {
+          if (mask & (1u << lane))
+            table[mask] |= lane << (8 * kept++);
+        }
+      }
+      return table;
+    }();
+
+    // 8 points per iteration, kept lanes are packed with one permutation
+    __attribute__((target("avx2"))) static size_t cull_points_avx2(
+      int32_t *offsets, uint32_t *selected, const Point *points, size_t length,
+      const Rect &clip, int stride)
+    {
+      const __m256i sign = _mm256_set1_epi32(0x80000000);
+      const __m256i left = _mm256_set1_epi32(clip.left());
+      const __m256i top = _mm256_set1_epi32(clip.top());
+      const __m256i width =
+        _mm256_xor_si256(_mm256_set1_epi32(clip.width()), sign);
+      const __m256i height =
+        _mm256_xor_si256(_mm256_set1_epi32(clip.height()), sign);
+      const __m256i strides = _mm256_set1_epi32(stride);
+      const __m256i lane_index = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+      size_t count = 0;
+      size_t i = 0;
+      for (; i + 8 <= length; i += 8)
+      {
+        const __m256 p0 = _mm256_loadu_ps((const float *)(points + i));
+        const __m256 p1 = _mm256_loadu_ps((const float *)(points + i + 4));
+        // shuffles work within 128 bit lanes, so their halves are reordered
+        const __m256i x = _mm256_permute4x64_epi64(
+          _mm256_castps_si256(
+            _mm256_shuffle_ps(p0, p1, _MM_SHUFFLE(2, 0, 2, 0))),
+          _MM_SHUFFLE(3, 1, 2, 0));
+        const __m256i y = _mm256_permute4x64_epi64(
+          _mm256_castps_si256(
+            _mm256_shuffle_ps(p0, p1, _MM_SHUFFLE(3, 1, 3, 1))),
+          _MM_SHUFFLE(3, 1, 2, 0));
+
+        const __m256i inside_x = _mm256_cmpgt_epi32(
+          width, _mm256_xor_si256(_mm256_sub_epi32(x, left), sign));
+        const __m256i inside_y = _mm256_cmpgt_epi32(
+          height, _mm256_xor_si256(_mm256_sub_epi32(y, top), sign));
+        const uint32_t mask = _mm256_movemask_ps(
+          _mm256_castsi256_ps(_mm256_and_si256(inside_x, inside_y)));
+        if (mask == 0)
+          continue;
+
+        const __m256i offset =
+          _mm256_add_epi32(_mm256_mullo_epi32(y, strides), x);
+        const __m256i compact = _mm256_cvtepu8_epi32(
+          _mm_cvtsi64_si128((long long)(COMPACT_LANES[mask])));
+        _mm256_storeu_si256(
+          (__m256i *)(offsets + count),
+          _mm256_permutevar8x32_epi32(offset, compact));
+        if (selected)
+        {
+          const __m256i index =
+            _mm256_add_epi32(_mm256_set1_epi32(i), lane_index);
+          _mm256_storeu_si256(
+            (__m256i *)(selected + count),
+            _mm256_permutevar8x32_epi32(index, compact));
+        }
+        count += __builtin_popcount(mask);
+      }
+
+      return cull_points_from(
+        offsets, selected, points, i, length, clip, stride, count);
+    }
+#endif
+
+    struct KernelTable
+    {
+      SimdLevel level;
+      CopyRowFunc copy_keyed_row;
+      CopyRowFunc blend_row[BLEND_MODES_NUM][2];
+      FillRowFunc blend_fill[BLEND_MODES_NUM];
+      FillRowFunc fill_span;
+      GatherRowFunc gather_row;
+      BilinearRowFunc bilinear_row;
+      CoverageRowFunc accumulate_coverage;
+      ExpandRowFunc expand_indexed_row;
+      GrayRowFunc expand_gray_row[2];
+      UpscaleRowFunc upscale_row;
+      UnpackRowFunc unpack_row;
+      PackRowFunc pack_row;
+      ConvolveRowFunc convolve_row;
+      BoxRowFunc box_row;
+      CullPointsFunc cull_points;
+      ScatterFillFunc scatter_fill[BLEND_MODES_NUM];
+      ScatterRowFunc scatter_row[BLEND_MODES_NUM];
+    };
+
+    template<BlendMode Mode>
+    static void set_blend_kernels(KernelTable &table)
+    {
+      const size_t m = (size_t)(Mode);
+      table.blend_row[m][0] = blend_row_scalar<Mode, false>;
+      table.blend_row[m][1] = blend_row_scalar<Mode, true>;
+      table.blend_fill[m] = blend_fill_scalar<Mode>;
+
+#ifdef ZD_KERNELS_X86
+      if (table.level >= SimdLevel::SSE2)
+      {
+        table.blend_row[m][0] = blend_row_sse2<Mode, false>;
+        table.blend_row[m][1] = blend_row_sse2<Mode, true>;
+        table.blend_fill[m] = blend_fill_sse2<Mode>;
+      }
+#endif
+    }
+
+    template<BlendMode Mode>
+    static void set_scatter_kernels(KernelTable &table)
+    {
+      table.scatter_fill[(size_t)(Mode)] = scatter_fill_scalar<Mode>;
+      table.scatter_row[(size_t)(Mode)] = scatter_row_scalar<Mode>;
+    }
+
+    static KernelTable make_table(SimdLevel level)
+    {
+      KernelTable table;
+      table.level = SimdLevel::Scalar;
+      table.copy_keyed_row = copy_keyed_row_scalar;
+      table.fill_span = fill_span_scalar;
+      table.gather_row = gather_row_scalar;
+      table.bilinear_row = bilinear_row_scalar;
+      table.accumulate_coverage = accumulate_coverage_scalar;
+      table.expand_indexed_row = expand_indexed_row_scalar;
+      table.expand_gray_row[0] = expand_gray_row_scalar<false>;
+      table.expand_gray_row[1] = expand_gray_row_scalar<true>;
+      table.upscale_row = upscale_row_scalar;
+      table.unpack_row = unpack_row_scalar;
+      table.pack_row = pack_row_scalar;
+      table.convolve_row = convolve_row_scalar;
+      table.box_row = box_row_scalar;
+      table.cull_points = cull_points_scalar;
+
+#ifdef ZD_KERNELS_X86
+      switch (level)
+      {
+        case SimdLevel::AVX2:
+          table.level = SimdLevel::AVX2;
+          table.copy_keyed_row = copy_keyed_row_avx2;
+          table.fill_span = fill_span_avx2;
+          table.gather_row = gather_row_avx2;
+          table.expand_indexed_row = expand_indexed_row_avx2;
+          table.expand_gray_row[0] = expand_gray_row_sse2<false>;
+          table.expand_gray_row[1] = expand_gray_row_sse2<true>;
+          table.upscale_row = upscale_row_avx2;
+          table.unpack_row = unpack_row_sse2;
+          table.pack_row = pack_row_sse2;
+          table.convolve_row = convolve_row_avx2;
+          table.box_row = box_row_sse2;
+          table.cull_points = cull_points_avx2;
+          table.bilinear_row = bilinear_row_sse2;
+          table.accumulate_coverage = accumulate_coverage_sse2;
+          break;
+        case SimdLevel::SSE2:
+          table.level = SimdLevel::SSE2;
+          table.copy_keyed_row = copy_keyed_row_sse2;
+          table.fill_span = fill_span_sse2;
+          table.upscale_row = upscale_row_sse2;
+          table.expand_gray_row[0] = expand_gray_row_sse2<false>;
+          table.expand_gray_row[1] = expand_gray_row_sse2<true>;
+          table.unpack_row = unpack_row_sse2;
+          table.pack_row = pack_row_sse2;
+          table.convolve_row = convolve_row_sse2;
+          table.box_row = box_row_sse2;
+          table.cull_points = cull_points_sse2;
+          table.bilinear_row = bilinear_row_sse2;
+          table.accumulate_coverage = accumulate_coverage_sse2;
+          break;
+        case SimdLevel::Scalar: break;
+      }
+#else
+      (void)level;
+#endif
+
+      const size_t replace = (size_t)(BlendMode::Replace);
+      table.blend_row[replace][0] = copy_row;
+      table.blend_row[replace][1] = copy_row;
+      table.blend_fill[replace] = table.fill_span;
+
+      const size_t color_key = (size_t)(BlendMode::ColorKey);
+      table.blend_row[color_key][0] = table.copy_keyed_row;
+      table.blend_row[color_key][1] = table.copy_keyed_row;
+      table.blend_fill[color_key] = fill_keyed_row;
+
+      set_blend_kernels<BlendMode::SrcOver>(table);
+      set_blend_kernels<BlendMode::Additive>(table);
+      set_blend_kernels<BlendMode::Multiply>(table);
+      set_blend_kernels<BlendMode::PremultipliedSrcOver>(table);
+
+      set_scatter_kernels<BlendMode::Replace>(table);
+      set_scatter_kernels<BlendMode::ColorKey>(table);
+      set_scatter_kernels<BlendMode::SrcOver>(table);
+      set_scatter_kernels<BlendMode::Additive>(table);
+      set_scatter_kernels<BlendMode::Multiply>(table);
+      set_scatter_kernels<BlendMode::PremultipliedSrcOver>(table);
+
+      return table;
+    }
+
+    static const KernelTable &level_table(SimdLevel level)
+    {
+      static const KernelTable tables[] = { make_table(SimdLevel::Scalar),
+                                            make_table(SimdLevel::SSE2),
+                                            make_table(SimdLevel::AVX2) };
+      return tables[(size_t)(level)];
+    }
+
+    // tables never change, set_simd_level only publishes another one
+    static std::atomic<const KernelTable *> &current_table()
+    {
+      static std::atomic<const KernelTable *> table {
+        &level_table(detect_simd_level())
+      };
+      return table;
+    }
+
+    static const KernelTable &active_table()
+    {
+      return *current_table().load(std::memory_order_acquire);
+    }
+
+    SimdLevel detect_simd_level()
+    {
+#ifdef ZD_KERNELS_X86
+      __builtin_cpu_init();
+      if (__builtin_cpu_supports("avx2"))
+        return SimdLevel::AVX2;
+      if (__builtin_cpu_supports("sse2"))
+        return SimdLevel::SSE2;
+#endif
+      return SimdLevel::Scalar;
+    }
+
+    SimdLevel get_simd_level() { return active_table().level; }
+
+    void set_simd_level(SimdLevel level)
+    {
+      if (level > detect_simd_level())
+        level = detect_simd_level();
+
+      current_table().store(&level_table(level), std::memory_order_release);
+    }
+
+    void copy_keyed_row(uint32_t *dest, const uint32_t *src, size_t length)
+    {
+      active_table().copy_keyed_row(dest, src, length);
+    }
+
+    void blend_row(
+      uint32_t *dest, const uint32_t *src, size_t length, BlendMode mode,
+      PixelFormat::Type src_format)
+    {
+      const size_t has_alpha = PixelFormat::has_alpha(src_format) ? 1 : 0;
+      active_table().blend_row[(size_t)(mode)][has_alpha](dest, src, length);
+    }
+
+    void blend_fill(
+      uint32_t *dest, uint32_t color, size_t length, BlendMode mode)
+    {
+      active_table().blend_fill[(size_t)(mode)](dest, color, length);
+    }
+
+    void fill_span(uint32_t *dest, uint32_t color, size_t length)
+    {
+      active_table().fill_span(dest, color, length);
+    }
+
+    void gather_row(
+      uint32_t *dest, const uint32_t *src, const int32_t *offsets,
+      size_t length)
+    {
+      active_table().gather_row(dest, src, offsets, length);
+    }
+
+    void expand_indexed_row(
+      uint32_t *dest, const uint8_t *src, const uint32_t *palette,
+      size_t length)
+    {
+      active_table().expand_indexed_row(dest, src, palette, length);
+    }
+
+    void expand_gray_row(uint32_t *dest, const uint8_t *src, size_t length)
+    {
+      active_table().expand_gray_row[0](dest, src, length);
+    }
+
+    void expand_gray_alpha_row(
+      uint32_t *dest, const uint8_t *src, size_t length)
+    {
+      active_table().expand_gray_row[1](dest, src, length);
+    }
+
+    void upscale_row(
+      uint32_t *dest, const uint32_t *src, size_t length, int factor)
+    {
+      active_table().upscale_row(dest, src, length, factor);
+    }
+
+    void bilinear_row(
+      uint32_t *dest, const uint32_t *row0, const uint32_t *row1,
+      const int32_t *x0, const int32_t *x1, const uint16_t *fx, uint32_t fy,
+      size_t length)
+    {
+      active_table().bilinear_row(dest, row0, row1, x0, x1, fx, fy, length);
+    }
+
+    void accumulate_coverage(
+      uint8_t *coverage, float *accumulation, size_t length, bool even_odd)
+    {
+      active_table().accumulate_coverage(
+        coverage, accumulation, length, even_odd);
+    }
+
+    void unpack_row(float *dest, const uint32_t *src, size_t length)
+    {
+      active_table().unpack_row(dest, src, length);
+    }
+
+    void pack_row(uint32_t *dest, const float *src, size_t length)
+    {
+      active_table().pack_row(dest, src, length);
+    }
+
+    void convolve_row(
+      float *dest, const float *src, size_t length, const float *weights,
+      size_t taps)
+    {
+      active_table().convolve_row(dest, src, length, weights, taps);
+    }
+
+    void box_row(float *dest, const float *src, size_t length, size_t taps)
+    {
+      active_table().box_row(dest, src, length, taps);
+    }
+
+    size_t cull_points(
+      int32_t *offsets, uint32_t *selected, const Point *points, size_t length,
+      const Rect &clip, int stride)
+    {
+      return active_table().cull_points(
+        offsets, selected, points, length, clip, stride);
+    }
+
+    void scatter_fill(
+      uint32_t *dest, const int32_t *offsets, uint32_t color, size_t length,
+      BlendMode mode)
+    {
+      active_table().scatter_fill[(size_t)(mode)](dest, offsets, color, length);
+    }
+
+    void scatter_row(
+      uint32_t *dest, const int32_t *offsets, const uint32_t *colors,
+      size_t length, BlendMode mode)
+    {
+      active_table().scatter_row[(size_t)(mode)](
+        dest, offsets, colors, length);
+    }
+
+    void blend_mask(
+      uint32_t *dest, uint32_t color, const uint8_t *coverage, size_t length,
+      BlendMode mode)
+    {
+      // coverage is carried in alpha, so modes ignoring it can't be used
+      if (mode == BlendMode::Replace || mode == BlendMode::ColorKey)
+        mode = BlendMode::SrcOver;
+
+      const bool premultiplied = mode == BlendMode::PremultipliedSrcOver;
+      const uint32_t alpha = color & 0xff;
+      const auto blend = active_table().blend_row[(size_t)(mode)][1];
+
+      constexpr size_t CHUNK = 64;
+      uint32_t src[CHUNK];
+
+      for (size_t i = 0; i < length; i += CHUNK)
+      {
+        const size_t n = std::min(CHUNK, length - i);
+        const uint8_t *c = coverage + i;
+
+        uint32_t any = 0;
+        uint32_t all = 0xff;
+        for (size_t j = 0; j < n; ++j)
+        {
+          any |= c[j];
+          all &= c[j];
+        }
+        if (any == 0)
+          continue;
+
+        if (all == 0xff)
+        {
+          active_table().blend_fill[(size_t)(mode)](dest + i, color, n);
+          continue;
+        }
+
+        if (premultiplied)
+        {
+          for (size_t j = 0; j < n; ++j)
+          {
+            src[j] = lerp_channels(0, color, c[j] + (c[j] >> 7));
+          }
+        }
+        else
+        {
+          for (size_t j = 0; j < n; ++j)
+          {
+            src[j] = (color & 0xffffff00) | div255(alpha * c[j]);
+          }
+        }
+        blend(dest + i, src, n);
+      }
+    }
+
+    uint32_t blend_pixel(
+      uint32_t dest, uint32_t src, BlendMode mode, PixelFormat::Type src_format)
+    {
+      blend_row(&dest, &src, 1, mode, src_format);
+      return dest;
+    }
+
+    uint32_t bilinear_pixel(
+      uint32_t top_left, uint32_t top_right, uint32_t bottom_left,
+      uint32_t bottom_right, uint32_t fx, uint32_t fy)
+    {
+      return lerp_channels(
+        lerp_channels(top_left, top_right, fx),
+        lerp_channels(bottom_left, bottom_right, fx),
+        fy);
+    }
+
+  } // namespace Kernels
+} // namespace ZD
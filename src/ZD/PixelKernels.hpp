@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Color.hpp"
+#include "Point.hpp"
+#include "Rect.hpp"
+
+namespace ZD
+{
+  enum class SimdLevel
+  {
+    Scalar,
+    SSE2,
+    AVX2
+  };
+
+  /*
+   *  Row kernels used by Painter and ImageFilter.
+   *  Every kernel works on already clipped rows, so callers have to
+   *  make sure `length` pixels are valid in both `dest` and `src`.
+   *  Implementation is picked once at startup (see detect_simd_level),
+   *  set_simd_level can be used to force a specific one. It can be called
+   *  while other threads draw, calls already running finish with the
+   *  previous kernels.
+   * */
+  namespace Kernels
+  {
+    SimdLevel detect_simd_level();
+    SimdLevel get_simd_level();
+    void set_simd_level(SimdLevel level);
+
+    // copies pixels skipping these with alpha equal to 0
+    void copy_keyed_row(uint32_t *dest, const uint32_t *src, size_t length);
+
+    // blends a row of `src_format` pixels into destination
+    void blend_row(
+      uint32_t *dest, const uint32_t *src, size_t length, BlendMode mode,
+      PixelFormat::Type src_format = PixelFormat::BGRA);
+
+    // blends a single color over `length` destination pixels
+    void blend_fill(
+      uint32_t *dest, uint32_t color, size_t length, BlendMode mode);
+
+    /*
+     *  Sets `length` pixels to the color. Large spans (like clearing
+     *  a whole canvas) are written around the cache.
+     * */
+    void fill_span(uint32_t *dest, uint32_t color, size_t length);
+
+    // dest[i] = src[offsets[i]]
+    void gather_row(
+      uint32_t *dest, const uint32_t *src, const int32_t *offsets,
+      size_t length);
+
+    // dest[i] = palette[src[i]], palette has 256 colors
+    void expand_indexed_row(
+      uint32_t *dest, const uint8_t *src, const uint32_t *palette,
+      size_t length);
+
+    // gray levels (interleaved with alpha) become opaque (translucent) gray
+    void expand_gray_row(uint32_t *dest, const uint8_t *src, size_t length);
+    void expand_gray_alpha_row(
+      uint32_t *dest, const uint8_t *src, size_t length);
+
+    // repeats every source pixel `factor` times, dest holds length * factor
+    void upscale_row(
+      uint32_t *dest, const uint32_t *src, size_t length, int factor);
+
+    /*
+     *  Bilinear sampling between two source rows.
+     *  Column i is interpolated between x0[i] and x1[i] with weight fx[i],
+     *  rows with weight fy. Weights are in range [0; 255] (256 means 1.0).
+     * */
+    void bilinear_row(
+      uint32_t *dest, const uint32_t *row0, const uint32_t *row1,
+      const int32_t *x0, const int32_t *x1, const uint16_t *fx, uint32_t fy,
+      size_t length);
+
+    /*
+     *  Resolves a row of signed area accumulation (see PathRasterizer)
+     *  into coverage in range [0; 255]. Accumulation is prefix summed
+     *  and cleared, so the buffer can be reused.
+     * */
+    void accumulate_coverage(
+      uint8_t *coverage, float *accumulation, size_t length, bool even_odd);
+
+    /*
+     *  Filter rows (see ImageFilter) hold every pixel as 4 floats, one per
+     *  channel in memory order. Packing rounds and clamps to [0; 255].
+     * */
+    void unpack_row(float *dest, const uint32_t *src, size_t length);
+    void pack_row(uint32_t *dest, const float *src, size_t length);
+
+    // pixel i is the weighted sum of src pixels [i; i + taps)
+    void convolve_row(
+      float *dest, const float *src, size_t length, const float *weights,
+      size_t taps);
+    // average of src pixels [i; i + taps), kept as a running sum
+    void box_row(float *dest, const float *src, size_t length, size_t taps);
+
+    /*
+     *  Keeps points inside of the clip, writing their offsets in the target
+     *  (y * stride + x) and, unless `selected` is null, their indices in
+     *  `points`. Both outputs have room for `length` values, returns how
+     *  many points were kept.
+     * */
+    size_t cull_points(
+      int32_t *offsets, uint32_t *selected, const Point *points, size_t length,
+      const Rect &clip, int stride);
+    // blends color into dest[offsets[i]], one pixel after another
+    void scatter_fill(
+      uint32_t *dest, const int32_t *offsets, uint32_t color, size_t length,
+      BlendMode mode);
+    // blends colors[i] into dest[offsets[i]]
+    void scatter_row(
+      uint32_t *dest, const int32_t *offsets, const uint32_t *colors,
+      size_t length, BlendMode mode);
+
+    // blends color with its alpha scaled by coverage of every pixel
+    void blend_mask(
+      uint32_t *dest, uint32_t color, const uint8_t *coverage, size_t length,
+      BlendMode mode);
+
+    uint32_t blend_pixel(
+      uint32_t dest, uint32_t src, BlendMode mode,
+      PixelFormat::Type src_format = PixelFormat::BGRA);
+
+    // same interpolation as bilinear_row, for a single pixel
+    uint32_t bilinear_pixel(
+      uint32_t top_left, uint32_t top_right, uint32_t bottom_left,
+      uint32_t bottom_right, uint32_t fx, uint32_t fy);
+  } // namespace Kernels
+
+} // namespace ZD
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ZD
+{
+  // pixel of PixelFormat::GrayAlpha images
+  struct GrayAlphaPixel
+  {
+    uint8_t gray;
+    uint8_t alpha;
+  };
+
+  static_assert(sizeof(GrayAlphaPixel) == 2);
+
+  /*
+   *  Typed access to pixels in their stored form (see Image::view):
+   *  uint32_t for 32 bit formats, uint8_t for PixelFormat::Gray and
+   *  PixelFormat::Indexed, GrayAlphaPixel for PixelFormat::GrayAlpha.
+   *  Rows are `stride` pixels apart. Views don't own the pixels and writing
+   *  through them doesn't mark anything as changed.
+   * */
+  template<typename Pixel> class PixelView
+  {
+  public:
+    PixelView(Pixel *pixels, int width, int height, int stride)
+    : pixels { pixels }
+    , view_width { width }
+    , view_height { height }
+    , view_stride { stride }
+    {
+    }
+
+    int width() const { return view_width; }
+    int height() const { return view_height; }
+    int stride() const { return view_stride; }
+
+    Pixel *row(int y) const { return pixels + (ptrdiff_t)(y) * view_stride; }
+    Pixel &operator()(int x, int y) const { return row(y)[x]; }
+
+  private:
+    Pixel *pixels;
+    int view_width;
+    int view_height;
+    int view_stride;
+  };
+
+} // namespace ZD
@@ -0,0 +1,20 @@
+#pragma once
+
+namespace ZD
+{
+  struct Point
+  {
+    int x { 0 };
+    int y { 0 };
+
+    constexpr bool operator==(const Point &o) const
+    {
+      return o.x == x && o.y == y;
+    }
+    constexpr bool operator!=(const Point &o) const
+    {
+      return o.x != x || o.y != y;
+    }
+  };
+
+} // namespace ZD
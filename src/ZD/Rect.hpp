@@ -0,0 +1,102 @@
+#pragma once
+
+#include <algorithm>
+
+namespace ZD
+{
+  /*
+   *  Axis aligned rectangle.
+   *  left/top are inclusive, right/bottom are exclusive.
+   * */
+  class Rect
+  {
+  public:
+    constexpr Rect() = default;
+
+    constexpr Rect(int x, int y, int w, int h)
+    : x { x }
+    , y { y }
+    , w { w }
+    , h { h }
+    {
+    }
+
+    // rectangle spanning both corners (inclusive)
+    static constexpr Rect from_corners(int x1, int y1, int x2, int y2)
+    {
+      if (x2 < x1)
+        std::swap(x1, x2);
+      if (y2 < y1)
+        std::swap(y1, y2);
+      return Rect(x1, y1, x2 - x1 + 1, y2 - y1 + 1);
+    }
+
+    constexpr int left() const { return x; }
+    constexpr int top() const { return y; }
+    constexpr int right() const { return x + w; }
+    constexpr int bottom() const { return y + h; }
+    constexpr int width() const { return w; }
+    constexpr int height() const { return h; }
+    constexpr long area() const { return is_empty() ? 0 : (long)w * h; }
+
+    constexpr bool is_empty() const { return w <= 0 || h <= 0; }
+
+    constexpr bool contains(int px, int py) const
+    {
+      return px >= x && py >= y && px < x + w && py < y + h;
+    }
+
+    constexpr bool contains(const Rect &other) const
+    {
+      return other.x >= x && other.y >= y && other.right() <= right() &&
+             other.bottom() <= bottom();
+    }
+
+    constexpr bool intersects(const Rect &other) const
+    {
+      return !intersected(other).is_empty();
+    }
+
+    constexpr Rect intersected(const Rect &other) const
+    {
+      const int x1 = std::max(x, other.x);
+      const int y1 = std::max(y, other.y);
+      const int x2 = std::min(right(), other.right());
+      const int y2 = std::min(bottom(), other.bottom());
+      if (x2 <= x1 || y2 <= y1)
+        return Rect();
+      return Rect(x1, y1, x2 - x1, y2 - y1);
+    }
+
+    constexpr Rect united(const Rect &other) const
+    {
+      if (is_empty())
+        return other;
+      if (other.is_empty())
+        return *this;
+
+      const int x1 = std::min(x, other.x);
+      const int y1 = std::min(y, other.y);
+      const int x2 = std::max(right(), other.right());
+      const int y2 = std::max(bottom(), other.bottom());
+      return Rect(x1, y1, x2 - x1, y2 - y1);
+    }
+
+    constexpr bool operator==(const Rect &other) const
+    {
+      return other.x == x && other.y == y && other.w == w && other.h == h;
+    }
+
+    constexpr bool operator!=(const Rect &other) const
+    {
+      return !(*this == other);
+    }
+
+  private:
+    int x { 0 };
+    int y { 0 };
+    int w { 0 };
+    int h { 0 };
+  };
+
+} // namespace ZD
@@ -0,0 +1,37 @@
+#include "RleImage.hpp"
+#include "Image.hpp"
+
+#pragma GCC optimize("O3")
+
+namespace ZD
+{
+  RleImage::RleImage(const Image &image)
+  {
+    const int width = image.width();
+    const int height = image.height();
+    std::vector<uint32_t> buffer(image.is_compact() ? width : 0);
+
+    row_offsets.reserve(height + 1);
+    row_offsets.push_back(0);
+
+    for (int y = 0; y < height; ++y)
+    {
+      const uint32_t *pixels = image.get_pixels(0, y, width, buffer.data());
+      int x = 0;
+      while (x < width)
+      {
+        while (x < width && (pixels[x] & 0xff) == 0)
+          x++;
+
+        const int start = x;
+        while (x < width && (pixels[x] & 0xff) != 0)
+          x++;
+
+        if (x > start)
+          runs.push_back({ start, x - start });
+      }
+      row_offsets.push_back(runs.size());
+    }
+  }
+
+} // namespace ZD
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace ZD
+{
+  class Image;
+
+  /*
+   *  Rows of an image split into runs of visible pixels, pixels with alpha
+   *  equal to 0 are left out. Pixels stay in the image, runs only point
+   *  into its rows (see Image::get_rle).
+   * */
+  class RleImage
+  {
+  public:
+    struct Run
+    {
+      int32_t x;
+      int32_t length;
+    };
+
+    RleImage(const Image &image);
+
+    // runs of row y, ordered from left to right
+    std::span<const Run> row(int y) const
+    {
+      return { runs.data() + row_offsets[y], runs.data() + row_offsets[y + 1] };
+    }
+
+    size_t run_count() const { return runs.size(); }
+
+  private:
+    // runs of row y are [row_offsets[y]; row_offsets[y + 1])
+    std::vector<uint32_t> row_offsets;
+    std::vector<Run> runs;
+  };
+
+} // namespace ZD
@@ -1,4 +1,8 @@
 #include "ScaledPainter.hpp"
+#include "BasicPainter.hpp"
+#include "Font.hpp"
+
+#include <algorithm>
 
 namespace ZD
 {
@@ -15,66 +19,244 @@ namespace ZD
   {
   }
 
-  void ScaledPainter::set_pixel(int x, int y, const Color &color)
+  void ScaledPainter::set_pixel(
+    int x, int y, const Color &color, BlendMode mode)
   {
     x = this->scale_h(x);
     y = this->scale_v(y);
-    Painter::set_pixel(x, y, color);
+    Painter::set_pixel(x, y, color, mode);
   }
 
-  void ScaledPainter::draw_image(int x, int y, const Image &image)
+  void ScaledPainter::plot_points(
+    std::span<const Point> points, const Color &color, BlendMode mode)
+  {
+    scale_points(points);
+    Painter::plot_points(scaled_points, color, mode);
+  }
+
+  void ScaledPainter::plot_points(
+    std::span<const Point> points, std::span<const Color> colors,
+    BlendMode mode)
+  {
+    scale_points(points);
+    Painter::plot_points(scaled_points, colors, mode);
+  }
+
+  void ScaledPainter::draw_image(
+    int x, int y, const ImageView &image, BlendMode mode)
   {
     x = this->scale_h(x);
     y = this->scale_v(y);
     Painter::draw_image(
-      x, y, image, (double)(this->x_scaler), (double)(this->y_scaler));
+      x, y, image, (double)(this->x_scaler), (double)(this->y_scaler), mode);
   }
 
   void ScaledPainter::draw_image(
-    int x, int y, const Image &image, double scale_x, double scale_y)
+    int x, int y, const ImageView &image, ImageFlip flip, BlendMode mode)
+  {
+    const bool flip_x =
+      flip == ImageFlip::Horizontal || flip == ImageFlip::Both;
+    const bool flip_y = flip == ImageFlip::Vertical || flip == ImageFlip::Both;
+
+    x = this->scale_h(x);
+    y = this->scale_v(y);
+    Painter::draw_image(
+      x,
+      y,
+      image,
+      flip_x ? -(double)(this->x_scaler) : (double)(this->x_scaler),
+      flip_y ? -(double)(this->y_scaler) : (double)(this->y_scaler),
+      mode);
+  }
+
+  void ScaledPainter::draw_image(
+    int x, int y, const ImageView &image, const Rect &source, BlendMode mode)
+  {
+    BasicPainter<BlendSink, FactorScaler> painter(
+      *get_target(),
+      get_clip(),
+      BlendSink { mode, image.get_format() },
+      FactorScaler { x_scaler, y_scaler });
+    mark_changed(painter.draw_image(x, y, image, source));
+  }
+
+  void ScaledPainter::draw_image_affine(
+    const ImageView &image, const glm::mat3 &transform, BlendMode mode,
+    ScaleFilter filter)
+  {
+    glm::mat3 scale(1.0f);
+    scale[0][0] = x_scaler;
+    scale[1][1] = y_scaler;
+    Painter::draw_image_affine(image, scale * transform, mode, filter);
+  }
+
+  void ScaledPainter::draw_image(
+    int x, int y, const ImageView &image, double scale_x, double scale_y,
+    BlendMode mode, ScaleFilter filter)
   {
     x = this->scale_h(x);
     y = this->scale_v(y);
     scale_x = this->scale_h(scale_x);
     scale_y = this->scale_v(scale_y);
-    Painter::draw_image(x, y, image, scale_x, scale_y);
+    Painter::draw_image(x, y, image, scale_x, scale_y, mode, filter);
   }
 
   void ScaledPainter::draw_image(
-    int x, int y, const Image &image, int width, int height)
+    int x, int y, const ImageView &image, int width, int height,
+    AspectRatioOptions aspect_ratio_options, BlendMode mode,
+    ScaleFilter filter)
   {
     x = this->scale_h(x);
     y = this->scale_v(y);
     width = this->scale_h(width);
     height = this->scale_v(height);
-    Painter::draw_image(x, y, image, width, height);
+    Painter::draw_image(
+      x, y, image, width, height, aspect_ratio_options, mode, filter);
+  }
+
+  void ScaledPainter::draw_text(
+    int x, int y, const Font &font, std::string_view text, const Color &color,
+    BlendMode mode)
+  {
+    const Rect clip = get_clip();
+    Rect changed;
+
+    font.for_each_glyph(text, [&](int gx, int gy, const Font::Glyph &g) {
+      const int left = x + gx;
+      const int top = y + gy;
+      const int x1 = scale_h(left);
+      const int y1 = scale_v(top);
+      const int width = scale_h(left + g.width) - x1;
+      const int height = scale_v(top + g.height) - y1;
+      const Rect rect(x1, y1, width, height);
+      if (!rect.intersects(clip))
+        return;
+
+      // glyph rows are scaled once and repeated
+      scaled_coverage.resize((size_t)width * height);
+      const uint8_t *src = font.coverage(g);
+      for (int j = 0; j < g.height; ++j, src += g.width)
+      {
+        const int row1 = scale_v(top + j) - y1;
+        const int row2 = scale_v(top + j + 1) - y1;
+        if (row1 >= row2)
+          continue;
+
+        uint8_t *row = scaled_coverage.data() + (size_t)row1 * width;
+        for (int i = 0; i < g.width; ++i)
+        {
+          const int column1 = scale_h(left + i) - x1;
+          const int column2 = scale_h(left + i + 1) - x1;
+          std::fill(row + column1, row + column2, src[i]);
+        }
+        for (int r = row1 + 1; r < row2; ++r)
+        {
+          std::copy(row, row + width, row + (size_t)(r - row1) * width);
+        }
+      }
+
+      changed = changed.united(blend_coverage(
+        clip, rect, scaled_coverage.data(), width, color, mode));
+    });
+    mark_changed(changed);
   }
 
   void ScaledPainter::draw_line(
-    int x1, int y1, int x2, int y2, const Color &color)
+    int x1, int y1, int x2, int y2, const Color &color, BlendMode mode)
   {
     x1 = this->scale_h(x1);
     x2 = this->scale_h(x2);
     y1 = this->scale_v(y1);
     y2 = this->scale_v(y2);
-    Painter::draw_line(x1, y1, x2, y2, color);
+    Painter::draw_line(x1, y1, x2, y2, color, mode);
+  }
+
+  void ScaledPainter::scale_points(std::span<const Point> points)
+  {
+    scaled_points.resize(points.size());
+    for (size_t i = 0; i < points.size(); ++i)
+    {
+      scaled_points[i].x = this->scale_h(points[i].x);
+      scaled_points[i].y = this->scale_v(points[i].y);
+    }
+  }
+
+  void ScaledPainter::draw_polyline(
+    std::span<const Point> points, const Color &color, BlendMode mode)
+  {
+    scale_points(points);
+    Painter::draw_polyline(scaled_points, color, mode);
   }
 
   void ScaledPainter::draw_rectangle(
-    int x1, int y1, int x2, int y2, const Color &color)
+    int x1, int y1, int x2, int y2, const Color &color, BlendMode mode)
   {
     x1 = this->scale_h(x1);
     x2 = this->scale_h(x2);
     y1 = this->scale_v(y1);
     y2 = this->scale_v(y2);
-    Painter::draw_rectangle(x1, y1, x2, y2, color);
+    Painter::draw_rectangle(x1, y1, x2, y2, color, mode);
   }
 
-  void ScaledPainter::draw_circle(int x, int y, int radius, const Color &color)
+  void ScaledPainter::draw_circle(
+    int x, int y, int radius, const Color &color, BlendMode mode)
   {
     x = this->scale_h(x);
+    y = this->scale_v(y);
+    radius = this->scale_v(radius);
+    Painter::draw_circle(x, y, radius, color, mode);
+  }
+
+  void ScaledPainter::fill_rectangle(
+    int x1, int y1, int x2, int y2, const Color &color, BlendMode mode)
+  {
+    x1 = this->scale_h(x1);
+    x2 = this->scale_h(x2);
+    y1 = this->scale_v(y1);
+    y2 = this->scale_v(y2);
+    Painter::fill_rectangle(x1, y1, x2, y2, color, mode);
+  }
+
+  void ScaledPainter::fill_circle(
+    int x, int y, int radius, const Color &color, BlendMode mode)
+  {
     x = this->scale_h(x);
+    y = this->scale_v(y);
     radius = this->scale_v(radius);
-    Painter::draw_circle(x, y, radius, color);
+    Painter::fill_circle(x, y, radius, color, mode);
+  }
+
+  void ScaledPainter::fill_triangle(
+    int x1, int y1, int x2, int y2, int x3, int y3, const Color &color,
+    BlendMode mode)
+  {
+    x1 = this->scale_h(x1);
+    x2 = this->scale_h(x2);
+    x3 = this->scale_h(x3);
+    y1 = this->scale_v(y1);
+    y2 = this->scale_v(y2);
+    y3 = this->scale_v(y3);
+    Painter::fill_triangle(x1, y1, x2, y2, x3, y3, color, mode);
+  }
+
+  void ScaledPainter::fill_polygon(
+    std::span<const Point> points, const Color &color, BlendMode mode)
+  {
+    scale_points(points);
+    Painter::fill_polygon(scaled_points, color, mode);
+  }
+
+  void ScaledPainter::fill_path(
+    const Path &path, const Color &color, FillRule rule, BlendMode mode)
+  {
+    Painter::fill_path(path.scaled(x_scaler, y_scaler), color, rule, mode);
+  }
+
+  void ScaledPainter::stroke_path(
+    const Path &path, float width, const Color &color, BlendMode mode)
+  {
+    // width follows the vertical scale, as circle radius does
+    Painter::stroke_path(
+      path.scaled(x_scaler, y_scaler), this->scale_v(width), color, mode);
   }
 } // namespace ZD
@@ -11,14 +11,72 @@ namespace ZD
     ScaledPainter(std::shared_ptr<Image> image, float x_scaler, float y_scaler);
     ScaledPainter(std::shared_ptr<Image> image, float scaler);
 
-    void set_pixel(int x, int y, const Color &color);
-    void draw_image(int x, int y, const Image &image);
+    void set_pixel(
+      int x, int y, const Color &color, BlendMode mode = BlendMode::Replace);
+    // points are moved, but stay single pixels
+    void plot_points(
+      std::span<const Point> points, const Color &color,
+      BlendMode mode = BlendMode::Replace);
+    void plot_points(
+      std::span<const Point> points, std::span<const Color> colors,
+      BlendMode mode = BlendMode::Replace);
     void draw_image(
-      int x, int y, const Image &image, double scale_x, double scale_y);
-    void draw_image(int x, int y, const Image &image, int width, int height);
-    void draw_line(int x1, int y1, int x2, int y2, const Color &color);
-    void draw_rectangle(int x1, int y1, int x2, int y2, const Color &color);
-    void draw_circle(int x, int y, int radius, const Color &color);
+      int x, int y, const ImageView &image,
+      BlendMode mode = BlendMode::ColorKey);
+    void draw_image(
+      int x, int y, const ImageView &image, ImageFlip flip,
+      BlendMode mode = BlendMode::ColorKey);
+    // every source pixel becomes a block of scaler size
+    void draw_image(
+      int x, int y, const ImageView &image, const Rect &source,
+      BlendMode mode = BlendMode::ColorKey);
+    void draw_image(
+      int x, int y, const ImageView &image, double scale_x, double scale_y,
+      BlendMode mode = BlendMode::ColorKey,
+      ScaleFilter filter = ScaleFilter::Nearest);
+    void draw_image(
+      int x, int y, const ImageView &image, int width, int height,
+      AspectRatioOptions aspect_ratio_options = NoPreserveAspectRatio,
+      BlendMode mode = BlendMode::ColorKey,
+      ScaleFilter filter = ScaleFilter::Nearest);
+    void draw_image_affine(
+      const ImageView &image, const glm::mat3 &transform,
+      BlendMode mode = BlendMode::ColorKey,
+      ScaleFilter filter = ScaleFilter::Nearest);
+    // every coverage pixel becomes a block of scaler size
+    void draw_text(
+      int x, int y, const Font &font, std::string_view text,
+      const Color &color, BlendMode mode = BlendMode::SrcOver);
+    void draw_line(
+      int x1, int y1, int x2, int y2, const Color &color,
+      BlendMode mode = BlendMode::Replace);
+    void draw_polyline(
+      std::span<const Point> points, const Color &color,
+      BlendMode mode = BlendMode::Replace);
+    void draw_rectangle(
+      int x1, int y1, int x2, int y2, const Color &color,
+      BlendMode mode = BlendMode::Replace);
+    void draw_circle(
+      int x, int y, int radius, const Color &color,
+      BlendMode mode = BlendMode::Replace);
+    void fill_rectangle(
+      int x1, int y1, int x2, int y2, const Color &color,
+      BlendMode mode = BlendMode::Replace);
+    void fill_circle(
+      int x, int y, int radius, const Color &color,
+      BlendMode mode = BlendMode::Replace);
+    void fill_triangle(
+      int x1, int y1, int x2, int y2, int x3, int y3, const Color &color,
+      BlendMode mode = BlendMode::Replace);
+    void fill_polygon(
+      std::span<const Point> points, const Color &color,
+      BlendMode mode = BlendMode::Replace);
+    void fill_path(
+      const Path &path, const Color &color,
+      FillRule rule = FillRule::NonZero, BlendMode mode = BlendMode::SrcOver);
+    void stroke_path(
+      const Path &path, float width, const Color &color,
+      BlendMode mode = BlendMode::SrcOver);
 
     void set_x_scaler(float n) { x_scaler = n; }
     void set_y_scaler(float n) { y_scaler = n; }
@@ -36,12 +94,17 @@ namespace ZD
     template<typename T>
     T scale_v(T v)
     {
-      return v * x_scaler;
+      return v * y_scaler;
     }
 
   private:
+    void scale_points(std::span<const Point> points);
+
     float x_scaler { 1.0 };
     float y_scaler { 1.0 };
+
+    std::vector<Point> scaled_points;
+    std::vector<uint8_t> scaled_coverage;
   };
 
 } // namespace ZD
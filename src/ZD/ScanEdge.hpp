@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+
+namespace ZD
+{
+  /*
+   *  Polygon edge walked one scanline at a time.
+   *  Pixels are sampled at their centers, so on row y the edge crosses
+   *  x = x0 + (y + 0.5 - y0) * (x1 - x0) / (y1 - y0).
+   *  boundary() is the first pixel with its center on or right of that
+   *  crossing, a span between two edges is [left.boundary(); right.boundary()).
+   *  Crossings are kept as exact fractions, so polygons sharing an edge
+   *  never overlap nor leave gaps between them.
+   * */
+  struct ScanEdge
+  {
+    int y_start { 0 }; // first row crossed by the edge
+    int y_end { 0 };   // row after the last one
+    int winding { 1 }; // 1 for edges going down, -1 for edges going up
+
+    // edge can't be horizontal (y0 != y1)
+    static ScanEdge create(int x0, int y0, int x1, int y1)
+    {
+      ScanEdge e;
+      if (y1 < y0)
+      {
+        std::swap(x0, x1);
+        std::swap(y0, y1);
+        e.winding = -1;
+      }
+
+      const int64_t dx = (int64_t)x1 - x0;
+      const int64_t dy = (int64_t)y1 - y0;
+
+      e.y_start = y0;
+      e.y_end = y1;
+      e.denominator = 2 * dy;
+      e.start_numerator = 2 * dy * x0 + dx - dy;
+      e.step_numerator = 2 * dx;
+      e.step_q = floor_div(e.step_numerator, e.denominator);
+      e.step_r = e.step_numerator - e.step_q * e.denominator;
+      e.set_row(y0);
+      return e;
+    }
+
+    // moves the edge to row y
+    void set_row(const int y)
+    {
+      const int64_t n =
+        start_numerator + (int64_t)(y - y_start) * step_numerator;
+      q = floor_div(n, denominator);
+      r = n - q * denominator;
+    }
+
+    // moves the edge to the next row
+    void step()
+    {
+      q += step_q;
+      r += step_r;
+      if (r >= denominator)
+      {
+        r -= denominator;
+        q++;
+      }
+    }
+
+    int boundary() const { return q + (r > 0); }
+
+  private:
+    static int64_t floor_div(const int64_t a, const int64_t b)
+    {
+      const int64_t d = a / b;
+      return (a % b != 0 && (a < 0) != (b < 0)) ? d - 1 : d;
+    }
+
+    // crossing - 0.5 == (q * denominator + r) / denominator
+    // where 0 <= r < denominator
+    int64_t q { 0 };
+    int64_t r { 0 };
+    int64_t denominator { 1 };
+    int64_t start_numerator { 0 };
+    int64_t step_numerator { 0 };
+    int64_t step_q { 0 };
+    int64_t step_r { 0 };
+  };
+
+} // namespace ZD
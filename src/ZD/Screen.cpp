@@ -12,14 +12,108 @@ namespace ZD
   , y { y }
   , width { width }
   , height { height }
-  , canvas_image { Image::create(Size(width, height), PixelFormat::RGBA) }
-  , image_painter { std::make_shared<Painter>(canvas_image) }
+  , canvas { create_buffer() }
+  , front { canvas }
   {
   }
 
+  Screen::CanvasBuffer Screen::create_buffer() const
+  {
+    auto image = Image::create(Size(width, height), PixelFormat::RGBA);
+    return { image, std::make_shared<Painter>(image) };
+  }
+
+  std::shared_ptr<Image> Screen::image()
+  {
+    if (buffering == CanvasBuffering::Single)
+      return canvas.image;
+
+    std::unique_lock<std::mutex> lock(buffers_mutex);
+    wait_for_canvas(lock);
+    return canvas.image;
+  }
+
+  std::shared_ptr<Painter> Screen::painter()
+  {
+    if (buffering == CanvasBuffering::Single)
+      return canvas.painter;
+
+    std::unique_lock<std::mutex> lock(buffers_mutex);
+    wait_for_canvas(lock);
+    return canvas.painter;
+  }
+
+  void Screen::wait_for_canvas(std::unique_lock<std::mutex> &lock)
+  {
+    if (buffering != CanvasBuffering::Double || !frame_ready)
+      return;
+
+    // the rendering thread would wait for itself, it paints over the presented frame instead
+    if (std::this_thread::get_id() == render_thread)
+    {
+      frame_ready = false;
+      return;
+    }
+
+    // with two buffers the presented one is painted again only after render swaps it
+    frame_taken.wait(lock, [this]() { return buffering != CanvasBuffering::Double || !frame_ready; });
+  }
+
+  void Screen::set_buffering(CanvasBuffering new_buffering)
+  {
+    std::scoped_lock<std::mutex> lock(buffers_mutex);
+    buffering = new_buffering;
+    frame_ready = false;
+    front = canvas;
+    ready = {};
+    if (buffering != CanvasBuffering::Single)
+      front = create_buffer();
+    if (buffering == CanvasBuffering::Triple)
+      ready = create_buffer();
+    frame_taken.notify_all();
+  }
+
+  void Screen::present_frame()
+  {
+    std::scoped_lock<std::mutex> lock(buffers_mutex);
+    if (buffering == CanvasBuffering::Single)
+      return;
+
+    // a frame presented before the previous one was rendered replaces it
+    frame_ready = true;
+    if (buffering == CanvasBuffering::Triple)
+    {
+      std::swap(canvas, ready);
+    }
+  }
+
+  bool Screen::take_presented_frame()
+  {
+    std::scoped_lock<std::mutex> lock(buffers_mutex);
+    render_thread = std::this_thread::get_id();
+    if (!frame_ready)
+      return false;
+
+    if (buffering == CanvasBuffering::Triple)
+    {
+      std::swap(front, ready);
+    }
+    else
+    {
+      std::swap(front, canvas);
+    }
+    frame_ready = false;
+    frame_taken.notify_all();
+
+    // changed areas were recorded against an older frame of the same buffer
+    front.image->mark_changed();
+    return true;
+  }
+
   Screen_GL::Screen_GL(std::shared_ptr<Texture> texture, int x, int y)
   : Screen(x, y, texture->get_width(), texture->get_height())
   , texture { texture }
+  , canvas_texture { false }
   {
     model = std::unique_ptr<Model>(new Model { ModelDefault::Screen });
 
@@ -33,14 +127,14 @@ namespace ZD
   : Screen(x, y, width, height)
   , shader_program { shader }
   {
-    texture = Texture::load(canvas_image);
+    texture = Texture::load(canvas.image);
     model = std::unique_ptr<Model>(new Model { ModelDefault::Screen });
   }
 
   Screen_GL::Screen_GL(int x, int y, int width, int height)
   : Screen(x, y, width, height)
   {
-    texture = Texture::load(canvas_image);
+    texture = Texture::load(canvas.image);
     model = std::unique_ptr<Model>(new Model { ModelDefault::Screen });
 
     shader_program = ShaderLoader()
@@ -51,6 +145,13 @@ namespace ZD
 
   void Screen_GL::render(const RenderTarget &target)
   {
+    // texture is sampled with GL_NEAREST, so pixels are just duplicated
+    if (pixel_scale > 0)
+    {
+      scale = ScreenScale(
+        (float)(width * pixel_scale) / target.get_width(), (float)(height * pixel_scale) / target.get_height());
+    }
+
     shader_program->use();
 
     shader_program->set_uniform<glm::vec2>("view_size", { target.get_width(), target.get_height() });
@@ -58,14 +159,27 @@ namespace ZD
     shader_program->set_uniform<glm::vec2>("screen_scale", { scale.x, scale.y });
     shader_program->set_uniform<int>("flip_y", flip_y);
 
-    //printf("image=%p changes=%d\n", &canvas_image, canvas_image->change_counter());
-    if (canvas_image && canvas_image->is_changed())
+    //printf("image=%p changes=%d\n", &canvas.image, canvas.image->change_counter());
+    frame_changed = false;
+    if (texture && texture->has_change_detection() != detect_changes)
+    {
+      texture->set_change_detection(detect_changes);
+    }
+
+    // painting goes on in the back buffer meanwhile, only the front one is touched below
+    take_presented_frame();
+    if (texture && canvas_texture && texture->get_image() != front.image)
+    {
+      texture->replace_image(front.image);
+    }
+
+    if (front.image && (detect_changes || front.image->is_changed()))
     {
       if (texture)
       {
-        texture->update();
+        frame_changed = texture->update();
       }
-      canvas_image->reset_change_counter();
+      front.image->reset_change_counter();
     }
 
     if (!enabled)
@@ -1,5 +1,11 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
@@ -26,14 +32,50 @@ namespace ZD
     float y { 1.0f };
   };
 
+  // number of canvas images, see Screen::set_buffering
+  enum class CanvasBuffering
+  {
+    Single = 1,
+    Double = 2,
+    Triple = 3
+  };
+
   class Screen
   {
   public:
     Screen(int x, int y, int width, int height);
     virtual ~Screen() = default;
-    std::shared_ptr<Image> image() { return canvas_image; }
-    std::shared_ptr<Painter> painter() { return image_painter; }
+    /*
+     *  Canvas painted on (the back buffer when buffered) and its painter, see present_frame.
+     *  Every buffer has its own painter, so painter state (clip, viewport) isn't carried over
+     *  from one buffer to the next. Without buffering the canvas never changes and they
+     *  return it without locking.
+     * */
+    std::shared_ptr<Image> image();
+    std::shared_ptr<Painter> painter();
     virtual void render(const RenderTarget &) = 0;
+
+    /*
+     *  With more than one canvas image painting goes to a back buffer while render uploads
+     *  the front one, so a painting thread and the rendering thread don't wait for each other.
+     *  Finished frames are handed over with present_frame and swapped to the front at render,
+     *  frames which aren't presented are never shown. Triple buffering never blocks painting,
+     *  with Double painter() and image() wait until render takes the presented frame.
+     *  Called on the thread which renders they don't wait, the next frame is painted over
+     *  the presented one instead. Before the first render that thread isn't known yet, so
+     *  a single threaded program with Double buffering has to render between present_frame
+     *  and painter() (or use Triple buffering).
+     *  Back buffers keep older frames, so every frame has to be painted whole.
+     *  Call it before painting and rendering start.
+     * */
+    void set_buffering(CanvasBuffering new_buffering);
+    CanvasBuffering get_buffering() const { return buffering; }
+    /*
+     *  Hands the finished back buffer over to render, called by the painting thread.
+     *  Painter and image have to be taken again (painter(), image()) before painting
+     *  the next frame. Does nothing without buffering.
+     * */
+    void present_frame();
     int center_x() const { return x + width / 2; }
     int center_y() const { return y + height / 2; }
     int left() const { return x; }
@@ -43,8 +85,32 @@ namespace ZD
     int x { 0 }, y { 0 };
     ScreenScale scale;
 
+    /*
+     *  Whole number of render target pixels per canvas pixel, 0 turns it off.
+     *  The canvas keeps its logical resolution (e.g. 320x180) and is upscaled when rendered,
+     *  `scale` is recomputed from it for the render target every frame.
+     * */
+    int pixel_scale { 0 };
+    // largest pixel_scale at which the whole canvas fits into the target
+    int max_pixel_scale(const RenderTarget &target) const
+    {
+      return std::max(1, std::min(target.get_width() / width, target.get_height() / height));
+    }
+
     bool flip_y { false };
 
+    /*
+     *  Finds changes by comparing every frame with the previously uploaded one, instead of
+     *  trusting the canvas change counter (see Texture::set_change_detection).
+     *  For canvases written directly, e.g. with Image::set_data.
+     * */
+    bool detect_changes { false };
+    /*
+     *  Whether the last render uploaded new pixels. Static screens can skip rendering
+     *  and swapping buffers while it is false.
+     * */
+    bool is_frame_changed() const { return frame_changed; }
+
     int get_width() const { return width; }
     int get_height() const { return height; }
 
@@ -53,10 +119,32 @@ namespace ZD
     void enable() { enabled = true; }
 
   protected:
+    /*
+     *  Swaps a presented frame to the front, called by render. Returns false when there
+     *  is no new frame (always without buffering).
+     * */
+    bool take_presented_frame();
+    void wait_for_canvas(std::unique_lock<std::mutex> &lock);
+
+    // canvas image with the painter painting on it, they are swapped together
+    struct CanvasBuffer
+    {
+      std::shared_ptr<Image> image;
+      std::shared_ptr<Painter> painter;
+    };
+    CanvasBuffer create_buffer() const;
+
     int width, height;
     bool enabled { true };
-    std::shared_ptr<Image> canvas_image;
-    std::shared_ptr<Painter> image_painter;
+    bool frame_changed { true };
+    std::atomic<CanvasBuffering> buffering { CanvasBuffering::Single };
+    CanvasBuffer canvas; // painted on
+    CanvasBuffer front; // rendered, the canvas itself without buffering
+    CanvasBuffer ready; // presented and not rendered yet (triple buffering)
+    bool frame_ready { false };
+    std::thread::id render_thread; // calling take_presented_frame, none before the first one
+    std::mutex buffers_mutex;
+    std::condition_variable frame_taken;
   };
 
   class Screen_GL : public Screen
@@ -69,6 +157,7 @@ namespace ZD
 
   private:
     std::shared_ptr<Texture> texture;
+    bool canvas_texture { true }; // texture shows the canvas, it follows the front buffer
     std::unique_ptr<Model> model;
     std::shared_ptr<ShaderProgram> shader_program;
 
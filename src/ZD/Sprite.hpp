@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Image.hpp"
+#include "ImageView.hpp"
 #include "Model.hpp"
 #include "Texture.hpp"
 #include "Shader.hpp"
@@ -46,6 +47,12 @@ namespace ZD
     virtual void render(const RenderTarget &);
 
     std::shared_ptr<Image> get_image() const { return this->image; }
+    // current frame of the sheet, e.g. for drawing it with Painter
+    ImageView get_frame_view() const
+    {
+      return ImageView(
+        *image, Rect(frame * frame_size.width(), 0, frame_size.width(), frame_size.height()));
+    }
 
     /* 
    *  Changing image and texture to new image.
@@ -5,6 +5,7 @@
 #include <GLFW/glfw3.h>
 
 #include "OpenGLRenderer.hpp"
+#include "TiledImage.hpp"
 
 namespace ZD
 {
@@ -45,6 +46,24 @@ namespace ZD
     return Texture::load(Image::load(image_name), params, reload);
   }
 
+  std::shared_ptr<Texture> Texture::create(const Size &size, const TextureParameters params)
+  {
+    std::shared_ptr<Texture> texture { new Texture { params } };
+    texture->width = size.width();
+    texture->height = size.height();
+    glBindTexture(GL_TEXTURE_2D, texture->id);
+    glTexImage2D(
+      GL_TEXTURE_2D, 0, GL_RGBA8, size.width(), size.height(), 0, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8, nullptr);
+    return texture;
+  }
+
+  std::shared_ptr<Texture> Texture::create(const ImageView &view, const TextureParameters params)
+  {
+    std::shared_ptr<Texture> texture = create(view.get_size(), params);
+    texture->upload(view);
+    return texture;
+  }
+
   Texture::Texture(const TextureParameters params)
   : texture_wrap { params.wrap }
   , generate_mipmap { params.generate_mipmap }
@@ -102,6 +121,7 @@ namespace ZD
     if (!image)
       return;
 
+    const uint32_t *pixels = image_pixels();
     glBindTexture(GL_TEXTURE_2D, this->id);
     glTexImage2D(
       GL_TEXTURE_2D,
@@ -112,19 +132,19 @@ namespace ZD
       0,
       GL_BGRA,
       GL_UNSIGNED_INT_8_8_8_8,
-      &image->get_data()[0]);
+      pixels);
 
     if (pbo[0] > 0)
     {
       glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo[0]);
       glBufferData(
-        GL_PIXEL_UNPACK_BUFFER, image->get_size().area() * sizeof(uint32_t), image->get_data(), GL_STREAM_DRAW);
+        GL_PIXEL_UNPACK_BUFFER, image->get_size().area() * sizeof(uint32_t), pixels, GL_STREAM_DRAW);
     }
     if (pbo[1] > 0)
     {
       glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo[1]);
       glBufferData(
-        GL_PIXEL_UNPACK_BUFFER, image->get_size().area() * sizeof(uint32_t), image->get_data(), GL_STREAM_DRAW);
+        GL_PIXEL_UNPACK_BUFFER, image->get_size().area() * sizeof(uint32_t), pixels, GL_STREAM_DRAW);
     }
     glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
 
@@ -150,15 +170,134 @@ namespace ZD
     {
       set_buffer_data();
     }
-    update();
+    if (frame_diff)
+    {
+      frame_diff->reset();
+      update();
+      return;
+    }
+    update_all();
+  }
+
+  void Texture::set_change_detection(bool enabled)
+  {
+    if (!enabled)
+    {
+      frame_diff.reset();
+      return;
+    }
+
+    if (!frame_diff)
+    {
+      frame_diff = std::make_unique<FrameDiff>();
+    }
   }
 
-  void Texture::update()
+  /*
+   *  Partially changed images upload only their changed rectangles, straight from image memory.
+   *  Pixel buffers are used for whole image uploads only, they lag one update behind,
+   *  so partial uploads wait until the pending buffer is flushed (see bind).
+   *  With change detection rectangles come from comparing frames, the first one covers
+   *  the whole image.
+   * */
+  bool Texture::update()
   {
     if (!image)
+      return false;
+
+    if (frame_diff)
+    {
+      const uint32_t *pixels = image_pixels();
+      const auto &rects = frame_diff->compare(pixels, image->get_size());
+      if (rects.empty())
+        return false;
+
+      update_rects(pixels, rects);
+      return true;
+    }
+
+    const bool pbo_pending = pbo[0] > 0 && frame % 2 == 1;
+    if (image->is_partially_changed() && !pbo_pending)
+    {
+      update_rects(image_pixels(), image->get_changed_rects());
+      return true;
+    }
+
+    update_all();
+    return true;
+  }
+
+  void Texture::update_rects(const uint32_t *pixels, const std::vector<Rect> &rects)
+  {
+    const int image_width = image->width();
+
+    glBindTexture(GL_TEXTURE_2D, this->id);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, image_width);
+
+    for (const auto &rect : rects)
+    {
+      glTexSubImage2D(
+        GL_TEXTURE_2D,
+        0,
+        rect.left(),
+        rect.top(),
+        rect.width(),
+        rect.height(),
+        GL_BGRA,
+        GL_UNSIGNED_INT_8_8_8_8,
+        pixels + rect.left() + rect.top() * image_width);
+    }
+
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+    if (generate_mipmap)
+    {
+      glGenerateMipmap(GL_TEXTURE_2D);
+    }
+  }
+
+  void Texture::upload(const ImageView &view, int x, int y)
+  {
+    if (view.is_empty())
       return;
 
-    auto *data_ptr = &image->get_data()[0];
+    const int view_width = view.width();
+    const uint32_t *pixels = view.get_data();
+    int row_length = view.stride();
+    if (view.is_compact())
+    {
+      expanded_pixels.resize(view.get_size().area());
+      for (int row = 0; row < view.height(); row++)
+      {
+        view.get_pixels(0, row, view_width, expanded_pixels.data() + (long)row * view_width);
+      }
+      pixels = expanded_pixels.data();
+      row_length = view_width;
+    }
+
+    glBindTexture(GL_TEXTURE_2D, this->id);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, row_length);
+    glTexSubImage2D(
+      GL_TEXTURE_2D, 0, x, y, view_width, view.height(), GL_BGRA, GL_UNSIGNED_INT_8_8_8_8, pixels);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+    if (generate_mipmap)
+    {
+      glGenerateMipmap(GL_TEXTURE_2D);
+    }
+  }
+
+  void Texture::upload(TiledImage &image, const Rect &window)
+  {
+    image.for_each_part(window, [&](const ImageView &part, int x, int y) {
+      upload(part, x - window.left(), y - window.top());
+    });
+  }
+
+  void Texture::update_all()
+  {
+    const uint32_t *pixels = image_pixels();
+    auto *data_ptr = pixels;
 
     if (pbo[frame % 2] > 0)
     {
@@ -190,7 +329,7 @@ namespace ZD
       auto *pbo_ptr = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
       if (pbo_ptr)
       {
-        memcpy(pbo_ptr, &image->get_data()[0], image->get_size().area() * sizeof(uint32_t));
+        memcpy(pbo_ptr, pixels, image->get_size().area() * sizeof(uint32_t));
         glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
       }
       glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
@@ -198,6 +337,21 @@ namespace ZD
     }
   }
 
+  const uint32_t *Texture::image_pixels()
+  {
+    if (!image->is_compact())
+      return image->get_data();
+
+    const int image_width = image->width();
+    expanded_pixels.resize(image->get_size().area());
+    for (int y = 0; y < image->height(); y++)
+    {
+      uint32_t *row = expanded_pixels.data() + (long)y * image_width;
+      image->get_pixels(0, y, image_width, row);
+    }
+    return expanded_pixels.data();
+  }
+
   void Texture::bind(const ShaderProgram &shader, GLuint sampler_id, std::string_view sampler_name)
   {
     glActiveTexture(GL_TEXTURE0 + sampler_id);
@@ -217,7 +371,7 @@ namespace ZD
 
     glCheckError();
 
-    if (frame % 2 == 1)
+    if (frame % 2 == 1 && !frame_diff)
     {
       update();
     }
@@ -1,14 +1,19 @@
 #pragma once
 #include <memory>
+#include <vector>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
+#include "FrameDiff.hpp"
 #include "Image.hpp"
+#include "ImageView.hpp"
 #include "Shader.hpp"
 #include "File.hpp"
 
 namespace ZD
 {
+  class TiledImage;
+
   struct TextureWrap
   {
     float x { 1 }, y { 1 };
@@ -33,14 +38,47 @@ namespace ZD
     static std::shared_ptr<Texture> load(
       const std::string image_name, const TextureParameters params = TextureParameters {},
       ForceReload reload = ForceReload::No);
+    // texture of the size with undefined pixels, to be filled with upload
+    static std::shared_ptr<Texture> create(
+      const Size &size, const TextureParameters params = TextureParameters {});
+    // texture of the view size with a copy of its pixels, e.g. for an atlas entry
+    static std::shared_ptr<Texture> create(
+      const ImageView &view, const TextureParameters params = TextureParameters {});
 
     virtual ~Texture();
 
-    void update();
+    // returns false if nothing had to be uploaded
+    bool update();
     void bind(const ShaderProgram &shader, GLuint sampler_id = 0, std::string_view sampler_name = "sampler");
 
+    /*
+     *  Uploads the view with its top left corner at (x, y), straight from the viewed rows
+     *  (GL_UNPACK_ROW_LENGTH is set to the view stride). The next update of the texture
+     *  image overwrites the uploaded pixels.
+     * */
+    void upload(const ImageView &view, int x = 0, int y = 0);
+    /*
+     *  Uploads the window of a tiled image (e.g. the visible part of a huge map) with its top
+     *  left corner at (0, 0), tile by tile. Only tiles under the window are read.
+     * */
+    void upload(TiledImage &image, const Rect &window);
+
     void set_name(const std::string name) { this->name = name; }
     void set_image(std::shared_ptr<Image> new_image);
+    // switches to an image of the same size without uploading it (e.g. buffers of a Screen)
+    void replace_image(std::shared_ptr<Image> new_image)
+    {
+      assert(image && new_image->get_size() == image->get_size());
+      image = new_image;
+    }
+
+    /*
+     *  Compares every update with the previously uploaded frame (see FrameDiff) and uploads
+     *  only tiles which differ, for images changed without marking them. Keeps a copy of
+     *  the image, pixel buffers aren't used meanwhile.
+     * */
+    void set_change_detection(bool enabled);
+    bool has_change_detection() const { return frame_diff != nullptr; }
 
     GLuint get_id() const { return id; }
     const std::string &get_name() const { return name; }
@@ -54,9 +92,15 @@ namespace ZD
 
     void generate(const TextureParameters params);
     void set_buffer_data();
+    void update_all();
+    void update_rects(const uint32_t *pixels, const std::vector<Rect> &rects);
+    // pixels to upload, compact images are expanded (see Image)
+    const uint32_t *image_pixels();
     bool set_uniform(const ShaderUniform &uniform);
 
     std::shared_ptr<Image> image;
+    std::vector<uint32_t> expanded_pixels;
+    std::unique_ptr<FrameDiff> frame_diff;
     TextureWrap texture_wrap { 1.0f, 1.0f };
     bool generate_mipmap { false };
 
@@ -0,0 +1,281 @@
+#include "TiledImage.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ImagePool.hpp"
+#include "Painter.hpp"
+
+#pragma GCC optimize("O3")
+
+namespace ZD
+{
+  // at the beginning of the file, followed by the tiles row by row
+  struct TiledImageHeader
+  {
+    char magic[4];
+    uint32_t version;
+    int32_t width;
+    int32_t height;
+    int32_t tile_size;
+    int32_t format;
+  };
+
+  static constexpr char TILED_IMAGE_MAGIC[4] = { 'Z', 'D', 'T', 'I' };
+  static constexpr uint32_t TILED_IMAGE_VERSION = 1;
+
+  static size_t tile_count(const Size &size, int tile_size)
+  {
+    const size_t tiles_x = (size.width() + tile_size - 1) / tile_size;
+    const size_t tiles_y = (size.height() + tile_size - 1) / tile_size;
+    return tiles_x * tiles_y;
+  }
+
+  TiledImage::TiledImage(
+    int fd, const Size &size, PixelFormat::Type format, bool read_only,
+    size_t max_resident_tiles)
+  : fd { fd }
+  , size { size }
+  , format { format }
+  , read_only { read_only }
+  , tiles_x { (size.width() + TILE_SIZE - 1) / TILE_SIZE }
+  , max_resident_tiles { std::max<size_t>(max_resident_tiles, 1) }
+  {
+  }
+
+  std::shared_ptr<TiledImage> TiledImage::create(
+    const std::string &path, const Size &size, PixelFormat::Type format,
+    size_t max_resident_tiles)
+  {
+    assert(PixelFormat::get_pixel_bytes(format) == 4);
+    if (size.width() <= 0 || size.height() <= 0)
+      return nullptr;
+
+    const int fd = ::open(path.data(), O_RDWR | O_CREAT | O_TRUNC, 0660);
+    if (fd == -1)
+    {
+      perror("TiledImage create");
+      fprintf(stderr, "Cannot create tiled image '%s'!\n", path.data());
+      return nullptr;
+    }
+
+    TiledImageHeader header {};
+    memcpy(header.magic, TILED_IMAGE_MAGIC, sizeof(header.magic));
+    header.version = TILED_IMAGE_VERSION;
+    header.width = size.width();
+    header.height = size.height();
+    header.tile_size = TILE_SIZE;
+    header.format = format;
+
+    // the file is extended without writing, tiles read as zeros
+    const off_t file_size =
+      HEADER_BYTES + tile_count(size, TILE_SIZE) * TILE_BYTES;
+    const bool written =
+      pwrite(fd, &header, sizeof(header), 0) == sizeof(header) &&
+      ftruncate(fd, file_size) == 0;
+    if (!written)
+    {
+      perror("TiledImage create");
+      fprintf(stderr, "Cannot write tiled image '%s'!\n", path.data());
+      close(fd);
+      return nullptr;
+    }
+
+    return std::shared_ptr<TiledImage>(
+      new TiledImage(fd, size, format, false, max_resident_tiles));
+  }
+
+  std::shared_ptr<TiledImage> TiledImage::open(
+    const std::string &path, File::OpenMode mode, size_t max_resident_tiles)
+  {
+    const bool read_only = mode == File::Read;
+    const int fd = ::open(path.data(), read_only ? O_RDONLY : O_RDWR);
+    if (fd == -1)
+    {
+      perror("TiledImage open");
+      fprintf(stderr, "Cannot open tiled image '%s'!\n", path.data());
+      return nullptr;
+    }
+
+    TiledImageHeader header {};
+    struct stat file_stat;
+    bool valid = pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+                 fstat(fd, &file_stat) == 0 &&
+                 memcmp(header.magic, TILED_IMAGE_MAGIC, 4) == 0 &&
+                 header.version == TILED_IMAGE_VERSION &&
+                 header.tile_size == TILE_SIZE && header.width > 0 &&
+                 header.height > 0 &&
+                 PixelFormat::get_pixel_bytes(
+                   (PixelFormat::Type)(header.format)) == 4;
+
+    const Size size(header.width, header.height);
+    valid = valid && (size_t)(file_stat.st_size) >=
+                       HEADER_BYTES + tile_count(size, TILE_SIZE) * TILE_BYTES;
+    if (!valid)
+    {
+      fprintf(stderr, "File '%s' isn't a tiled image!\n", path.data());
+      close(fd);
+      return nullptr;
+    }
+
+    return std::shared_ptr<TiledImage>(new TiledImage(
+      fd,
+      size,
+      (PixelFormat::Type)(header.format),
+      read_only,
+      max_resident_tiles));
+  }
+
+  TiledImage::~TiledImage()
+  {
+    for (const auto &index_tile : resident)
+    {
+      munmap(index_tile.second.pixels, TILE_BYTES);
+    }
+    close(fd);
+  }
+
+  uint32_t *TiledImage::map_tile(int tile_x, int tile_y)
+  {
+    const size_t index = (size_t)(tile_y) * tiles_x + tile_x;
+    auto found = resident.find(index);
+    if (found != resident.end())
+    {
+      lru.splice(lru.begin(), lru, found->second.position);
+      return found->second.pixels;
+    }
+
+    if (resident.size() >= max_resident_tiles)
+      unmap_least_recent();
+
+    // pages are read when they are touched for the first time
+    const int protection = read_only ? PROT_READ : PROT_READ | PROT_WRITE;
+    void *mapping = mmap(
+      nullptr,
+      TILE_BYTES,
+      protection,
+      MAP_SHARED,
+      fd,
+      HEADER_BYTES + index * TILE_BYTES);
+    if (mapping == MAP_FAILED)
+    {
+      perror("TiledImage mmap");
+      return nullptr;
+    }
+
+    lru.push_front(index);
+    resident.emplace(index, Resident { (uint32_t *)(mapping), lru.begin() });
+    stats.mapped++;
+    return (uint32_t *)(mapping);
+  }
+
+  void TiledImage::unmap_least_recent()
+  {
+    const size_t index = lru.back();
+    lru.pop_back();
+    auto found = resident.find(index);
+    munmap(found->second.pixels, TILE_BYTES);
+    resident.erase(found);
+    stats.unmapped++;
+  }
+
+  void TiledImage::draw(
+    Painter &painter, int x, int y, const Rect &region, BlendMode mode)
+  {
+    // only the part landing inside of the clip is read
+    const Rect visible = painter.get_clip().intersected(
+      Rect(x, y, region.width(), region.height()));
+    const Rect source(
+      region.left() + visible.left() - x,
+      region.top() + visible.top() - y,
+      visible.width(),
+      visible.height());
+
+    for_each_part(source, [&](const ImageView &part, int px, int py) {
+      painter.draw_image(
+        x + px - region.left(), y + py - region.top(), part, mode);
+    });
+  }
+
+  std::shared_ptr<Image> TiledImage::read(const Rect &region)
+  {
+    const bool inside = Rect(0, 0, width(), height()).contains(region);
+    auto image = ImagePool::shared()->acquire(
+      Size(region.width(), region.height()),
+      format,
+      inside ? ZeroFill::No : ZeroFill::Yes);
+
+    auto output = image->view<uint32_t>();
+    for_each_tile(region, [&](uint32_t *pixels, const Rect &part) {
+      const int x = part.left() - region.left();
+      for (int row = 0; row < part.height(); ++row)
+      {
+        const int y = part.top() - region.top() + row;
+        std::copy_n(
+          pixels + (ptrdiff_t)(row) * TILE_SIZE, part.width(), &output(x, y));
+      }
+    });
+    return image;
+  }
+
+  void TiledImage::write(int x, int y, const ImageView &source)
+  {
+    assert(!read_only);
+    const Rect region(x, y, source.width(), source.height());
+    std::vector<uint32_t> row_buffer;
+    if (source.is_compact())
+      row_buffer.resize(source.width());
+
+    for_each_tile(region, [&](uint32_t *pixels, const Rect &part) {
+      const int sx = part.left() - x;
+      for (int row = 0; row < part.height(); ++row)
+      {
+        const uint32_t *src = source.get_pixels(
+          sx, part.top() - y + row, part.width(), row_buffer.data());
+        std::copy_n(
+          src, part.width(), pixels + (ptrdiff_t)(row) * TILE_SIZE);
+      }
+    });
+  }
+
+  Color TiledImage::get_pixel(int x, int y)
+  {
+    Color color;
+    for_each_tile(Rect(x, y, 1, 1), [&](uint32_t *pixels, const Rect &) {
+      color = Color::from_value(*pixels);
+    });
+    return color;
+  }
+
+  void TiledImage::set_pixel(int x, int y, const Color &color)
+  {
+    assert(!read_only);
+    for_each_tile(Rect(x, y, 1, 1), [&](uint32_t *pixels, const Rect &) {
+      *pixels = color.value();
+    });
+  }
+
+  void TiledImage::flush()
+  {
+    for (const auto &index_tile : resident)
+    {
+      msync(index_tile.second.pixels, TILE_BYTES, MS_SYNC);
+    }
+  }
+
+  TiledImage::Stats TiledImage::get_stats() const
+  {
+    Stats current = stats;
+    current.resident_tiles = resident.size();
+    return current;
+  }
+
+} // namespace ZD
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "Color.hpp"
+#include "File.hpp"
+#include "Image.hpp"
+#include "ImageView.hpp"
+#include "Rect.hpp"
+#include "Size.hpp"
+
+namespace ZD
+{
+  class Painter;
+
+  /*
+   *  Image too big for memory (e.g. a 64k x 64k world map), stored in
+   *  a file as TILE_SIZE x TILE_SIZE tiles of 32 bit pixels. Tiles are
+   *  memory-mapped when they are used for the first time, at most
+   *  max_resident_tiles of them stay mapped and the least recently used
+   *  one is unmapped to make room. Pages of a mapped tile are read only when
+   *  touched, so opening a file is instant whatever its size. Changes are
+   *  written back by the system (see flush). Not safe to use from many
+   *  threads.
+   *
+   *  Parts are accessed as views of tiles (see for_each_part), which stay
+   *  valid until more than max_resident_tiles other tiles are mapped.
+   *  Painters drawing later (ParallelPainter) have to finish before that.
+   * */
+  class TiledImage
+  {
+  public:
+    static constexpr int TILE_SIZE = 256;
+    static constexpr size_t DEFAULT_MAX_RESIDENT_TILES = 256; // 64 MiB
+
+    struct Stats
+    {
+      size_t mapped { 0 }; // tiles mapped because they weren't resident
+      size_t unmapped { 0 }; // least recently used tiles unmapped
+      size_t resident_tiles { 0 };
+    };
+
+    /*
+     *  New file (an existing one is overwritten) with all pixels equal to 0.
+     *  Unwritten tiles take no disk space where sparse files are supported.
+     *  Returns null when the file can't be created.
+     * */
+    static std::shared_ptr<TiledImage> create(
+      const std::string &path, const Size &size,
+      PixelFormat::Type format = PixelFormat::BGRA,
+      size_t max_resident_tiles = DEFAULT_MAX_RESIDENT_TILES);
+    // null when the file can't be opened or isn't a tiled image
+    static std::shared_ptr<TiledImage> open(
+      const std::string &path, File::OpenMode mode = File::Read,
+      size_t max_resident_tiles = DEFAULT_MAX_RESIDENT_TILES);
+
+    TiledImage(const TiledImage &) = delete;
+    TiledImage &operator=(const TiledImage &) = delete;
+    ~TiledImage();
+
+    Size get_size() const { return size; }
+    int width() const { return size.width(); }
+    int height() const { return size.height(); }
+    PixelFormat::Type get_format() const { return format; }
+    bool is_read_only() const { return read_only; }
+
+    /*
+     *  Calls func(part, x, y) for parts of tiles covering the region, part
+     *  is a view of the tile pixels with its top left corner at (x, y) of
+     *  the image. Tiles are visited row by row.
+     * */
+    template<typename Func> void for_each_part(const Rect &region, Func func)
+    {
+      for_each_tile(region, [&](uint32_t *pixels, const Rect &part) {
+        const ImageView view(
+          pixels, part.width(), part.height(), TILE_SIZE, format);
+        func(view, part.left(), part.top());
+      });
+    }
+
+    // draws the region with its top left corner at (x, y), tiles outside
+    // of the painter's clip aren't touched
+    void draw(
+      Painter &painter, int x, int y, const Rect &region,
+      BlendMode mode = BlendMode::ColorKey);
+    // copy of the region, pixels outside of the image are 0
+    std::shared_ptr<Image> read(const Rect &region);
+    // copies the source with its top left corner at (x, y)
+    void write(int x, int y, const ImageView &source);
+
+    Color get_pixel(int x, int y);
+    void set_pixel(int x, int y, const Color &color);
+
+    // writes changed pages of resident tiles to the file and waits for it
+    void flush();
+    Stats get_stats() const;
+
+  private:
+    static constexpr size_t TILE_BYTES =
+      (size_t)(TILE_SIZE) * TILE_SIZE * sizeof(uint32_t);
+    // tiles start at a multiple of any page size
+    static constexpr size_t HEADER_BYTES = 64 << 10;
+
+    struct Resident
+    {
+      uint32_t *pixels;
+      std::list<size_t>::iterator position; // in lru
+    };
+
+    TiledImage(
+      int fd, const Size &size, PixelFormat::Type format, bool read_only,
+      size_t max_resident_tiles);
+
+    // null when the tile can't be mapped
+    uint32_t *map_tile(int tile_x, int tile_y);
+    void unmap_least_recent();
+
+    // func(pixels, part) for parts of tiles in the region, pixels point at
+    // the top left corner of the part and rows are TILE_SIZE pixels apart
+    template<typename Func> void for_each_tile(const Rect &region, Func func)
+    {
+      const Rect area = region.intersected(Rect(0, 0, width(), height()));
+      if (area.is_empty())
+        return;
+
+      for (int ty = area.top() / TILE_SIZE; ty * TILE_SIZE < area.bottom();
+           ++ty)
+      {
+        for (int tx = area.left() / TILE_SIZE; tx * TILE_SIZE < area.right();
+             ++tx)
+        {
+          const Rect tile(
+            tx * TILE_SIZE, ty * TILE_SIZE, TILE_SIZE, TILE_SIZE);
+          const Rect part = tile.intersected(area);
+          uint32_t *pixels = map_tile(tx, ty);
+          if (!pixels)
+            continue;
+
+          const int x = part.left() - tile.left();
+          const int y = part.top() - tile.top();
+          func(pixels + (ptrdiff_t)(y) * TILE_SIZE + x, part);
+        }
+      }
+    }
+
+    int fd;
+    Size size;
+    PixelFormat::Type format;
+    bool read_only;
+    int tiles_x;
+    size_t max_resident_tiles;
+
+    std::list<size_t> lru; // resident tile indices, most recently used first
+    std::unordered_map<size_t, Resident> resident;
+    Stats stats;
+  };
+
+} // namespace ZD
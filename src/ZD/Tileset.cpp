@@ -23,17 +23,7 @@ namespace ZD
     if (id_y < 0)
       return;
 
-    const auto img_w = source->width();
-    const auto source_data =
-      source->get_data() + (id_x * tile_width + (id_y * tile_height) * img_w);
-
-    for (ssize_t i = 0; i < tile_width * tile_height; ++i)
-    {
-      const int px = i % tile_width;
-      const int py = i / tile_width;
-      const auto color = source_data[px + py * img_w];
-      p.set_pixel(x + px, y + py, color);
-    }
+    p.draw_image(x, y, tile_view(id_x, id_y), BlendMode::Replace);
   }
 
   void Tileset::draw_tiles(const Tilemap &map, Painter &p)
@@ -8,6 +8,8 @@
 #include <unordered_set>
 
 #include "Image.hpp"
+#include "ImagePool.hpp"
+#include "ImageView.hpp"
 #include "Painter.hpp"
 
 #include "BufferBuilder.hpp"
@@ -337,6 +339,13 @@ namespace ZD
         p);
     }
     void draw_tile(int x, int y, int id_x, int id_y, Painter &);
+    // tile of the source image, without copying it
+    ImageView tile_view(int id_x, int id_y) const
+    {
+      return ImageView(
+        *source,
+        Rect(id_x * tile_width, id_y * tile_height, tile_width, tile_height));
+    }
 
     inline int get_tile_width() { return tile_width; }
     inline int get_tile_height() { return tile_height; }
@@ -397,8 +406,8 @@ namespace ZD
       auto ptr = images.find(key);
       if (ptr == images.end())
       {
-        auto new_image =
-          Image::create(Size(image_width(), image_height()), PixelFormat::RGBA);
+        auto new_image = ImagePool::shared()->acquire(
+          Size(image_width(), image_height()), PixelFormat::RGBA);
         images.insert({ key, new_image });
         return new_image;
       }
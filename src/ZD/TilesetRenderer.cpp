@@ -2,6 +2,7 @@
 #include <GLFW/glfw3.h>
 
 #include "TilesetRenderer.hpp"
+#include "ImagePool.hpp"
 #include "ShaderLoader.hpp"
 
 namespace ZD
@@ -87,8 +88,9 @@ namespace ZD
 
   void TilesetRenderer::update(const Tilemap &tilemap)
   {
-    std::shared_ptr<Image> image =
-      Image::create(Size(MAP_TEXTURE_WIDTH, MAP_TEXTURE_HEIGHT), Color(255, 255, 255), PixelFormat::RGBA);
+    // the previous map goes back to the pool once the texture drops it
+    std::shared_ptr<Image> image = ImagePool::shared()->acquire(
+      Size(MAP_TEXTURE_WIDTH, MAP_TEXTURE_HEIGHT), Color(255, 255, 255), PixelFormat::RGBA);
     for (const auto &key_tile : tilemap.get_tiles())
     {
       const auto &tile = key_tile.second;
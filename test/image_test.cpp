@@ -198,6 +198,9 @@ auto image_test_main(int, char **) -> int
     painter->draw_image(0, 0, *image, 0.0, 0.0);
     painter->draw_image(x - 50, y + 40, *image, 1.2, 1.2);
     painter->draw_image(x - 80, y + 50, *image, -1.5, -1.5);
+    painter->draw_image(
+      W - 300, 20, *image, 0.75, 0.75, BlendMode::Replace, ScaleFilter::Bilinear);
+    painter->draw_image(W / 2, H / 2, *image, BlendMode::Additive);
 
     painter->draw_line(10, 10, 300, 300, Color(255, 0, 0));
     painter->draw_line(-100, -50, 300, 320, Color(255, 0, 0));
@@ -240,6 +243,28 @@ auto image_test_main(int, char **) -> int
 
     painter->draw_image(W - 400, H - 300, *canvas_image, 0.5, 0.5);
 
+    painter->push_clip(Rect(W - 400, H - 300, 200, 150));
+    painter->draw_circle(W - 300, H - 225, 100, Color(255, 255, 0));
+    painter->pop_clip();
+
+    painter->fill_rectangle(20, H - 120, 120, H - 20, Color(40, 40, 160));
+    painter->fill_circle(
+      70, H - 70, 40, Color(255, 0, 0, 120), BlendMode::SrcOver);
+    painter->fill_triangle(
+      140, H - 20, 240, H - 20, 190 + x % 50, H - 120, Color(0, 255, 0));
+    const Point star[] = { { 300, H - 120 }, { 330, H - 20 }, { 250, H - 85 },
+                           { 350, H - 85 },  { 270, H - 20 } };
+    painter->fill_polygon(star, Color(255, 255, 0, 160), BlendMode::SrcOver);
+
+    Path graph;
+    graph.move_to(380, H - 20);
+    graph.cubic_to(420, H - 160, 460, H + 60, 520, H - 90);
+    graph.quad_to(560, H - 140, 600, H - 40);
+    painter->stroke_path(graph, 3.0f, Color(255, 255, 255));
+    graph.line_to(600, H - 20);
+    graph.close();
+    painter->fill_path(graph, Color(0, 160, 255, 90));
+
     painter->draw_image(W - x, H - y, *scaled_image, 2.0, 2.0);
 
     screen2->painter()->clear();
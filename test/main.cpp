@@ -1,4 +1,5 @@
 #include <cstdio>
+#include <string_view>
 
 extern int image_test_main(int, char **);
 extern int model_test_main(int, char **);
@@ -6,16 +7,21 @@ extern int file_test_main(int, char **);
 extern int shader_test_main(int, char **);
 extern int minimal_test_main(int, char **);
 extern int network_test_main(int, char **);
+extern int painter_test_main(int, char **);
+extern int screen_test_main(int, char **);
+extern int painter_bench_main(int, char **);
 
 #define DUMMY(a, b) 0
 
 // tests definitions
-#define FILE_TEST(a, b)    file_test_main(a, b)
-#define IMAGE_TEST(a, b)   image_test_main(a, b)
-#define SHADER_TEST(a, b)  shader_test_main(a, b)
-#define MODEL_TEST(a, b)   model_test_main(a, b)
-#define MINIMAL_TEST(a, b) minimal_test_main(a, b)
-#define NETWORK_TEST(a, b) network_test_main(a, b)
+#define FILE_TEST(a, b)     file_test_main(a, b)
+#define IMAGE_TEST(a, b)    image_test_main(a, b)
+#define SHADER_TEST(a, b)   shader_test_main(a, b)
+#define MODEL_TEST(a, b)    model_test_main(a, b)
+#define MINIMAL_TEST(a, b)  minimal_test_main(a, b)
+#define NETWORK_TEST(a, b)  network_test_main(a, b)
+#define PAINTER_TEST(a, b)  painter_test_main(a, b)
+#define SCREEN_TEST(a, b)   screen_test_main(a, b)
 
 #ifndef IMAGE_TEST
 #define IMAGE_TEST(a, b) DUMMY(a, b)
@@ -41,14 +47,40 @@ extern int network_test_main(int, char **);
 #define NETWORK_TEST(a, b) DUMMY(a, b)
 #endif
 
+#ifndef PAINTER_TEST
+#define PAINTER_TEST(a, b) DUMMY(a, b)
+#endif
+
+#ifndef SCREEN_TEST
+#define SCREEN_TEST(a, b) DUMMY(a, b)
+#endif
+
 auto main(int argc, char *argv[]) -> int
 {
+  // timings only, run with `demo --bench`
+  if (argc > 1 && std::string_view(argv[1]) == "--bench")
+  {
+    return painter_bench_main(argc, argv);
+  }
+
   if (MINIMAL_TEST(argc, argv) > 0)
   {
     puts("Minimal test ERROR");
     return 4;
   }
 
+  if (PAINTER_TEST(argc, argv) > 0)
+  {
+    puts("Painter test ERROR");
+    return 7;
+  }
+
+  if (SCREEN_TEST(argc, argv) > 0)
+  {
+    puts("Screen test ERROR");
+    return 8;
+  }
+
   if (FILE_TEST(argc, argv) > 0)
   {
     puts("File test ERROR");
@@ -0,0 +1,618 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ZD/Font.hpp"
+#include "ZD/ImageFilter.hpp"
+#include "ZD/ImagePool.hpp"
+#include "ZD/ImageView.hpp"
+#include "ZD/Painter.hpp"
+#include "ZD/PainterCommandList.hpp"
+#include "ZD/Palette.hpp"
+#include "ZD/ParallelPainter.hpp"
+#include "ZD/PixelKernels.hpp"
+#include "ZD/ScaledPainter.hpp"
+#include "ZD/TiledImage.hpp"
+#include "ZD/Tileset.hpp"
+
+#define W 1280
+#define H 720
+
+static const char *simd_level_name(ZD::SimdLevel level)
+{
+  switch (level)
+  {
+    case ZD::SimdLevel::Scalar: return "scalar";
+    case ZD::SimdLevel::SSE2: return "sse2";
+    case ZD::SimdLevel::AVX2: return "avx2";
+  }
+  return "?";
+}
+
+static double measure_ms(int iterations, std::function<void()> func)
+{
+  func();
+
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; i++)
+  {
+    func();
+  }
+  const auto end = std::chrono::steady_clock::now();
+
+  return std::chrono::duration<double, std::milli>(end - start).count() /
+         iterations;
+}
+
+// every third pixel is transparent, the rest has random colors
+static std::shared_ptr<ZD::Image> create_keyed_image(ZD::Size size)
+{
+  using namespace ZD;
+
+  auto image = Image::create(size, PixelFormat::RGBA);
+  for (int y = 0; y < size.height(); y++)
+  {
+    for (int x = 0; x < size.width(); x++)
+    {
+      if ((x + y) % 3 == 0)
+        continue;
+      image->set_pixel(x, y, Color::from_random(1));
+    }
+  }
+  return image;
+}
+
+// typical frame: background, sprites and some shapes on top
+static void draw_frame(
+  ZD::Painter &painter, const ZD::Image &background, const ZD::Image &sprite)
+{
+  using namespace ZD;
+
+  painter.draw_image(0, 0, background, BlendMode::Replace);
+  for (int i = 0; i < 1000; i++)
+  {
+    painter.draw_image((i * 37) % W - 16, (i * 91) % H - 16, sprite);
+  }
+  for (int i = 0; i < 200; i++)
+  {
+    const int x = (i * 53) % W;
+    const int y = (i * 29) % H;
+    painter.fill_circle(x, y, 24, Color(255, 0, 0, 96), BlendMode::SrcOver);
+    painter.fill_rectangle(
+      x - 40, y, x + 40, y + 8, Color(0, 0, 255), BlendMode::Replace);
+  }
+}
+
+// UI made of panels covering each other, with icons and separators
+template<typename P> static void draw_ui(P &painter, const ZD::Image &icon)
+{
+  using namespace ZD;
+
+  painter.fill(Color(40, 40, 40));
+  for (int panel = 0; panel < 8; panel++)
+  {
+    const int x = 40 + panel * 110;
+    const int y = 30 + panel * 60;
+    painter.fill_rectangle(x, y, x + 399, y + 299, Color(70, 70, 90));
+    painter.push_clip(Rect(x, y, 400, 300));
+    for (int i = 0; i < 60; i++)
+    {
+      painter.draw_image(x + 8 + (i % 10) * 40, y + 8 + (i / 10) * 48, icon);
+    }
+    for (int i = 0; i < 6; i++)
+    {
+      const int line_y = y + 46 + i * 48;
+      painter.draw_line(x, line_y, x + 400, line_y, Color(120, 120, 140));
+    }
+    painter.pop_clip();
+  }
+}
+
+// every third pixel has index 0, which is transparent
+static std::shared_ptr<ZD::Image> create_indexed_image(
+  ZD::Size size, std::shared_ptr<ZD::Palette> palette)
+{
+  using namespace ZD;
+
+  auto image = Image::create(size, palette);
+  for (int y = 0; y < size.height(); y++)
+  {
+    for (int x = 0; x < size.width(); x++)
+    {
+      if ((x + y) % 3 == 0)
+        continue;
+      image->set_index(x, y, 1 + (x * 7 + y * 13) % 255);
+    }
+  }
+  return image;
+}
+
+// 8x8 cells for characters 32-127, every glyph is a different pattern
+static std::shared_ptr<ZD::Image> create_font_atlas()
+{
+  using namespace ZD;
+
+  auto atlas = Image::create(Size(16 * 8, 6 * 8), PixelFormat::RGBA);
+  for (int i = 1; i < 96; i++)
+  {
+    for (int y = 1; y < 7; y++)
+    {
+      for (int x = 1; x < 6; x++)
+      {
+        if ((i * 7 + x * 3 + y * 5) % 4 == 0)
+          continue;
+        atlas->set_pixel(
+          (i % 16) * 8 + x, (i / 16) * 8 + y, Color(255, 255, 255));
+      }
+    }
+  }
+  return atlas;
+}
+
+// opaque disc covering about 30% of the image, the rest is transparent
+static std::shared_ptr<ZD::Image> create_disc_image(int size)
+{
+  using namespace ZD;
+
+  auto image = Image::create(Size(size, size), PixelFormat::RGBA);
+  image->clear(Color(0));
+  const int radius = size * 31 / 100;
+  for (int y = 0; y < size; y++)
+  {
+    for (int x = 0; x < size; x++)
+    {
+      const int dx = x - size / 2;
+      const int dy = y - size / 2;
+      if (dx * dx + dy * dy < radius * radius)
+        image->set_pixel(x, y, Color::from_random(1));
+    }
+  }
+  return image;
+}
+
+auto painter_bench_main(int, char **) -> int
+{
+  using namespace ZD;
+
+  puts("Painter benchmark.");
+
+  auto canvas = Image::create(Size(W, H), PixelFormat::RGBA);
+  Painter painter(canvas);
+
+  auto screen_image = create_keyed_image(Size(W, H));
+  auto sprite_image = create_keyed_image(Size(32, 32));
+
+  const SimdLevel detected = Kernels::detect_simd_level();
+  const SimdLevel levels[] = { SimdLevel::Scalar,
+                               SimdLevel::SSE2,
+                               SimdLevel::AVX2 };
+
+  for (const auto level : levels)
+  {
+    if (level > detected)
+      break;
+
+    Kernels::set_simd_level(level);
+
+    const double screen_ms = measure_ms(
+      100, [&]() { painter.draw_image(0, 0, *screen_image); });
+    const double sprites_ms = measure_ms(100, [&]() {
+      for (int i = 0; i < 1000; i++)
+      {
+        painter.draw_image((i * 37) % W - 16, (i * 91) % H - 16, *sprite_image);
+      }
+    });
+
+    printf(
+      "draw_image %-6s: full screen %8.3f ms; 1000 sprites 32x32 %8.3f ms\n",
+      simd_level_name(level),
+      screen_ms,
+      sprites_ms);
+
+    // span fills, scalar is the plain std::fill_n loop used before
+    const double clear_ms =
+      measure_ms(100, [&]() { painter.clear(Color(16, 32, 48)); });
+    const double clear_rectangle_ms =
+      measure_ms(100, [&]() { painter.clear_rectangle(8, 8, W - 8, H - 8); });
+    const double circles_ms = measure_ms(100, [&]() {
+      for (int i = 0; i < 1000; i++)
+      {
+        painter.fill_circle((i * 37) % W, (i * 91) % H, 24, Color(0, 255, 0));
+      }
+    });
+    printf(
+      "span fill  %-6s: clear %8.3f ms; clear_rectangle %8.3f ms; "
+      "1000 circles %8.3f ms\n",
+      simd_level_name(level),
+      clear_ms,
+      clear_rectangle_ms,
+      circles_ms);
+  }
+
+  Kernels::set_simd_level(detected);
+
+  const double triangles_ms = measure_ms(100, [&]() {
+    for (int i = 0; i < 1000; i++)
+    {
+      const int x = (i * 37) % W;
+      const int y = (i * 91) % H;
+      painter.fill_triangle(
+        x, y, x + 40, y + 10, x + 15, y + 35, Color(0, 255, 0, 128),
+        BlendMode::SrcOver);
+    }
+  });
+  printf("fill_triangle: 1000 triangles %8.3f ms\n", triangles_ms);
+
+  Path circle;
+  const float r = W / 2;
+  const float k = 0.5523f * r;
+  circle.move_to(W / 2 + r, H / 2);
+  circle.cubic_to(W / 2 + r, H / 2 + k, W / 2 + k, H / 2 + r, W / 2, H / 2 + r);
+  circle.cubic_to(W / 2 - k, H / 2 + r, W / 2 - r, H / 2 + k, W / 2 - r, H / 2);
+  circle.cubic_to(W / 2 - r, H / 2 - k, W / 2 - k, H / 2 - r, W / 2, H / 2 - r);
+  circle.cubic_to(W / 2 + k, H / 2 - r, W / 2 + r, H / 2 - k, W / 2 + r, H / 2);
+  circle.close();
+
+  const double path_ms =
+    measure_ms(100, [&]() { painter.fill_path(circle, Color(0, 0, 255)); });
+  printf("fill_path: full screen circle %8.3f ms\n", path_ms);
+
+  auto disc_image = create_disc_image(64);
+  auto draw_discs = [&](auto draw) {
+    for (int i = 0; i < 1000; i++)
+    {
+      draw((i * 37) % W - 32, (i * 91) % H - 32);
+    }
+  };
+  const double keyed_ms = measure_ms(100, [&]() {
+    draw_discs([&](int x, int y) { painter.draw_image(x, y, *disc_image); });
+  });
+  const double rle_ms = measure_ms(100, [&]() {
+    draw_discs([&](int x, int y) {
+      painter.draw_image(x, y, *disc_image, ImageFlip::None);
+    });
+  });
+  const double rle_flipped_ms = measure_ms(100, [&]() {
+    draw_discs([&](int x, int y) {
+      painter.draw_image(x, y, *disc_image, ImageFlip::Both);
+    });
+  });
+  printf(
+    "1000 sprites 64x64, 70%% transparent: ColorKey %8.3f ms; runs %8.3f ms; "
+    "flipped runs %8.3f ms\n",
+    keyed_ms,
+    rle_ms,
+    rle_flipped_ms);
+
+  // 1000 rotated 64x64 sprites
+  auto draw_rotated = [&](ScaleFilter filter) {
+    for (int i = 0; i < 1000; i++)
+    {
+      const float angle = i * 0.1f;
+      glm::mat3 transform(1.0f);
+      transform[0][0] = std::cos(angle);
+      transform[0][1] = std::sin(angle);
+      transform[1][0] = -std::sin(angle);
+      transform[1][1] = std::cos(angle);
+      transform[2][0] = (i * 37) % W;
+      transform[2][1] = (i * 91) % H;
+      painter.draw_image_affine(
+        *disc_image, transform, BlendMode::ColorKey, filter);
+    }
+  };
+  const double rotated_ms =
+    measure_ms(100, [&]() { draw_rotated(ScaleFilter::Nearest); });
+  const double rotated_bilinear_ms =
+    measure_ms(100, [&]() { draw_rotated(ScaleFilter::Bilinear); });
+  printf(
+    "draw_image_affine: 1000 rotated sprites 64x64 %8.3f ms; bilinear %8.3f "
+    "ms\n",
+    rotated_ms,
+    rotated_bilinear_ms);
+
+  auto palette = Palette::create();
+  palette->set_color(0, Color(0, 0, 0, 0));
+  auto indexed_screen = create_indexed_image(Size(W, H), palette);
+  auto indexed_sprite = create_indexed_image(Size(32, 32), palette);
+  const double indexed_screen_ms =
+    measure_ms(100, [&]() { painter.draw_image(0, 0, *indexed_screen); });
+  const double indexed_sprites_ms = measure_ms(100, [&]() {
+    for (int i = 0; i < 1000; i++)
+    {
+      palette->cycle(1, 255);
+      painter.draw_image((i * 37) % W - 16, (i * 91) % H - 16, *indexed_sprite);
+    }
+  });
+  printf(
+    "draw_image indexed: full screen %8.3f ms; 1000 sprites 32x32 with "
+    "palette cycling %8.3f ms\n",
+    indexed_screen_ms,
+    indexed_sprites_ms);
+
+  // heightmap stored as 1 byte per pixel, against the same one in BGRA
+  auto heightmap = Image::create(Size(W, H), PixelFormat::Gray);
+  auto heightmap_bgra = Image::create(Size(W, H), PixelFormat::BGRA);
+  auto heights = heightmap->view<uint8_t>();
+  for (int y = 0; y < H; y++)
+  {
+    for (int x = 0; x < W; x++)
+    {
+      heights(x, y) = (x * x + y * 3) & 0xff;
+      heightmap_bgra->set_pixel(x, y, heightmap->get_pixel(x, y));
+    }
+  }
+  const double gray_ms =
+    measure_ms(100, [&]() { painter.draw_image(0, 0, *heightmap); });
+  const double gray_bgra_ms =
+    measure_ms(100, [&]() { painter.draw_image(0, 0, *heightmap_bgra); });
+  printf(
+    "draw_image gray: full screen %8.3f ms (%zu KiB); as BGRA %8.3f ms "
+    "(%zu KiB)\n",
+    gray_ms,
+    W * H / 1024ul,
+    gray_bgra_ms,
+    W * H * sizeof(uint32_t) / 1024);
+
+  // HUD text: 40 lines of 100 characters
+  auto font_atlas = create_font_atlas();
+  auto font = Font::create(*font_atlas, Size(8, 8));
+  std::vector<std::shared_ptr<Image>> glyph_images;
+  for (int i = 0; i < 96; i++)
+  {
+    auto glyph = Image::create(Size(8, 8), PixelFormat::RGBA);
+    for (int y = 0; y < 8; y++)
+    {
+      for (int x = 0; x < 8; x++)
+      {
+        glyph->set_pixel(
+          x, y, font_atlas->get_pixel((i % 16) * 8 + x, (i / 16) * 8 + y));
+      }
+    }
+    glyph_images.push_back(glyph);
+  }
+  std::string hud_line;
+  for (int i = 0; i < 100; i++)
+  {
+    hud_line += (char)(' ' + (i * 17) % 95);
+  }
+  const double glyph_images_ms = measure_ms(100, [&]() {
+    for (int line = 0; line < 40; line++)
+    {
+      for (size_t i = 0; i < hud_line.size(); i++)
+      {
+        const auto &glyph = glyph_images[hud_line[i] - ' '];
+        painter.draw_image(i * 8, line * 10, *glyph);
+      }
+    }
+  });
+  const double text_ms = measure_ms(100, [&]() {
+    for (int line = 0; line < 40; line++)
+    {
+      painter.draw_text(0, line * 10, *font, hud_line, Color(255, 255, 255));
+    }
+  });
+  printf(
+    "text: 4000 characters as images %8.3f ms; draw_text %8.3f ms\n",
+    glyph_images_ms,
+    text_ms);
+
+  // pixel art: 1000 sprites at 320x180 shown 4x larger
+  auto low_canvas = Image::create(Size(W / 4, H / 4), PixelFormat::RGBA);
+  Painter low_painter(low_canvas);
+  ScaledPainter scaled_4x_painter(canvas, 4.0f);
+  auto draw_pixel_art = [&](Painter &p) {
+    for (int i = 0; i < 1000; i++)
+    {
+      p.draw_image(
+        (i * 37) % (W / 4) - 16, (i * 91) % (H / 4) - 16, *sprite_image);
+    }
+  };
+  const double scaled_4x_ms =
+    measure_ms(20, [&]() { draw_pixel_art(scaled_4x_painter); });
+  const double present_ms = measure_ms(100, [&]() {
+    painter.draw_image(0, 0, *low_canvas, 4.0, 4.0, BlendMode::Replace);
+  });
+  const double low_ms = measure_ms(20, [&]() {
+    draw_pixel_art(low_painter);
+    painter.draw_image(0, 0, *low_canvas, 4.0, 4.0, BlendMode::Replace);
+  });
+  printf(
+    "pixel art 4x: ScaledPainter %8.3f ms; 320x180 canvas and upscale %8.3f "
+    "ms (upscale alone %8.3f ms)\n",
+    scaled_4x_ms,
+    low_ms,
+    present_ms);
+
+  // particles: 200000 points, about a tenth of them outside of the screen
+  std::vector<Point> particles(200000);
+  for (size_t i = 0; i < particles.size(); i++)
+  {
+    particles[i] = Point { (int)(i * 7919 % (W + W / 10)) - W / 20,
+                           (int)(i * 104729 % (H + H / 10)) - H / 20 };
+  }
+  const Color spark(255, 200, 64, 48);
+  const double set_pixel_ms = measure_ms(20, [&]() {
+    for (const auto &p : particles)
+    {
+      painter.set_pixel(p.x, p.y, spark, BlendMode::Additive);
+    }
+  });
+  const double plot_points_ms = measure_ms(
+    20, [&]() { painter.plot_points(particles, spark, BlendMode::Additive); });
+  printf(
+    "particles: 200000 set_pixel %8.3f ms; plot_points %8.3f ms\n",
+    set_pixel_ms,
+    plot_points_ms);
+
+  // post effects on the whole screen, with one thread and with all of them
+  auto blurred = Image::create(Size(W, H), PixelFormat::RGBA);
+  const auto gaussian = ImageFilter::gaussian_kernel(4.0f);
+  for (const unsigned int threads : { 1u, 0u })
+  {
+    ImageFilter filter(threads);
+    const double box_ms =
+      measure_ms(10, [&]() { filter.box_blur(*screen_image, *blurred, 4, 4); });
+    const double gaussian_ms = measure_ms(
+      10, [&]() { filter.gaussian_blur(*screen_image, *blurred, 4); });
+    const double convolve_ms = measure_ms(10, [&]() {
+      filter.convolve(*screen_image, *blurred, gaussian, gaussian);
+    });
+    printf(
+      "ImageFilter %2u threads: box radius 4 %8.3f ms; gaussian blur sigma 4 "
+      "%8.3f ms; 25 taps kernel %8.3f ms\n",
+      filter.get_thread_count(),
+      box_ms,
+      gaussian_ms,
+      convolve_ms);
+  }
+
+  Tileset tileset(screen_image, 16, 16);
+  ScaledPainter scaled_painter(canvas, 2.0f);
+  auto draw_tiles = [&](Painter &p) {
+    for (int i = 0; i < 1000; i++)
+    {
+      tileset.draw_tile((i % 40) * 16, (i / 40) * 16, i % 64, i % 32, p);
+    }
+  };
+  const double tiles_ms = measure_ms(100, [&]() { draw_tiles(painter); });
+  const double scaled_tiles_ms =
+    measure_ms(100, [&]() { draw_tiles(scaled_painter); });
+  printf(
+    "draw_tile: 1000 tiles 16x16 %8.3f ms; scaled 2x %8.3f ms\n",
+    tiles_ms,
+    scaled_tiles_ms);
+
+  // sprite frames flipped to face left, copied out of the sheet or viewed
+  auto sheet = create_keyed_image(Size(256, 256));
+  auto frame_of = [](int i) {
+    return Rect((i % 8) * 32, (i / 8 % 8) * 32, 32, 32);
+  };
+  const double copied_frames_ms = measure_ms(100, [&]() {
+    for (int i = 0; i < 1000; i++)
+    {
+      auto frame = ImagePool::shared()->acquire(
+        Size(32, 32), PixelFormat::RGBA, ZeroFill::No);
+      Painter(frame).draw_image(
+        0, 0, *sheet, frame_of(i), BlendMode::Replace);
+      painter.draw_image(
+        (i % 40) * 16, (i / 40) * 16, *frame, ImageFlip::Horizontal);
+    }
+  });
+  const double viewed_frames_ms = measure_ms(100, [&]() {
+    for (int i = 0; i < 1000; i++)
+    {
+      painter.draw_image(
+        (i % 40) * 16,
+        (i / 40) * 16,
+        ImageView(*sheet, frame_of(i)),
+        ImageFlip::Horizontal);
+    }
+  });
+  printf(
+    "sprite frames: 1000 flipped 32x32 copied %8.3f ms; ImageView %8.3f ms\n",
+    copied_frames_ms,
+    viewed_frames_ms);
+
+  // world map far bigger than memory, only tiles under the window are read
+  const std::string map_path =
+    std::filesystem::temp_directory_path() / "painter_bench_map.zdt";
+  auto world = TiledImage::create(map_path, Size(65536, 65536));
+  bool map_measured = false;
+  if (world)
+  {
+    world->write(30000, 30000, *screen_image);
+    world.reset();
+    const auto open_start = std::chrono::steady_clock::now();
+    world = TiledImage::open(map_path);
+    const double open_ms = std::chrono::duration<double, std::milli>(
+                             std::chrono::steady_clock::now() - open_start)
+                             .count();
+    if (world)
+    {
+      const Rect window(30100, 30050, W, H);
+      const double window_ms = measure_ms(100, [&]() {
+        world->draw(painter, 0, 0, window, BlendMode::Replace);
+      });
+      printf(
+        "tiled map 65536x65536: open %8.3f ms; %dx%d window %8.3f ms (%zu "
+        "tiles resident)\n",
+        open_ms,
+        W,
+        H,
+        window_ms,
+        world->get_stats().resident_tiles);
+      world.reset();
+      map_measured = true;
+    }
+  }
+  if (!map_measured)
+    printf("tiled map: %s can't be used, skipped\n", map_path.c_str());
+  std::filesystem::remove(map_path);
+
+  // a map image created every update, as in TilesetRenderer::update
+  auto pool = ImagePool::create();
+  std::shared_ptr<Image> map_image;
+  const double create_ms = measure_ms(100, [&]() {
+    map_image =
+      Image::create(Size(256, 256), Color(255, 255, 255), PixelFormat::RGBA);
+  });
+  const double pooled_ms = measure_ms(100, [&]() {
+    map_image =
+      pool->acquire(Size(256, 256), Color(255, 255, 255), PixelFormat::RGBA);
+  });
+  const auto pool_stats = pool->get_stats();
+  printf(
+    "map image 256x256: Image::create %8.3f ms; ImagePool %8.3f ms (%zu "
+    "hits, %zu misses)\n",
+    create_ms,
+    pooled_ms,
+    pool_stats.hits,
+    pool_stats.misses);
+
+  const double sequential_ms = measure_ms(
+    20, [&]() { draw_frame(painter, *screen_image, *sprite_image); });
+  printf("frame: Painter %8.3f ms\n", sequential_ms);
+
+  const double ui_ms =
+    measure_ms(100, [&]() { draw_ui(painter, *sprite_image); });
+
+  PainterCommandList ui_list(Size(W, H));
+  draw_ui(ui_list, *sprite_image);
+  const size_t recorded_commands = ui_list.size();
+  ui_list.optimize();
+
+  const double replay_ms = measure_ms(100, [&]() { ui_list.replay(painter); });
+  printf(
+    "ui: Painter %8.3f ms; PainterCommandList replay %8.3f ms (%zu of %zu "
+    "commands)\n",
+    ui_ms,
+    replay_ms,
+    ui_list.size(),
+    recorded_commands);
+
+  const unsigned int max_threads =
+    std::max(1u, std::thread::hardware_concurrency());
+  for (unsigned int threads = 1; threads <= max_threads; threads++)
+  {
+    ParallelPainter parallel_painter(canvas, threads);
+    const double parallel_ms = measure_ms(20, [&]() {
+      draw_frame(parallel_painter, *screen_image, *sprite_image);
+      parallel_painter.finish();
+    });
+    printf(
+      "frame: ParallelPainter %2u threads %8.3f ms (%.2fx)\n",
+      threads,
+      parallel_ms,
+      sequential_ms / parallel_ms);
+  }
+
+  puts("Painter benchmark complete.");
+  return 0;
+}
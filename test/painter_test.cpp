@@ -0,0 +1,1319 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ZD/Font.hpp"
+#include "ZD/FrameDiff.hpp"
+#include "ZD/ImageFilter.hpp"
+#include "ZD/ImagePool.hpp"
+#include "ZD/Painter.hpp"
+#include "ZD/PainterCommandList.hpp"
+#include "ZD/Palette.hpp"
+#include "ZD/ParallelPainter.hpp"
+#include "ZD/PixelKernels.hpp"
+#include "ZD/TiledImage.hpp"
+
+static int failures = 0;
+
+static void check(bool condition, const char *what)
+{
+  if (!condition)
+  {
+    printf("Painter test failed: %s\n", what);
+    failures++;
+  }
+}
+
+static uint32_t random_state = 1;
+
+// deterministic, so failures can be reproduced
+static uint32_t random_value()
+{
+  random_state = random_state * 1103515245 + 12345;
+  return (random_state >> 16) | (random_state << 16);
+}
+
+// random colors, about a third of them fully transparent
+static std::shared_ptr<ZD::Image> create_random_image(
+  ZD::Size size, ZD::PixelFormat::Type format = ZD::PixelFormat::RGBA)
+{
+  using namespace ZD;
+
+  auto image = Image::create(size, format);
+  for (int y = 0; y < size.height(); y++)
+  {
+    for (int x = 0; x < size.width(); x++)
+    {
+      const uint32_t value = random_value();
+      image->set_pixel(
+        x, y, Color::from_value(value % 3 == 0 ? value & 0xffffff00 : value));
+    }
+  }
+  return image;
+}
+
+static bool same_pixels(const ZD::Image &a, const ZD::Image &b)
+{
+  if (a.get_size() != b.get_size())
+    return false;
+
+  for (int y = 0; y < a.height(); y++)
+  {
+    for (int x = 0; x < a.width(); x++)
+    {
+      if (a.get_pixel(x, y) != b.get_pixel(x, y))
+        return false;
+    }
+  }
+  return true;
+}
+
+// part of `large` with its top left corner at (x, y) equals `small`
+static bool same_pixels(
+  const ZD::Image &small, const ZD::Image &large, int x, int y)
+{
+  for (int row = 0; row < small.height(); row++)
+  {
+    for (int column = 0; column < small.width(); column++)
+    {
+      if (small.get_pixel(column, row) != large.get_pixel(x + column, y + row))
+        return false;
+    }
+  }
+  return true;
+}
+
+// a bit of everything, every call covers a different kernel
+template<typename P>
+static void draw_scene(P &painter, const ZD::Image &sprite)
+{
+  using namespace ZD;
+
+  painter.clear(Color(20, 30, 40));
+  for (int i = 0; i < 40; i++)
+  {
+    const int x = (i * 37) % 180 - 20;
+    const int y = (i * 53) % 140 - 20;
+    const BlendMode mode = (BlendMode)(i % 6);
+    painter.draw_image(x, y, sprite, mode);
+    painter.draw_image(x + 5, y, sprite, ImageFlip::Horizontal, mode);
+    painter.fill_rectangle(x, y, x + 30, y + 4, Color(200, 10, 90, 120), mode);
+    painter.fill_circle(y, x, 9, Color(10, 250, 90, 70), mode);
+  }
+  painter.draw_image(3, 7, sprite, 3.0, 2.0, BlendMode::SrcOver);
+  painter.draw_image(-9, 40, sprite, 1.7, 0.6, BlendMode::SrcOver);
+  painter.draw_image(
+    60, 3, sprite, 0.8, 1.3, BlendMode::ColorKey, ScaleFilter::Bilinear);
+  painter.draw_line(-10, 5, 170, 130, Color(255, 255, 0, 128), BlendMode::SrcOver);
+  painter.fill_triangle(10, 10, 150, 40, 30, 120, Color(0, 0, 255, 60), BlendMode::Additive);
+}
+
+static void test_simd_levels()
+{
+  using namespace ZD;
+
+  const SimdLevel detected = Kernels::detect_simd_level();
+  const SimdLevel levels[] = { SimdLevel::Scalar,
+                               SimdLevel::SSE2,
+                               SimdLevel::AVX2 };
+
+  // odd lengths and offsets reach the scalar tails and unaligned heads
+  const size_t length = 203;
+  const size_t offset = 3;
+  std::vector<uint32_t> source(length + offset);
+  std::vector<uint8_t> bytes(2 * (length + offset));
+  std::vector<int32_t> offsets(length);
+  std::vector<uint32_t> initial(5 * (length + offset));
+  for (auto &value : source)
+    value = random_value() & (random_value() % 3 ? ~0u : ~0xffu);
+  for (auto &value : bytes)
+    value = random_value();
+  for (auto &value : offsets)
+    value = random_value() % length;
+  for (auto &value : initial)
+    value = random_value();
+  uint32_t palette[256];
+  for (auto &color : palette)
+    color = random_value();
+  // points around the clip, it cuts them on every side
+  const Rect points_clip(5, 3, 17, 11);
+  std::vector<Point> points(length);
+  for (auto &point : points)
+  {
+    point.x = (int)(random_value() % 32) - 5;
+    point.y = (int)(random_value() % 24) - 5;
+  }
+
+  // every kernel writes its own part of the output, for each level
+  auto run_kernels = [&]() {
+    std::vector<std::vector<uint32_t>> outputs;
+    auto output = [&]() -> uint32_t * {
+      outputs.push_back(initial);
+      return outputs.back().data() + offset;
+    };
+    const uint32_t *src = source.data() + offset;
+
+    Kernels::copy_keyed_row(output(), src, length);
+    for (int mode = 0; mode < 6; mode++)
+    {
+      for (auto format : { PixelFormat::BGRA, PixelFormat::BGR })
+        Kernels::blend_row(output(), src, length, (BlendMode)(mode), format);
+      Kernels::blend_fill(output(), 0x80402090, length, (BlendMode)(mode));
+      Kernels::blend_fill(output(), 0x804020ff, length, (BlendMode)(mode));
+    }
+    for (size_t start = 0; start < 8; start++)
+      Kernels::fill_span(output() + start, 0x11223344, length - start);
+    for (int factor = 1; factor <= 5; factor++)
+      Kernels::upscale_row(output(), src, length / 5, factor);
+    Kernels::gather_row(output(), src, offsets.data(), length);
+    Kernels::expand_indexed_row(output(), bytes.data(), palette, length);
+    Kernels::expand_gray_row(output(), bytes.data() + 1, length);
+    Kernels::expand_gray_alpha_row(output(), bytes.data() + 1, length);
+
+    std::vector<int32_t> culled(length);
+    std::vector<uint32_t> selected(length);
+    for (uint32_t *indices : { selected.data(), (uint32_t *)nullptr })
+    {
+      const size_t count = Kernels::cull_points(
+        culled.data(), indices, points.data(), length, points_clip, 40);
+      outputs.emplace_back(culled.begin(), culled.begin() + count);
+      if (indices)
+        outputs.emplace_back(selected.begin(), selected.begin() + count);
+    }
+    return outputs;
+  };
+
+  auto sprite = create_random_image(Size(33, 21));
+  auto draw = [&]() {
+    auto image = Image::create(Size(160, 120), PixelFormat::RGBA);
+    Painter painter(image);
+    draw_scene(painter, *sprite);
+    return image;
+  };
+
+  Kernels::set_simd_level(SimdLevel::Scalar);
+  const auto scalar_outputs = run_kernels();
+  const auto scalar_image = draw();
+  for (const auto level : levels)
+  {
+    if (level > detected)
+      break;
+
+    Kernels::set_simd_level(level);
+    check(run_kernels() == scalar_outputs, "SIMD kernels give scalar results");
+    check(same_pixels(*draw(), *scalar_image), "SIMD drawing is scalar one");
+  }
+  Kernels::set_simd_level(detected);
+}
+
+/*
+ *  Shapes partly outside of a small canvas have to look like the same
+ *  shapes drawn on a larger canvas, cut to the small one.
+ * */
+static void test_clipping()
+{
+  using namespace ZD;
+
+  const int border = 64;
+  const Size size(50, 40);
+  const Color color(250, 120, 30, 140);
+  std::vector<std::function<void(Painter &, int)>> shapes = {
+    [&](Painter &p, int o) { p.draw_line(o - 30, o - 7, o + 80, o + 60, color); },
+    [&](Painter &p, int o) { p.draw_line(o + 70, o - 9, o - 20, o + 33, color); },
+    [&](Painter &p, int o) { p.draw_line(o - 40, o + 5, o + 90, o + 5, color); },
+    [&](Painter &p, int o) { p.draw_line(o + 7, o - 40, o + 7, o + 90, color); },
+    [&](Painter &p, int o) {
+      p.draw_rectangle(o - 10, o - 5, o + 60, o + 20, color, BlendMode::SrcOver);
+    },
+    [&](Painter &p, int o) {
+      p.fill_rectangle(o + 30, o - 50, o + 80, o + 30, color, BlendMode::SrcOver);
+    },
+    [&](Painter &p, int o) { p.draw_circle(o - 3, o + 45, 30, color); },
+    [&](Painter &p, int o) {
+      p.fill_circle(o + 49, o, 25, color, BlendMode::SrcOver);
+    },
+    [&](Painter &p, int o) {
+      p.fill_triangle(
+        o - 30, o - 20, o + 90, o + 10, o + 10, o + 70, color,
+        BlendMode::SrcOver);
+    },
+    [&](Painter &p, int o) {
+      const std::vector<Point> points = { { o - 20, o + 10 },
+                                          { o + 30, o - 30 },
+                                          { o + 70, o + 20 },
+                                          { o + 10, o + 60 },
+                                          { o + 20, o + 5 } };
+      p.fill_polygon(points, color, BlendMode::SrcOver);
+    },
+    [&](Painter &p, int o) {
+      Path path;
+      path.move_to(o - 20.5f, o + 30.0f);
+      path.cubic_to(o + 10.0f, o - 40.0f, o + 40.0f, o + 90.0f, o + 75.5f, o - 5.0f);
+      path.line_to(o + 20.0f, o + 55.25f);
+      path.close();
+      p.fill_path(path, color);
+    },
+    [&](Painter &p, int o) {
+      Path path;
+      path.move_to(o - 10.0f, o - 10.0f);
+      path.quad_to(o + 25.0f, o + 80.0f, o + 65.0f, o + 12.5f);
+      p.stroke_path(path, 5.0f, color);
+    },
+  };
+
+  for (const auto &shape : shapes)
+  {
+    auto small = Image::create(size, Color(5, 5, 5), PixelFormat::RGBA);
+    auto large = Image::create(
+      Size(size.width() + 2 * border, size.height() + 2 * border),
+      Color(5, 5, 5),
+      PixelFormat::RGBA);
+    Painter small_painter(small);
+    Painter large_painter(large);
+    shape(small_painter, 0);
+    shape(large_painter, border);
+    check(
+      same_pixels(*small, *large, border, border),
+      "shapes are clipped to the canvas");
+
+    // the same through a clip rectangle on the larger canvas
+    auto clipped = Image::create(large->get_size(), Color(5, 5, 5), PixelFormat::RGBA);
+    Painter clipped_painter(clipped);
+    clipped_painter.push_clip(Rect(border, border, size.width(), size.height()));
+    shape(clipped_painter, border);
+    bool outside_untouched = true;
+    for (int y = 0; y < clipped->height(); y++)
+    {
+      for (int x = 0; x < clipped->width(); x++)
+      {
+        const bool inside = x >= border && x < border + size.width() &&
+                            y >= border && y < border + size.height();
+        if (!inside && clipped->get_pixel(x, y) != Color(5, 5, 5))
+          outside_untouched = false;
+      }
+    }
+    check(outside_untouched, "shapes are clipped to the clip rectangle");
+    check(
+      same_pixels(*small, *clipped, border, border),
+      "clip rectangle gives the same pixels as the canvas edge");
+  }
+
+  // entirely outside, nothing is drawn
+  auto image = Image::create(size, Color(5, 5, 5), PixelFormat::RGBA);
+  Painter painter(image);
+  for (const auto &shape : shapes)
+  {
+    shape(painter, -1000);
+    shape(painter, 1000);
+  }
+  check(
+    same_pixels(*image, *Image::create(size, Color(5, 5, 5), PixelFormat::RGBA)),
+    "shapes outside of the canvas don't draw");
+}
+
+// source pixel (x, y) of `image` is pixel (y, height - 1 - x) of the result
+static std::shared_ptr<ZD::Image> rotated_copy(const ZD::Image &image)
+{
+  using namespace ZD;
+
+  auto rotated =
+    Image::create(Size(image.height(), image.width()), PixelFormat::RGBA);
+  for (int y = 0; y < image.height(); y++)
+  {
+    for (int x = 0; x < image.width(); x++)
+      rotated->set_pixel(image.height() - 1 - y, x, image.get_pixel(x, y));
+  }
+  return rotated;
+}
+
+static void test_affine_blit()
+{
+  using namespace ZD;
+
+  const Size size(90, 70);
+  const Color background(5, 5, 5);
+  auto sprite = create_random_image(Size(23, 17));
+  const float w = sprite->width();
+  const float h = sprite->height();
+
+  // matrices are column major, the last column is the translation
+  auto same_as_blit = [&](const glm::mat3 &transform, const Image &reference,
+                          int x, int y) {
+    bool same = true;
+    for (auto mode : { BlendMode::ColorKey, BlendMode::SrcOver })
+    {
+      auto image = Image::create(size, background, PixelFormat::RGBA);
+      Painter painter(image);
+      painter.draw_image_affine(*sprite, transform, mode);
+      auto expected = Image::create(size, background, PixelFormat::RGBA);
+      Painter expected_painter(expected);
+      expected_painter.draw_image(x, y, reference, mode);
+      same &= same_pixels(*image, *expected);
+    }
+    return same;
+  };
+
+  check(
+    same_as_blit(glm::mat3(1.0f), *sprite, 0, 0),
+    "identity affine blit is draw_image");
+  check(
+    same_as_blit(
+      glm::mat3(1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 31.0f, -6.0f, 1.0f),
+      *sprite, 31, -6),
+    "translated affine blit is draw_image");
+
+  // 90 degrees clockwise: (x, y) goes to (h - y, x)
+  check(
+    same_as_blit(
+      glm::mat3(0.0f, 1.0f, 0.0f, -1.0f, 0.0f, 0.0f, h + 10.0f, 20.0f, 1.0f),
+      *rotated_copy(*sprite), 10, 20),
+    "affine blit rotated by 90 degrees is the transposed blit");
+
+  // 180 degrees: (x, y) goes to (w - x, h - y)
+  auto flipped = Image::create(sprite->get_size(), PixelFormat::RGBA);
+  Painter flip_painter(flipped);
+  flip_painter.draw_image(0, 0, *sprite, ImageFlip::Both, BlendMode::Replace);
+  check(
+    same_as_blit(
+      glm::mat3(-1.0f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, w + 40.0f, h + 3.0f,
+                1.0f),
+      *flipped, 40, 3),
+    "affine blit rotated by 180 degrees is the flipped blit");
+
+  // rotated and scaled, partly outside of the canvas, as in test_clipping
+  const int border = 64;
+  const float angle = 0.5f;
+  for (auto filter : { ScaleFilter::Nearest, ScaleFilter::Bilinear })
+  {
+    for (const glm::vec2 position :
+         { glm::vec2(-12.3f, 40.0f), glm::vec2(70.0f, -9.0f),
+           glm::vec2(80.5f, 55.25f) })
+    {
+      auto transform = [&](float offset) {
+        return glm::mat3(
+          1.5f * std::cos(angle), 1.5f * std::sin(angle), 0.0f,
+          -1.5f * std::sin(angle), 1.5f * std::cos(angle), 0.0f,
+          position.x + offset, position.y + offset, 1.0f);
+      };
+      auto small = Image::create(size, background, PixelFormat::RGBA);
+      Painter small_painter(small);
+      small_painter.draw_image_affine(
+        *sprite, transform(0.0f), BlendMode::SrcOver, filter);
+      auto large = Image::create(
+        Size(size.width() + 2 * border, size.height() + 2 * border),
+        background, PixelFormat::RGBA);
+      Painter large_painter(large);
+      large_painter.draw_image_affine(
+        *sprite, transform(border), BlendMode::SrcOver, filter);
+      check(
+        same_pixels(*small, *large, border, border),
+        "affine blit is clipped to the canvas");
+      check(
+        !same_pixels(
+          *small, *Image::create(size, background, PixelFormat::RGBA)),
+        "affine blit partly outside of the canvas draws");
+    }
+  }
+}
+
+/*
+ *  Flipped images are drawn from runs of visible pixels, the reference
+ *  blends pixel by pixel. Views start inside of the image, so runs before
+ *  them are skipped.
+ * */
+static void test_flipped_runs()
+{
+  using namespace ZD;
+
+  auto sheet = create_random_image(Size(40, 30));
+  auto background = create_random_image(Size(32, 24));
+  const ImageView views[] = { ImageView(*sheet),
+                              ImageView(*sheet, Rect(7, 5, 21, 17)) };
+  const ImageFlip flips[] = { ImageFlip::None,
+                              ImageFlip::Horizontal,
+                              ImageFlip::Vertical,
+                              ImageFlip::Both };
+  const BlendMode modes[] = { BlendMode::ColorKey,
+                              BlendMode::SrcOver,
+                              BlendMode::Additive,
+                              BlendMode::Multiply };
+  // cut on the left and top, right and bottom, and by a clip
+  const Point positions[] = { { -6, -4 }, { 20, 15 }, { 2, 1 } };
+  const Rect clip(4, 3, 19, 13);
+
+  bool same = true;
+  for (const auto &view : views)
+  {
+    for (const auto flip : flips)
+    {
+      for (const auto mode : modes)
+      {
+        for (const auto &position : positions)
+        {
+          const bool clipped = position.x == 2;
+          const Size size = background->get_size();
+          auto image = Image::create(size, PixelFormat::RGBA);
+          auto expected = Image::create(size, PixelFormat::RGBA);
+          Painter painter(image);
+          Painter reference(expected);
+          painter.draw_image(0, 0, *background, BlendMode::Replace);
+          reference.draw_image(0, 0, *background, BlendMode::Replace);
+          if (clipped)
+          {
+            painter.push_clip(clip);
+            reference.push_clip(clip);
+          }
+          painter.draw_image(position.x, position.y, view, flip, mode);
+
+          const bool flip_x =
+            flip == ImageFlip::Horizontal || flip == ImageFlip::Both;
+          const bool flip_y =
+            flip == ImageFlip::Vertical || flip == ImageFlip::Both;
+          for (int y = 0; y < view.height(); y++)
+          {
+            for (int x = 0; x < view.width(); x++)
+            {
+              const Color pixel = view.get_pixel(
+                flip_x ? view.width() - 1 - x : x,
+                flip_y ? view.height() - 1 - y : y);
+              if (mode == BlendMode::ColorKey && pixel.alpha() == 0)
+                continue;
+              reference.set_pixel(position.x + x, position.y + y, pixel, mode);
+            }
+          }
+          same &= same_pixels(*image, *expected);
+        }
+      }
+    }
+  }
+  check(same, "flipped runs are blended pixels");
+}
+
+/*
+ *  Views share the rows of their image, drawing one has to look like
+ *  drawing its pixels copied to an image of their own.
+ * */
+static void test_image_view()
+{
+  using namespace ZD;
+
+  auto sheet = create_random_image(Size(30, 20));
+  const ImageView frame(*sheet, Rect(5, 4, 12, 9));
+
+  // clipped at the frame edge, not at the sheet one
+  const ImageView part = frame.sub_view(Rect(8, 6, 10, 10));
+  check(
+    part.get_size() == Size(4, 3) && part.get_offset() == Point { 13, 10 } &&
+      part.stride() == 30,
+    "sub views are clipped to their view");
+  check(
+    part.get_pixel(3, 2) == sheet->get_pixel(16, 12),
+    "sub views share the pixels");
+  const ImageView corner = frame.sub_view(Rect(-3, -2, 5, 4));
+  check(
+    corner.get_size() == Size(2, 2) && corner.get_offset() == Point { 5, 4 },
+    "sub views are clipped before the view");
+  check(frame.sub_view(Rect(12, 0, 4, 4)).is_empty(), "sub views can be empty");
+
+  auto copy = Image::create(frame.get_size(), PixelFormat::RGBA);
+  for (int y = 0; y < frame.height(); y++)
+  {
+    for (int x = 0; x < frame.width(); x++)
+      copy->set_pixel(x, y, frame.get_pixel(x, y));
+  }
+  // the same pixels without the image, so without its runs
+  const ImageView raw(
+    frame.get_data(), frame.width(), frame.height(), frame.stride(),
+    PixelFormat::RGBA);
+
+  auto background = create_random_image(Size(24, 18));
+  std::vector<std::function<void(Painter &, const ImageView &)>> draws;
+  for (int mode = 0; mode < 6; mode++)
+  {
+    draws.push_back([mode](Painter &p, const ImageView &v) {
+      p.draw_image(-3, 8, v, (BlendMode)(mode));
+    });
+    draws.push_back([mode](Painter &p, const ImageView &v) {
+      p.draw_image(15, -2, v, ImageFlip::Both, (BlendMode)(mode));
+    });
+  }
+  for (auto filter : { ScaleFilter::Nearest, ScaleFilter::Bilinear })
+  {
+    draws.push_back([filter](Painter &p, const ImageView &v) {
+      p.draw_image(2, 1, v, 1.5, 2.25, BlendMode::SrcOver, filter);
+    });
+    draws.push_back([filter](Painter &p, const ImageView &v) {
+      glm::mat3 transform(1.0f);
+      transform[0][0] = 0.0f;
+      transform[0][1] = 1.2f;
+      transform[1][0] = -1.2f;
+      transform[1][1] = 0.0f;
+      transform[2][0] = 14.0f;
+      transform[2][1] = -2.0f;
+      p.draw_image_affine(v, transform, BlendMode::SrcOver, filter);
+    });
+  }
+  draws.push_back([](Painter &p, const ImageView &v) {
+    p.draw_image(4, 4, v, 3.0, 2.0);
+  });
+  draws.push_back([](Painter &p, const ImageView &v) {
+    p.draw_image(-1, 5, v, Rect(2, 3, 9, 5));
+  });
+
+  for (const auto &draw : draws)
+  {
+    auto expected = Image::create(background->get_size(), PixelFormat::RGBA);
+    Painter expected_painter(expected);
+    expected_painter.draw_image(0, 0, *background, BlendMode::Replace);
+    draw(expected_painter, *copy);
+
+    for (const auto *view : { &frame, &raw })
+    {
+      auto image = Image::create(background->get_size(), PixelFormat::RGBA);
+      Painter painter(image);
+      painter.draw_image(0, 0, *background, BlendMode::Replace);
+      draw(painter, *view);
+      check(same_pixels(*image, *expected), "views draw their own pixels");
+    }
+  }
+}
+
+/*
+ *  Glyphs of a monospaced font are the atlas cells copied at the pen
+ *  position, the cells are drawn by hand for the reference.
+ * */
+static void test_text()
+{
+  using namespace ZD;
+
+  // 'A' is a 2x3 block, 'B' a single pixel and a corner, 'C' is empty
+  const Size cell(4, 5);
+  auto atlas = Image::create(Size(12, 5), Color(0, 0, 0, 0), PixelFormat::RGBA);
+  for (int y = 1; y < 4; y++)
+  {
+    for (int x = 1; x < 3; x++)
+      atlas->set_pixel(x, y, Color(255, 255, 255));
+  }
+  atlas->set_pixel(4, 0, Color(255, 255, 255));
+  atlas->set_pixel(7, 4, Color(255, 255, 255));
+
+  auto font = Font::create(*atlas, cell, 'A');
+  auto proportional = Font::create(*atlas, cell, 'A', true, 1);
+
+  const Color background(5, 6, 7);
+  const Color color(200, 100, 50);
+  const std::string_view text = "AB\nCBA\n\nBA";
+  auto draw_reference = [&](Image &image, int x, int y) {
+    int pen_x = 0;
+    int pen_y = 0;
+    for (const char c : text)
+    {
+      if (c == '\n')
+      {
+        pen_x = 0;
+        pen_y += cell.height();
+        continue;
+      }
+
+      const int cell_x = (c - 'A') * cell.width();
+      for (int cy = 0; cy < cell.height(); cy++)
+      {
+        for (int cx = 0; cx < cell.width(); cx++)
+        {
+          const int px = x + pen_x + cx;
+          const int py = y + pen_y + cy;
+          if (
+            atlas->get_pixel(cell_x + cx, cy).alpha() > 0 && px >= 0 &&
+            py >= 0 && px < image.width() && py < image.height())
+            image.set_pixel(px, py, color);
+        }
+      }
+      pen_x += cell.width();
+    }
+  };
+
+  // placement, and glyphs cut by the canvas edges
+  const Size size(14, 20);
+  const Point positions[] = { { 1, 2 }, { -3, -2 }, { 5, 1 }, { 2, 7 } };
+  for (const auto &position : positions)
+  {
+    auto image = Image::create(size, background, PixelFormat::RGBA);
+    auto expected = Image::create(size, background, PixelFormat::RGBA);
+    image->reset_change_counter();
+    Painter painter(image);
+    painter.draw_text(position.x, position.y, *font, text, color);
+    draw_reference(*expected, position.x, position.y);
+    check(same_pixels(*image, *expected), "glyphs are placed on the pen");
+    check(image->is_changed(), "text is marked as changed");
+  }
+
+  // a clip cutting through glyphs
+  const Rect clip(3, 3, 5, 6);
+  auto image = Image::create(size, background, PixelFormat::RGBA);
+  auto expected = Image::create(size, background, PixelFormat::RGBA);
+  Painter painter(image);
+  painter.push_clip(clip);
+  painter.draw_text(1, 2, *font, text, color);
+  draw_reference(*expected, 1, 2);
+  bool clipped = true;
+  for (int y = 0; y < size.height(); y++)
+  {
+    for (int x = 0; x < size.width(); x++)
+    {
+      const Color wanted =
+        clip.contains(x, y) ? expected->get_pixel(x, y) : background;
+      clipped &= image->get_pixel(x, y) == wanted;
+    }
+  }
+  check(clipped, "glyphs are cut by the clip");
+
+  // proportional advance is the visible width and spacing, empty glyphs
+  // and missing characters take half of a cell
+  check(font->measure("") == Size(0, 5), "empty text is a line high");
+  check(font->measure("AB\nCBA") == Size(12, 10), "monospaced lines");
+  check(font->measure("A\n") == Size(4, 10), "new line adds a line");
+  check(
+    proportional->measure("AB\nC B") == Size(9, 10),
+    "proportional lines");
+  check(
+    proportional->measure(std::string_view("AAB").substr(1)) ==
+      proportional->measure("AB"),
+    "measured text isn't read past its end");
+}
+
+// outlines blended with Additive mode show pixels written more than once
+static void test_outlines_drawn_once()
+{
+  using namespace ZD;
+
+  const Color one(1, 1, 1);
+  auto written_once = [](const Image &image) {
+    for (int y = 0; y < image.height(); y++)
+    {
+      for (int x = 0; x < image.width(); x++)
+      {
+        if (image.get_pixel(x, y).red() > 1)
+          return false;
+      }
+    }
+    return true;
+  };
+
+  for (int radius = 0; radius < 24; radius++)
+  {
+    auto image = Image::create(Size(60, 60), Color(0, 0, 0), PixelFormat::RGBA);
+    Painter painter(image);
+    painter.draw_circle(30, 30, radius, one, BlendMode::Additive);
+    check(written_once(*image), "circle pixels are drawn once");
+    check(
+      image->get_pixel(30 + radius, 30).red() == 1 &&
+        image->get_pixel(30, 30 - radius).red() == 1,
+      "circles are drawn");
+
+    // crossing the canvas edge
+    auto clipped = Image::create(Size(60, 60), Color(0, 0, 0), PixelFormat::RGBA);
+    Painter clipped_painter(clipped);
+    clipped_painter.draw_circle(radius - 3, 57, radius, one, BlendMode::Additive);
+    check(written_once(*clipped), "clipped circle pixels are drawn once");
+  }
+
+  auto image = Image::create(Size(60, 60), Color(0, 0, 0), PixelFormat::RGBA);
+  Painter painter(image);
+  painter.draw_rectangle(10, 10, 40, 30, one, BlendMode::Additive);
+  painter.draw_rectangle(50, 5, 50, 20, one, BlendMode::Additive);
+  painter.draw_rectangle(5, 50, 30, 50, one, BlendMode::Additive);
+  painter.draw_rectangle(55, 55, 55, 55, one, BlendMode::Additive);
+  check(written_once(*image), "rectangle pixels are drawn once");
+
+  // closed and open polylines, the closed one partly outside of the canvas
+  const std::vector<Point> closed = {
+    { 5, 5 }, { 30, 8 }, { 25, 40 }, { 8, 30 }, { 5, 5 }
+  };
+  const std::vector<Point> open = { { 40, 40 }, { 58, 45 }, { 50, 58 } };
+  const std::vector<Point> clipped = {
+    { 45, -10 }, { 70, 20 }, { 40, 25 }, { 45, -10 }
+  };
+  const std::vector<Point> single = { { 2, 57 } };
+  auto lines = Image::create(Size(60, 60), Color(0, 0, 0), PixelFormat::RGBA);
+  Painter lines_painter(lines);
+  for (const auto *polyline : { &closed, &open, &clipped, &single })
+    lines_painter.draw_polyline(*polyline, one, BlendMode::Additive);
+  check(written_once(*lines), "polyline pixels are drawn once");
+  bool vertices_drawn = true;
+  for (const auto *polyline : { &closed, &open, &single })
+  {
+    for (const auto &point : *polyline)
+      vertices_drawn &= lines->get_pixel(point.x, point.y).red() == 1;
+  }
+  check(vertices_drawn, "polyline points are drawn");
+}
+
+// split screen: clearing one viewport leaves the other one alone
+template<typename P> static void draw_viewports(P &painter)
+{
+  using namespace ZD;
+
+  painter.push_clip(Rect(0, 0, 40, 50));
+  painter.clear(Color(200, 0, 0));
+  painter.pop_clip();
+  painter.push_clip(Rect(40, 0, 40, 50));
+  painter.fill(Color(0, 200, 0));
+  painter.push_clip(Rect(50, 10, 10, 10));
+  painter.clear();
+  painter.pop_clip();
+  painter.pop_clip();
+}
+
+static void test_clear_clipped()
+{
+  using namespace ZD;
+
+  auto expected = Image::create(Size(80, 50), Color(1, 2, 3), PixelFormat::RGBA);
+  for (int y = 0; y < 50; y++)
+  {
+    for (int x = 0; x < 80; x++)
+    {
+      const bool hole = x >= 50 && x < 60 && y >= 10 && y < 20;
+      expected->set_pixel(
+        x, y, x < 40 ? Color(200, 0, 0) : hole ? Color(0) : Color(0, 200, 0));
+    }
+  }
+
+  auto image = Image::create(Size(80, 50), Color(1, 2, 3), PixelFormat::RGBA);
+  Painter painter(image);
+  draw_viewports(painter);
+  check(same_pixels(*image, *expected), "clear and fill stay in the clip");
+
+  auto parallel_image =
+    Image::create(Size(80, 50), Color(1, 2, 3), PixelFormat::RGBA);
+  ParallelPainter parallel_painter(parallel_image, 3);
+  draw_viewports(parallel_painter);
+  parallel_painter.finish();
+  check(
+    same_pixels(*parallel_image, *expected),
+    "ParallelPainter clear and fill stay in the clip");
+
+  PainterCommandList list(Size(80, 50));
+  draw_viewports(list);
+  list.optimize();
+  auto replayed = Image::create(Size(80, 50), Color(1, 2, 3), PixelFormat::RGBA);
+  Painter replay_painter(replayed);
+  list.replay(replay_painter);
+  check(
+    same_pixels(*replayed, *expected),
+    "PainterCommandList clear and fill stay in the clip");
+}
+
+// bands filtered by worker threads give what a single thread does
+static void test_image_filter()
+{
+  using namespace ZD;
+
+  auto source = create_random_image(Size(203, 157));
+  auto expected = Image::create(source->get_size(), PixelFormat::RGBA);
+  ImageFilter single(1);
+  single.gaussian_blur(*source, *expected, 2.5f);
+
+  ImageFilter filter(4);
+  for (int i = 0; i < 3; i++)
+  {
+    auto image = Image::create(source->get_size(), PixelFormat::RGBA);
+    filter.gaussian_blur(*source, *image, 2.5f);
+    check(same_pixels(*image, *expected), "threads filter as a single one");
+  }
+
+  auto sharpened = Image::create(source->get_size(), PixelFormat::RGBA);
+  single.sharpen(*source, *sharpened, 0.5f);
+  filter.sharpen(*source, 0.5f);
+  check(same_pixels(*source, *sharpened), "threads sharpen as a single one");
+}
+
+// calls draw_scene doesn't make, enough pixels for several batches
+template<typename P>
+static void draw_extras(P &painter, const ZD::Image &sprite)
+{
+  using namespace ZD;
+
+  painter.push_clip(Rect(5, 3, 140, 110));
+  for (int i = 0; i < 6000; i++)
+  {
+    const Color color((i / 100) * 20 % 256, 50, 200, 100);
+    painter.set_pixel(
+      (i * 97) % 170 - 5, (i * 61) % 130 - 5, color,
+      (BlendMode)((i / 500) % 6));
+  }
+
+  std::vector<Point> points;
+  std::vector<Color> colors;
+  for (int i = 0; i < 5000; i++)
+  {
+    points.push_back(Point((i * 31) % 180 - 10, (i * 43) % 140 - 10));
+    colors.push_back(Color(i % 256, (i / 3) % 256, 90, 160));
+  }
+  painter.plot_points(points, Color(255, 0, 0, 60), BlendMode::Additive);
+  painter.plot_points(points, colors, BlendMode::SrcOver);
+
+  const std::vector<Point> outline = { { 10, 10 },
+                                       { 90, 30 },
+                                       { 40, 100 },
+                                       { 10, 10 } };
+  painter.draw_polyline(outline, Color(0, 255, 0, 128), BlendMode::SrcOver);
+  painter.fill_polygon(outline, Color(0, 0, 255, 90), BlendMode::SrcOver);
+  painter.draw_image(70, 60, sprite, Rect(5, 3, 20, 15), BlendMode::SrcOver);
+  painter.draw_image(
+    100, 10, sprite, 50, 30, PreserveAspectRatio, BlendMode::SrcOver,
+    ScaleFilter::Bilinear);
+  const glm::mat3 rotation(
+    0.8f, 0.6f, 0.0f, -0.6f, 0.8f, 0.0f, 40.0f, 10.0f, 1.0f);
+  painter.draw_image_affine(sprite, rotation, BlendMode::SrcOver);
+  painter.draw_rectangle(20, 70, 60, 90, Color(9, 9, 9), BlendMode::Additive);
+  painter.draw_circle(120, 80, 25, Color(90, 9, 9), BlendMode::Additive);
+  painter.clear_rectangle(50, 50, 58, 57);
+
+  Path path;
+  path.move_to(15.5f, 60.0f);
+  path.cubic_to(40.0f, -10.0f, 90.0f, 130.0f, 150.0f, 40.0f);
+  painter.stroke_path(path, 3.0f, Color(200, 200, 0, 200));
+  path.close();
+  painter.fill_path(path, Color(0, 200, 200, 80), FillRule::EvenOdd);
+  painter.pop_clip();
+}
+
+static void test_parallel_painter()
+{
+  using namespace ZD;
+
+  auto sprite = create_random_image(Size(33, 21));
+  auto expected = Image::create(Size(160, 120), PixelFormat::RGBA);
+  Painter painter(expected);
+  draw_scene(painter, *sprite);
+  draw_extras(painter, *sprite);
+
+  for (unsigned int threads : { 1u, 2u, 3u, 7u })
+  {
+    auto image = Image::create(Size(160, 120), PixelFormat::RGBA);
+    ParallelPainter parallel_painter(image, threads);
+    // twice, the second frame reuses the batches of the first one
+    for (int frame = 0; frame < 2; frame++)
+    {
+      draw_scene(parallel_painter, *sprite);
+      draw_extras(parallel_painter, *sprite);
+      parallel_painter.finish();
+      check(
+        same_pixels(*image, *expected),
+        "ParallelPainter draws as Painter does");
+    }
+  }
+}
+
+// overlapping panels, so optimize() has hidden draws and fills to merge
+template<typename P>
+static void draw_panels(P &painter, const ZD::Image &icon)
+{
+  using namespace ZD;
+
+  painter.fill(Color(40, 40, 40));
+  for (int panel = 0; panel < 6; panel++)
+  {
+    const int x = panel * 23 - 10;
+    const int y = panel * 17 - 5;
+    painter.draw_image(x + 5, y + 5, icon);
+    painter.fill_rectangle(x, y, x + 79, y + 59, Color(70, 70, 90));
+    painter.fill_rectangle(x + 80, y, x + 89, y + 59, Color(70, 70, 90));
+    painter.push_clip(Rect(x, y, 90, 60));
+    for (int i = 0; i < 6; i++)
+    {
+      painter.draw_image(x + 4 + i * 15, y + 8, icon);
+      painter.draw_image(
+        x + 4 + i * 15, y + 30, icon, 0.5, 0.5, BlendMode::SrcOver);
+    }
+    painter.draw_line(x, y + 28, x + 90, y + 28, Color(120, 120, 140));
+    painter.clear_rectangle(x + 60, y + 50, x + 70, y + 55);
+    painter.pop_clip();
+  }
+}
+
+static void test_command_list()
+{
+  using namespace ZD;
+
+  const Size size(200, 150);
+  auto icon = create_random_image(Size(12, 14));
+  auto expected = Image::create(size, PixelFormat::RGBA);
+  Painter painter(expected);
+  draw_panels(painter, *icon);
+
+  PainterCommandList list(size);
+  draw_panels(list, *icon);
+  auto unoptimized = Image::create(size, PixelFormat::RGBA);
+  Painter unoptimized_painter(unoptimized);
+  list.replay(unoptimized_painter);
+  check(
+    same_pixels(*unoptimized, *expected),
+    "replay before optimize() draws as Painter does");
+
+  // recorded again after a reset, images and clips start over too
+  list.reset();
+  draw_panels(list, *icon);
+  const size_t recorded = list.size();
+  list.optimize();
+  check(list.size() < recorded, "optimize() removes commands");
+
+  auto image = Image::create(size, PixelFormat::RGBA);
+  Painter replay_painter(image);
+  list.replay(replay_painter);
+  check(same_pixels(*image, *expected), "replay draws as Painter does");
+
+  // replaying a part draws the same pixels there and nothing elsewhere
+  auto part = Image::create(size, Color(1, 2, 3), PixelFormat::RGBA);
+  Painter part_painter(part);
+  const Rect area(30, 20, 90, 70);
+  list.replay(part_painter, area);
+  bool same_part = true;
+  for (int y = 0; y < size.height(); y++)
+  {
+    for (int x = 0; x < size.width(); x++)
+    {
+      const Color wanted =
+        area.contains(x, y) ? expected->get_pixel(x, y) : Color(1, 2, 3);
+      same_part &= part->get_pixel(x, y) == wanted;
+    }
+  }
+  check(same_part, "replay of a part is clipped to it");
+}
+
+static void test_plot_points()
+{
+  using namespace ZD;
+
+  // points around the canvas on every side, some of them twice
+  std::vector<Point> points;
+  std::vector<Color> colors;
+  for (int i = 0; i < 5000; i++)
+  {
+    const int x = (int)(random_value() % 70) - 15;
+    const int y = (int)(random_value() % 60) - 15;
+    points.push_back(Point { x, y });
+    colors.push_back(Color::from_value(random_value()));
+  }
+  for (int i = 0; i < 100; i++)
+  {
+    points.push_back(points[i * 7]);
+    colors.push_back(colors[i * 3]);
+  }
+
+  const Size size(40, 30);
+  const Rect clips[] = { Rect(0, 0, 40, 30), Rect(3, 2, 31, 22) };
+  for (const auto &clip : clips)
+  {
+    for (int mode = 0; mode < 6; mode++)
+    {
+      for (bool colored : { false, true })
+      {
+        const Color color(200, 100, 50, 150);
+        auto image = Image::create(size, Color(5, 6, 7), PixelFormat::RGBA);
+        auto expected =
+          Image::create(size, Color(5, 6, 7), PixelFormat::RGBA);
+        image->reset_change_counter();
+        Painter painter(image);
+        Painter reference(expected);
+        painter.push_clip(clip);
+        reference.push_clip(clip);
+
+        if (colored)
+          painter.plot_points(points, colors, (BlendMode)(mode));
+        else
+          painter.plot_points(points, color, (BlendMode)(mode));
+
+        int left = size.width(), top = size.height(), right = -1, bottom = -1;
+        for (size_t i = 0; i < points.size(); i++)
+        {
+          const Point &p = points[i];
+          reference.set_pixel(
+            p.x, p.y, colored ? colors[i] : color, (BlendMode)(mode));
+          if (!clip.contains(p.x, p.y))
+            continue;
+          left = std::min(left, p.x);
+          top = std::min(top, p.y);
+          right = std::max(right, p.x);
+          bottom = std::max(bottom, p.y);
+        }
+        check(same_pixels(*image, *expected), "points are set pixels");
+
+        bool outside_kept = true;
+        for (int y = 0; y < size.height(); y++)
+        {
+          for (int x = 0; x < size.width(); x++)
+          {
+            if (!clip.contains(x, y))
+              outside_kept &= image->get_pixel(x, y) == Color(5, 6, 7);
+          }
+        }
+        check(outside_kept, "points outside of the clip aren't drawn");
+
+        const auto &rects = image->get_changed_rects();
+        // most of the canvas, so it may be marked whole
+        check(
+          rects.size() == 1 &&
+            rects[0].contains(Rect::from_corners(left, top, right, bottom)),
+          "plotted points are marked as changed");
+      }
+    }
+  }
+
+  // only the points are marked, not the whole rows of the clip
+  auto image = Image::create(Size(200, 150), PixelFormat::RGBA);
+  image->reset_change_counter();
+  Painter painter(image);
+  painter.push_clip(Rect(20, 10, 100, 80));
+  const std::vector<Point> corner = {
+    { 10, 5 }, { 25, 12 }, { 31, 40 }, { 300, 20 }, { -4, 30 }, { 22, 95 }
+  };
+  painter.plot_points(corner, Color(255, 255, 255));
+  const auto &rects = image->get_changed_rects();
+  check(
+    image->is_partially_changed() && rects.size() == 1 &&
+      rects[0] == Rect::from_corners(25, 12, 31, 40),
+    "change covers only the plotted points");
+
+  // overlapping points accumulate
+  const std::vector<Point> same(3, Point { 50, 50 });
+  painter.plot_points(same, Color(10, 20, 30), BlendMode::Additive);
+  const Color sum = image->get_pixel(50, 50);
+  check(
+    sum.red() == 30 && sum.green() == 60 && sum.blue() == 90,
+    "additive points accumulate");
+}
+
+static void test_change_tracking()
+{
+  using namespace ZD;
+
+  auto image = Image::create(Size(1000, 1000), PixelFormat::RGBA);
+  image->reset_change_counter();
+  Painter painter(image);
+
+  // small clusters far apart, more of them than there are rectangles
+  std::vector<Point> points;
+  for (int cluster = 0; cluster < 40; cluster++)
+  {
+    const int x = (cluster % 8) * 125;
+    const int y = (cluster / 8) * 200;
+    for (int i = 0; i < 20; i++)
+    {
+      points.push_back(Point { x + i % 5, y + i / 5 });
+    }
+  }
+  for (const auto &point : points)
+  {
+    painter.set_pixel(point.x, point.y, Color(255, 255, 255));
+  }
+
+  const auto &rects = image->get_changed_rects();
+  check(image->is_partially_changed(), "scattered pixels change a part");
+  check(rects.size() <= 16, "changed rectangles are bounded");
+  bool all_covered = true;
+  for (const auto &point : points)
+  {
+    bool found = false;
+    for (const auto &rect : rects)
+      found |= rect.contains(point.x, point.y);
+    all_covered &= found;
+  }
+  check(all_covered, "changed rectangles cover changed pixels");
+  long changed_area = 0;
+  for (size_t a = 0; a < rects.size(); a++)
+  {
+    changed_area += rects[a].area();
+    for (size_t b = a + 1; b < rects.size(); b++)
+      check(!rects[a].intersects(rects[b]), "changed rectangles don't overlap");
+  }
+  check(changed_area < 1000 * 1000 / 2, "changed rectangles stay small");
+}
+
+static void test_frame_diff()
+{
+  using namespace ZD;
+
+  const int tile = FrameDiff::TILE_SIZE;
+  const Size size(5 * tile + 10, 3 * tile + 7);
+  std::vector<uint32_t> frame(size.width() * size.height());
+  for (auto &pixel : frame)
+    pixel = random_value();
+
+  FrameDiff diff;
+  auto changed = diff.compare(frame.data(), size);
+  check(
+    changed.size() == 1 &&
+      changed[0] == Rect(0, 0, size.width(), size.height()),
+    "first frame is changed as a whole");
+  check(diff.compare(frame.data(), size).empty(), "same frame is unchanged");
+
+  auto covered = [&](int x, int y) {
+    for (const auto &rect : diff.compare(frame.data(), size))
+    {
+      if (rect.contains(x, y))
+        return true;
+    }
+    return false;
+  };
+
+  // changed pixels are inside of the reported rectangles ...
+  const Point pixels[] = { { 0, 0 },
+                           { tile + 3, 2 * tile + 1 },
+                           { size.width() - 1, size.height() - 1 } };
+  for (const auto &point : pixels)
+  {
+    frame[point.y * size.width() + point.x] ^= 0x100;
+    check(covered(point.x, point.y), "FrameDiff finds changed pixels");
+  }
+
+  // ... and these rectangles cover only the changed tiles
+  frame[(2 * tile + 5) * size.width() + 3 * tile + 9] ^= 0x100;
+  frame[(2 * tile + 9) * size.width() + 4 * tile + 2] ^= 0x100;
+  frame[(tile / 2) * size.width() + tile / 2] ^= 0x100;
+  const auto &rects = diff.compare(frame.data(), size);
+  int changed_pixels = 0;
+  for (const auto &rect : rects)
+    changed_pixels += rect.width() * rect.height();
+  check(changed_pixels <= 3 * tile * tile, "FrameDiff reports only changed tiles");
+  bool all_covered = true;
+  for (const auto &point : { Point { 3 * tile + 9, 2 * tile + 5 },
+                             Point { 4 * tile + 2, 2 * tile + 9 },
+                             Point { tile / 2, tile / 2 } })
+  {
+    bool found = false;
+    for (const auto &rect : rects)
+      found |= rect.contains(point.x, point.y);
+    all_covered &= found;
+  }
+  check(all_covered, "FrameDiff covers all changed tiles");
+}
+
+static void test_image_pool()
+{
+  using namespace ZD;
+
+  auto pool = ImagePool::create();
+  auto image = pool->acquire(Size(100, 50), PixelFormat::RGBA);
+  const uint32_t *pixels = image->get_data();
+  image->set_pixel(3, 4, Color(1, 2, 3));
+  image.reset();
+
+  // a close size shares the buffer and is zeroed again
+  image = pool->acquire(Size(99, 50), PixelFormat::RGBA);
+  check(image->get_data() == pixels, "ImagePool reuses buffers");
+  check(image->get_pixel(3, 4).value() == 0, "reused buffers are zeroed");
+  check(pool->get_stats().hits == 1, "ImagePool counts reuses");
+
+  auto other = pool->acquire(Size(100, 50), PixelFormat::RGBA);
+  check(other->get_data() != pixels, "buffers in use aren't shared");
+}
+
+static void test_gray_loading()
+{
+  using namespace ZD;
+
+  const std::string path =
+    std::filesystem::temp_directory_path() / "painter_test_gray.png";
+  const Size size(37, 21);
+  auto source = Image::create(size, PixelFormat::Gray);
+  for (int y = 0; y < size.height(); y++)
+  {
+    for (int x = 0; x < size.width(); x++)
+      source->set_pixel(x, y, Color::from_gray((x * 7 + y * 13) & 0xff));
+  }
+  check(source->save_to_file(path), "gray image is saved");
+
+  // gray files load as BGRA images by default, so they can be painted on
+  auto image = Image::load(path, ForceReload::Yes);
+  check(
+    image && !image->is_compact() && image->get_data() != nullptr,
+    "gray files load as BGRA images");
+  if (image)
+  {
+    check(same_pixels(*image, *source), "gray files keep their pixels as BGRA");
+    Painter painter(image);
+    painter.fill_rectangle(0, 0, 3, 3, Color(1, 2, 3));
+    check(image->get_pixel(1, 1) == Color(1, 2, 3), "loaded gray images are painted on");
+  }
+
+  auto gray = Image::load(path, ForceReload::Yes, KeepGray::Yes);
+  check(
+    gray && gray->get_format() == PixelFormat::Gray,
+    "gray files stay gray when asked to");
+  if (gray)
+    check(same_pixels(*gray, *source), "kept gray files keep their pixels");
+  check(
+    Image::load(path) != gray && Image::load(path, ForceReload::No, KeepGray::Yes) == gray,
+    "gray and BGRA loads are cached separately");
+
+  std::filesystem::remove(path);
+}
+
+static void test_tiled_image()
+{
+  using namespace ZD;
+
+  const std::string path =
+    std::filesystem::temp_directory_path() / "painter_test.zdt";
+  const Size size(TiledImage::TILE_SIZE * 2 + 30, TiledImage::TILE_SIZE + 7);
+  auto source = create_random_image(size);
+  {
+    auto tiled = TiledImage::create(path, size, PixelFormat::RGBA, 2);
+    check(tiled != nullptr, "TiledImage is created");
+    if (!tiled)
+      return;
+
+    tiled->write(0, 0, *source);
+    tiled->set_pixel(size.width() - 1, 0, Color(9, 8, 7));
+    source->set_pixel(size.width() - 1, 0, Color(9, 8, 7));
+  }
+
+  auto tiled = TiledImage::open(path);
+  check(tiled && tiled->get_size() == size, "TiledImage is opened");
+  if (tiled)
+  {
+    auto copy = tiled->read(Rect(0, 0, size.width(), size.height()));
+    check(same_pixels(*copy, *source), "TiledImage keeps written pixels");
+
+    auto part = tiled->read(Rect(-5, 250, 20, 20));
+    check(
+      part->get_pixel(0, 0).value() == 0 &&
+        part->get_pixel(5, 0) == source->get_pixel(0, 250),
+      "TiledImage reads parts outside of the image as 0");
+  }
+  tiled.reset();
+  std::filesystem::remove(path);
+}
+
+auto painter_test_main(int, char **) -> int
+{
+  puts("Painter tests.");
+
+  test_simd_levels();
+  test_clipping();
+  test_affine_blit();
+  test_flipped_runs();
+  test_image_view();
+  test_text();
+  test_outlines_drawn_once();
+  test_clear_clipped();
+  test_parallel_painter();
+  test_image_filter();
+  test_command_list();
+  test_plot_points();
+  test_change_tracking();
+  test_frame_diff();
+  test_image_pool();
+  test_gray_loading();
+  test_tiled_image();
+
+  printf("Painter tests complete, %d failed.\n", failures);
+  return failures;
+}
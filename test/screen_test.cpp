@@ -0,0 +1,171 @@
+#include <atomic>
+#include <cstdio>
+#include <thread>
+
+#include "ZD/Screen.hpp"
+
+static int failures = 0;
+
+static void check(bool condition, const char *what)
+{
+  if (!condition)
+  {
+    printf("Screen test failed: %s\n", what);
+    failures++;
+  }
+}
+
+// takes presented frames as Screen_GL::render does, without uploading them
+class TestScreen : public ZD::Screen
+{
+public:
+  static constexpr int WIDTH = 64;
+  static constexpr int HEIGHT = 48;
+
+  TestScreen()
+  : Screen(0, 0, WIDTH, HEIGHT)
+  {
+  }
+
+  void render(const ZD::RenderTarget &) {}
+
+  // number of the frame taken, -1 without a new frame, -2 for a torn one
+  int take_frame()
+  {
+    if (!take_presented_frame())
+      return -1;
+
+    // frames are painted whole before they are presented, so they are uniform
+    const uint32_t first = front.image->get_pixel(0, 0).value();
+    for (int y = 0; y < HEIGHT; y++)
+    {
+      for (int x = 0; x < WIDTH; x++)
+      {
+        if (front.image->get_pixel(x, y).value() != first)
+          return -2;
+      }
+    }
+    check(
+      front.image->is_changed() && !front.image->is_partially_changed(),
+      "taken frames are uploaded whole");
+    front.image->reset_change_counter();
+    return first >> 8;
+  }
+
+  std::shared_ptr<ZD::Image> front_image() const { return front.image; }
+};
+
+static void paint_frame(ZD::Screen &screen, int frame)
+{
+  const auto color = ZD::Color::from_value(((uint32_t)frame << 8) | 0xff);
+  auto painter = screen.painter();
+  check(painter->get_target() == screen.image(), "painter paints on the canvas");
+  painter->clear(ZD::Color(0, 0, 0));
+  painter->fill_rectangle(0, 0, TestScreen::WIDTH - 1, TestScreen::HEIGHT - 1, color);
+  screen.present_frame();
+}
+
+static void test_single_thread(ZD::CanvasBuffering buffering)
+{
+  TestScreen screen;
+  screen.set_buffering(buffering);
+  check(screen.get_buffering() == buffering, "buffering is set");
+
+  for (int frame = 1; frame <= 100; frame++)
+  {
+    paint_frame(screen, frame);
+    const int taken = screen.take_frame();
+    if (buffering != ZD::CanvasBuffering::Single)
+      check(taken == frame, "presented frames are taken in order");
+  }
+
+  // the rendering thread paints over a presented frame instead of waiting for itself
+  paint_frame(screen, 101);
+  paint_frame(screen, 102);
+  if (buffering != ZD::CanvasBuffering::Single)
+    check(screen.take_frame() == 102, "the last presented frame is taken");
+}
+
+// a painting thread and the rendering thread, no frame may be torn
+static void test_two_threads(ZD::CanvasBuffering buffering)
+{
+  TestScreen screen;
+  screen.set_buffering(buffering);
+
+  const int frames = 1000;
+  std::atomic<bool> done { false };
+  std::thread painting([&]() {
+    for (int frame = 1; frame <= frames; frame++)
+      paint_frame(screen, frame);
+    done = true;
+  });
+
+  int last = 0, taken = 0, torn = 0;
+  while (last < frames)
+  {
+    const bool painted = done;
+    const int frame = screen.take_frame();
+    if (frame == -2)
+      torn++;
+    if (frame > 0)
+    {
+      check(frame > last, "frames are taken in order");
+      last = frame;
+      taken++;
+    }
+    if (frame == -1 && painted)
+      break;
+    if (frame == -1)
+      std::this_thread::yield();
+  }
+  painting.join();
+
+  check(torn == 0, "frames aren't torn");
+  check(last == frames, "the last frame is taken");
+  if (buffering == ZD::CanvasBuffering::Double)
+    check(taken == frames, "double buffering takes every frame");
+}
+
+static void test_buffers()
+{
+  using namespace ZD;
+
+  TestScreen screen;
+  check(screen.front_image() == screen.image(), "single buffering renders the canvas");
+  // without buffering the canvas and its painter never change
+  auto single_painter = screen.painter();
+  screen.present_frame();
+  check(screen.take_frame() == -1, "single buffering has no frames to take");
+  check(screen.painter() == single_painter, "single buffering keeps its painter");
+  screen.set_buffering(CanvasBuffering::Double);
+  check(screen.front_image() != screen.image(), "buffered canvas isn't rendered");
+
+  // every buffer keeps its painter, painters aren't moved to other images
+  auto painter = screen.painter();
+  auto image = screen.image();
+  screen.present_frame();
+  screen.take_frame();
+  check(screen.painter() != painter, "the next buffer has its own painter");
+  check(painter->get_target() == image, "painters keep their buffer");
+  check(screen.front_image() == image, "presented buffer is rendered");
+
+  screen.set_buffering(CanvasBuffering::Single);
+  check(screen.front_image() == screen.image(), "single buffering renders the canvas again");
+}
+
+auto screen_test_main(int, char **) -> int
+{
+  using namespace ZD;
+
+  puts("Screen tests.");
+
+  test_single_thread(CanvasBuffering::Single);
+  test_single_thread(CanvasBuffering::Double);
+  test_single_thread(CanvasBuffering::Triple);
+  test_two_threads(CanvasBuffering::Double);
+  test_two_threads(CanvasBuffering::Triple);
+  test_buffers();
+
+  printf("Screen tests complete, %d failed.\n", failures);
+  return failures;
+}